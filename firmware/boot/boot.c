@@ -0,0 +1,350 @@
+/**
+ * @file  boot.c
+ * @brief Serial bootloader (first flash rows), update application over UART
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "boot.h"
+#include "hardware.h"
+
+#define BOOT_UART  SERCOM1_ADDR
+#define BOOT_GCLK  8000000
+#define CONF_BAUD  (65536 - ((65536 * 16.0f * BOOT_BAUD) / BOOT_GCLK))
+/* Max delay between two bytes of a request (loops, ~20ms) */
+#define BOOT_BYTE_WAIT 20000
+
+static void boot_reset(void);
+static void boot_fault(void);
+static void boot_main(void) __attribute__((noreturn));
+static int  boot_getc(u32 wait);
+static void boot_send(u8 status, const u8 *data, u32 len);
+static u16  boot_crc(u16 crc, const u8 *p, u32 len);
+static int  flash_cmd(u32 cmd, u32 addr);
+static int  flash_page(u32 addr, const u32 *data);
+
+/* The bootloader has no C runtime (no .data nor .bss), only a minimal
+ * vector table : initial stack pointer and reset. */
+__attribute__((section(".vectors"), used))
+static void (* const boot_vectors[4])(void) = {
+	(void (*)(void))BOOT_MAILBOX, /* Stack ends under the mailbox */
+	boot_reset,
+	boot_fault,                   /* NMI                          */
+	boot_fault                    /* HardFault                    */
+};
+
+/**
+ * @brief Entry point after reset
+ *
+ * When no update is requested (mailbox) and the application vector table
+ * looks valid, the application is started immediately : only a few reads
+ * are done before the jump, clocks and peripherals are untouched.
+ */
+static void boot_reset(void)
+{
+	volatile u32 *mbox = (volatile u32 *)BOOT_MAILBOX;
+	const u32 *app = (const u32 *)BOOT_APP_ADDR;
+	u32 sp = app[0];
+	u32 pc = app[1];
+
+	if (((mbox[0] != BOOT_MAGIC) || (mbox[1] != ~(u32)BOOT_MAGIC)) &&
+	    ((sp & 3) == 0) && (sp > 0x20000000) && (sp <= BOOT_MAILBOX) &&
+	    (pc > BOOT_APP_ADDR) && (pc < (BOOT_APP_ADDR + BOOT_APP_SIZE)))
+	{
+		/* Use application vector table (VTOR) */
+		reg_wr(SCB_VTOR, BOOT_APP_ADDR);
+		asm volatile("msr msp, %0 \n"
+		             "bx  %1      \n" : : "r" (sp), "r" (pc));
+	}
+	mbox[0] = 0;
+	mbox[1] = 0;
+	boot_main();
+}
+
+/**
+ * @brief Default handler for faults, wait for a reset
+ *
+ */
+static void boot_fault(void)
+{
+	while(1)
+		;
+}
+
+/**
+ * @brief Bootloader main loop : receive requests and process them
+ *
+ */
+static void boot_main(void)
+{
+	u8  req[4 + BOOT_BLOCK + 2];
+	u32 page[BOOT_BLOCK / 4];
+	u32 page0[BOOT_BLOCK / 4];
+	int page0_valid = 0; /* 0: none, 1: pending, 2: written */
+	u32 i, len, addr, v;
+	u16 crc;
+	int c;
+	u8  status;
+
+	/* OSC8M : clear prescaler (8MHz) */
+	v = reg_rd(SYSCTRL_ADDR + SYSCTRL_OSC8M) & ~SYSCTRL_OSC8M_PRESC_Msk;
+	reg_wr(SYSCTRL_ADDR + SYSCTRL_OSC8M, v);
+	/* Flash : manual page write (MANW) */
+	reg_wr(NVM_ADDR + NVMCTRL_CTRLB, NVMCTRL_CTRLB_MANW);
+
+	/* SERCOM1 as UART on PA24 (TX) and PA25 (RX) */
+	reg_set(PM_ADDR + PM_APBCMASK, PM_APBCMASK_SERCOM1);
+	reg16_wr(GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	         FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_SERCOM1));
+	reg_wr(BOOT_UART + SERCOM_CTRLA, SERCOM_USART_CTRLA_DORD |
+	       FIELD(SERCOM_USART_CTRLA_RXPO, 3) |
+	       FIELD(SERCOM_USART_CTRLA_TXPO, 1) |
+	       FIELD(SERCOM_CTRLA_MODE, SERCOM_MODE_USART_INT));
+	reg_wr(BOOT_UART + SERCOM_CTRLB, SERCOM_USART_CTRLB_RXEN | SERCOM_USART_CTRLB_TXEN);
+	reg16_wr(BOOT_UART + SERCOM_BAUD, CONF_BAUD);
+	reg_set(BOOT_UART + SERCOM_CTRLA, SERCOM_CTRLA_ENABLE);
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(24), PORT_PINCFG_PMUXEN);
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(25), PORT_PINCFG_PMUXEN);
+	reg8_wr(PORT_IOBUS + PORT_PMUX(24), FIELD(PORT_PMUX_PMUXO, PORT_FUNC_C) |
+	                                    FIELD(PORT_PMUX_PMUXE, PORT_FUNC_C));
+
+	while(1)
+	{
+		/* Wait for start of frame */
+		if (boot_getc(0) != BOOT_SOF_REQ)
+			continue;
+		/* Receive header (cmd, len, addr) */
+		for (i = 0; i < 4; i++)
+		{
+			if ((c = boot_getc(BOOT_BYTE_WAIT)) < 0)
+				break;
+			req[i] = c;
+		}
+		if ((i < 4) || (req[1] > BOOT_BLOCK))
+			continue;
+		/* Receive data and CRC */
+		len = req[1];
+		for (i = 0; i < len + 2; i++)
+		{
+			if ((c = boot_getc(BOOT_BYTE_WAIT)) < 0)
+				break;
+			req[4 + i] = c;
+		}
+		if (i < len + 2)
+			continue;
+		crc = boot_crc(0xFFFF, req, 4 + len);
+		if ((req[4 + len] != (crc & 0xFF)) || (req[5 + len] != (crc >> 8)))
+		{
+			boot_send(BOOT_ERR_CRC, 0, 0);
+			continue;
+		}
+		addr = req[2] | (req[3] << 8);
+
+		status = BOOT_OK;
+		switch (req[0])
+		{
+			case BOOT_CMD_INFO:
+				req[0] = BOOT_VERSION;
+				req[1] = BOOT_BLOCK;
+				req[2] = (BOOT_APP_ADDR & 0xFF);
+				req[3] = (BOOT_APP_ADDR >> 8);
+				req[4] = (BOOT_APP_SIZE & 0xFF);
+				req[5] = (BOOT_APP_SIZE >> 8);
+				boot_send(BOOT_OK, req, 6);
+				continue;
+
+			case BOOT_CMD_ERASE:
+				page0_valid = 0;
+				for (v = 0; v < BOOT_APP_SIZE; v += BOOT_ROW_SIZE)
+				{
+					if (flash_cmd(NVMCTRL_CMD_ER, BOOT_APP_ADDR + v))
+						status = BOOT_ERR_FLASH;
+				}
+				break;
+
+			case BOOT_CMD_WRITE:
+				if ((len != BOOT_BLOCK) || (addr & (BOOT_BLOCK - 1)) ||
+				    (addr >= BOOT_APP_SIZE))
+				{
+					status = BOOT_ERR_PARAM;
+					break;
+				}
+				for (i = 0; i < (BOOT_BLOCK / 4); i++)
+					page[i] = req[4 + (i * 4)] | (req[5 + (i * 4)] << 8) |
+					          (req[6 + (i * 4)] << 16) | ((u32)req[7 + (i * 4)] << 24);
+				/* First page (vector table) is kept and written after verify */
+				if (addr == 0)
+				{
+					for (i = 0; i < (BOOT_BLOCK / 4); i++)
+						page0[i] = page[i];
+					page0_valid = 1; /* Pending */
+				}
+				else if (flash_page(BOOT_APP_ADDR + addr, page))
+					status = BOOT_ERR_FLASH;
+				break;
+
+			case BOOT_CMD_VERIFY:
+				v = req[4] | (req[5] << 8);
+				if ((len != 4) || (v < BOOT_BLOCK) || (v > BOOT_APP_SIZE) || !page0_valid)
+				{
+					status = BOOT_ERR_PARAM;
+					break;
+				}
+				crc = boot_crc(0xFFFF, (const u8 *)page0, BOOT_BLOCK);
+				crc = boot_crc(crc, (const u8 *)(BOOT_APP_ADDR + BOOT_BLOCK), v - BOOT_BLOCK);
+				if ((req[6] != (crc & 0xFF)) || (req[7] != (crc >> 8)))
+					status = BOOT_ERR_VERIFY;
+				/* Image is good, write vector table : application valid.
+				 * Page is kept in RAM, a repeated VERIFY (lost response)
+				 * gives the same result without writing it again. */
+				else if (page0_valid == 1)
+				{
+					if (flash_page(BOOT_APP_ADDR, page0))
+						status = BOOT_ERR_FLASH;
+					else
+						page0_valid = 2;
+				}
+				break;
+
+			case BOOT_CMD_RUN:
+				boot_send(BOOT_OK, 0, 0);
+				/* Wait end of transmission (TXC) then reset */
+				while ((reg8_rd(BOOT_UART + SERCOM_INTFLAG) & SERCOM_USART_INT_TXC) == 0)
+					;
+				reg_wr(SCB_AIRCR, SCB_AIRCR_VECTKEY |
+				                  SCB_AIRCR_SYSRESETREQ);
+				while(1)
+					;
+
+			default:
+				status = BOOT_ERR_PARAM;
+				break;
+		}
+		boot_send(status, 0, 0);
+	}
+}
+
+/**
+ * @brief Receive one byte from UART
+ *
+ * @param wait Max number of loops to wait (0 for no timeout)
+ * @return integer Received byte, or -1 on timeout
+ */
+static int boot_getc(u32 wait)
+{
+	while ((reg8_rd(BOOT_UART + SERCOM_INTFLAG) & SERCOM_USART_INT_RXC) == 0)
+	{
+		if (wait && (--wait == 0))
+			return(-1);
+	}
+	return(reg16_rd(BOOT_UART + SERCOM_DATA) & 0xFF);
+}
+
+/**
+ * @brief Send a response frame
+ *
+ * @param status Status code (BOOT_OK or BOOT_ERR_xx)
+ * @param data   Pointer to response data (if any)
+ * @param len    Length of response data
+ */
+static void boot_send(u8 status, const u8 *data, u32 len)
+{
+	u8  hdr[2];
+	u16 crc;
+	u32 i;
+
+	hdr[0] = status;
+	hdr[1] = len;
+	crc = boot_crc(0xFFFF, hdr, 2);
+	crc = boot_crc(crc, data, len);
+
+	for (i = 0; i < (len + 5); i++)
+	{
+		while ((reg8_rd(BOOT_UART + SERCOM_INTFLAG) & SERCOM_USART_INT_DRE) == 0)
+			;
+		if (i == 0)
+			reg16_wr(BOOT_UART + SERCOM_DATA, BOOT_SOF_RSP);
+		else if (i < 3)
+			reg16_wr(BOOT_UART + SERCOM_DATA, hdr[i - 1]);
+		else if (i < (len + 3))
+			reg16_wr(BOOT_UART + SERCOM_DATA, data[i - 3]);
+		else if (i == (len + 3))
+			reg16_wr(BOOT_UART + SERCOM_DATA, crc & 0xFF);
+		else
+			reg16_wr(BOOT_UART + SERCOM_DATA, crc >> 8);
+	}
+}
+
+/**
+ * @brief Compute CRC-16/Modbus (bitwise, small code)
+ *
+ * @param crc Initial value (0xFFFF) or result of previous block
+ * @param p   Pointer to data
+ * @param len Number of bytes
+ * @return u16 Updated CRC
+ */
+static u16 boot_crc(u16 crc, const u8 *p, u32 len)
+{
+	int i;
+
+	while (len--)
+	{
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+	}
+	return(crc);
+}
+
+/**
+ * @brief Execute a NVM controller command and wait until it completes
+ *
+ * @param cmd  Command to execute
+ * @param addr Byte address of the targeted row/page
+ * @return integer Zero on success, -1 on error (STATUS)
+ */
+static int flash_cmd(u32 cmd, u32 addr)
+{
+	/* Wait for NVM controller ready (INTFLAG.READY) */
+	while ((reg8_rd(NVM_ADDR + NVMCTRL_INTFLAG) & NVMCTRL_INT_READY) == 0)
+		;
+	/* Clear previous errors (STATUS) */
+	reg16_wr(NVM_ADDR + NVMCTRL_STATUS,
+	         NVMCTRL_STATUS_LOAD | NVMCTRL_STATUS_ERRORS);
+	/* ADDR register use 16 bits words address */
+	reg_wr(NVM_ADDR + NVMCTRL_ADDR, (addr >> 1));
+	/* Write command with execution key (CMDEX) */
+	reg16_wr(NVM_ADDR + NVMCTRL_CTRLA, NVMCTRL_CTRLA_CMDEX | cmd);
+	while ((reg8_rd(NVM_ADDR + NVMCTRL_INTFLAG) & NVMCTRL_INT_READY) == 0)
+		;
+	/* Test PROGE, LOCKE and NVME */
+	if (reg16_rd(NVM_ADDR + NVMCTRL_STATUS) & NVMCTRL_STATUS_ERRORS)
+		return(-1);
+	return(0);
+}
+
+/**
+ * @brief Write one page of flash (must be erased)
+ *
+ * @param addr Address of the page
+ * @param data Pointer to the page content (BOOT_BLOCK bytes)
+ * @return integer Zero on success, -1 on error
+ */
+static int flash_page(u32 addr, const u32 *data)
+{
+	u32 i;
+
+	flash_cmd(NVMCTRL_CMD_PBC, 0);
+	for (i = 0; i < (BOOT_BLOCK / 4); i++)
+		reg_wr(addr + (i * 4), data[i]);
+	return(flash_cmd(NVMCTRL_CMD_WP, addr));
+}
+/* EOF */
@@ -0,0 +1,68 @@
+/**
+ * @file  acq.c
+ * @brief Acquisition mode : periodic (TC1) or external trigger (EIC)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "acq.h"
+#include "cmd.h"
+#include "nvconf.h"
+#include "sampler.h"
+
+/**
+ * @brief Set default acquisition settings (CPU, periodic trigger)
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void acq_default(struct acq_conf *conf)
+{
+	conf->mode = ACQ_CPU;
+	conf->reserved[0] = 0;
+	conf->reserved[1] = 0;
+	conf->reserved[2] = 0;
+}
+
+#if SAMPLER_EXT
+/**
+ * @brief Handler of the "ACQ" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void acq_cmd(int argc, char **argv)
+{
+	if (argc == 1)
+	{
+		if (nvconf.acq.mode == ACQ_EXT)
+			cmd_puts("ACQ EXT");
+		else
+			cmd_puts("ACQ CPU");
+		/* Triggers, lost samples and max trigger latency (us) */
+		cmd_puts("\r\nACQ STAT");
+		cmd_putint(sampler_seq());
+		cmd_putint(sampler_overrun());
+		cmd_putint(sampler_phase_max());
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "CPU"))
+		nvconf.acq.mode = ACQ_CPU;
+	else if ((argc == 2) && cmd_match(argv[1], "EXT"))
+		nvconf.acq.mode = ACQ_EXT;
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+#endif
+/* EOF */
@@ -0,0 +1,42 @@
+/**
+ * @file  acq.h
+ * @brief Headers and definitions for the acquisition mode (sampling trigger)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef ACQ_H
+#define ACQ_H
+#include "sampler.h"
+#include "types.h"
+
+/* Acquisition modes (value 1 is reserved) */
+#define ACQ_CPU 0  /* Sensor read by the CPU on each trigger (default) */
+#define ACQ_EXT 2  /* Sensor read by the CPU on an external trigger    */
+
+/**
+ * Acquisition settings, applied on startup (use SAVE then reset). The
+ * external trigger is only used with the text output mode (not with
+ * Modbus) and needs the IRQ line (point to point).
+ */
+struct acq_conf
+{
+	u8  mode;     /* ACQ_CPU or ACQ_EXT                  */
+	u8  reserved[3];
+};
+
+void acq_default(struct acq_conf *conf);
+#if SAMPLER_EXT
+void acq_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
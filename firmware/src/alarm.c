@@ -0,0 +1,269 @@
+/**
+ * @file  alarm.c
+ * @brief Threshold alarm with hysteresis, driven on a PMOD GPIO
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "alarm.h"
+#include "bus.h"
+#include "cmd.h"
+#include "hardware.h"
+#include "nvconf.h"
+#include "time.h"
+
+#if ALARM_OUTPUT
+static void alarm_output(void);
+
+static const char * const alm_names[2] = { "RH", "TEMP" };
+
+static uint alm_state;
+/* Channels in error (output is active, state is kept) */
+static uint alm_error;
+/* Output pin is driven (not used by the RS-485 bus) */
+static int  alm_pin;
+/* Delay from sensor result to output update (CPU cycles) */
+static u32  alm_lat_last;
+static u32  alm_lat_max;
+#endif
+
+/**
+ * @brief Set default alarm settings (disabled)
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void alarm_default(struct alarm_conf *conf)
+{
+	conf->enable     = 0;
+	conf->active_low = 0;
+	conf->reserved   = 0;
+	/* RH : 20% - 80% */
+	conf->chan[ALARM_RH].enable = 1;
+	conf->chan[ALARM_RH].hyst   = 200;
+	conf->chan[ALARM_RH].low    = 2000;
+	conf->chan[ALARM_RH].high   = 8000;
+	/* Temperature : 5 - 35 deg C */
+	conf->chan[ALARM_TEMP].enable = 1;
+	conf->chan[ALARM_TEMP].hyst   = 50;
+	conf->chan[ALARM_TEMP].low    = 500;
+	conf->chan[ALARM_TEMP].high   = 3500;
+}
+
+#if ALARM_OUTPUT
+/**
+ * @brief Configure the output pin (when alarm is enabled)
+ *
+ * The pin is only driven in point to point mode : on a RS-485 bus it is
+ * the driver enable of the transceiver, with an external trigger it is
+ * the trigger input. Alarm state is still computed and
+ * sent with samples.
+ */
+void alarm_init(void)
+{
+	alm_state = 0;
+	alm_error = 0;
+	alm_pin   = (nvconf.alarm.enable && (nvconf.bus.mode == BUS_P2P) &&
+	             (nvconf.acq.mode != ACQ_EXT));
+	if (alm_pin == 0)
+		return;
+	/* Inactive level, then output */
+	alarm_output();
+	reg_wr(PORT_IOBUS + PORT_DIRSET, (1 << ALARM_PIN));
+}
+
+/**
+ * @brief Check a new value against thresholds and update the output
+ *
+ * Called as soon as the sensor result is available (before any other
+ * processing of the sample) : the pin is updated with a single-cycle IO
+ * port write.
+ *
+ * @param chan  Channel of the value (ALARM_RH or ALARM_TEMP)
+ * @param value New value (1/100 unit)
+ * @param error Non-zero if the value could not be read
+ * @param t0    Time of the end of the conversion (time_cycles)
+ */
+void alarm_update(uint chan, int value, int error, u32 t0)
+{
+	const struct alarm_chan *c = &nvconf.alarm.chan[chan];
+	uint low  = (chan == ALARM_RH) ? ALARM_RH_LOW  : ALARM_TEMP_LOW;
+	uint high = (chan == ALARM_RH) ? ALARM_RH_HIGH : ALARM_TEMP_HIGH;
+	uint state = alm_state;
+
+	if ((nvconf.alarm.enable == 0) || (c->enable == 0))
+		return;
+
+	if (error)
+		alm_error |= (1 << chan);
+	else
+	{
+		alm_error &= ~(1 << chan);
+		if (state & high)
+		{
+			if (value < (c->high - (int)c->hyst))
+				state &= ~high;
+		}
+		else if (value > c->high)
+			state |= high;
+		if (state & low)
+		{
+			if (value > (c->low + (int)c->hyst))
+				state &= ~low;
+		}
+		else if (value < c->low)
+			state |= low;
+		alm_state = state;
+	}
+	alarm_output();
+
+	alm_lat_last = time_cycles() - t0;
+	if (alm_lat_last > alm_lat_max)
+		alm_lat_max = alm_lat_last;
+}
+
+/**
+ * @brief Get the current alarm state
+ *
+ * @return uint Active alarms (ALARM_xx_LOW / ALARM_xx_HIGH flags)
+ */
+uint alarm_state(void)
+{
+	return(alm_state);
+}
+
+/**
+ * @brief Handler of the "ALARM" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void alarm_cmd(int argc, char **argv)
+{
+	struct alarm_conf *conf = &nvconf.alarm;
+	struct alarm_chan *c;
+	int low, high, hyst;
+	uint i;
+
+	if (argc == 1)
+	{
+		cmd_puts(conf->enable ? "ALARM ON\r\n" : "ALARM OFF\r\n");
+		cmd_puts(conf->active_low ? "ALARM LEVEL LOW\r\n" : "ALARM LEVEL HIGH\r\n");
+		for (i = 0; i < 2; i++)
+		{
+			cmd_puts("ALARM ");
+			cmd_puts(alm_names[i]);
+			if (conf->chan[i].enable == 0)
+				cmd_puts(" OFF");
+			else
+			{
+				cmd_putint(conf->chan[i].low);
+				cmd_putint(conf->chan[i].high);
+				cmd_putint(conf->chan[i].hyst);
+			}
+			cmd_puts("\r\n");
+		}
+		/* Current state, and output level (-1 if not driven) */
+		cmd_puts("ALARM STATE");
+		cmd_putint(alm_state);
+		cmd_putint(alm_error);
+		cmd_putint(alm_pin ? (int)((reg_rd(PORT_IOBUS + PORT_OUT) >> ALARM_PIN) & 1) : -1);
+		/* Delay from sensor result to pin update (cycles, 8 per us) */
+		cmd_puts("\r\nALARM LATENCY");
+		cmd_putint(alm_lat_last);
+		cmd_putint(alm_lat_max);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "ON"))
+	{
+		conf->enable = 1;
+		alarm_init();
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "OFF"))
+	{
+		/* Release the pin : back to input (high impedance) */
+		if (alm_pin)
+			reg_wr(PORT_IOBUS + PORT_DIRCLR, (1 << ALARM_PIN));
+		alm_pin   = 0;
+		alm_state = 0;
+		alm_error = 0;
+		conf->enable = 0;
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "RESET"))
+	{
+		alm_lat_last = 0;
+		alm_lat_max  = 0;
+	}
+	else if ((argc == 3) && cmd_match(argv[1], "LEVEL"))
+	{
+		if (cmd_match(argv[2], "HIGH"))
+			conf->active_low = 0;
+		else if (cmd_match(argv[2], "LOW"))
+			conf->active_low = 1;
+		else
+			goto err;
+		alarm_output();
+	}
+	else if ((argc == 3) || (argc == 5))
+	{
+		if (cmd_match(argv[1], "RH"))
+			c = &conf->chan[ALARM_RH];
+		else if (cmd_match(argv[1], "TEMP"))
+			c = &conf->chan[ALARM_TEMP];
+		else
+			goto err;
+		if (argc == 3)
+		{
+			if ( ! cmd_match(argv[2], "OFF"))
+				goto err;
+			c->enable = 0;
+		}
+		else
+		{
+			if (cmd_atoi(argv[2], &low) || cmd_atoi(argv[3], &high) ||
+			    cmd_atoi(argv[4], &hyst))
+				goto err;
+			if ((low > high) || (hyst < 0) || (hyst > (high - low)))
+				goto err;
+			c->low    = low;
+			c->high   = high;
+			c->hyst   = hyst;
+			c->enable = 1;
+		}
+		/* New thresholds : evaluated again from next sample */
+		alm_state = 0;
+		alarm_output();
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Set the output pin according to the alarm state
+ *
+ */
+static void alarm_output(void)
+{
+	int active;
+
+	if (alm_pin == 0)
+		return;
+	active = ((alm_state | alm_error) != 0) ^ (nvconf.alarm.active_low != 0);
+	if (active)
+		reg_wr(PORT_IOBUS + PORT_OUTSET, (1 << ALARM_PIN));
+	else
+		reg_wr(PORT_IOBUS + PORT_OUTCLR, (1 << ALARM_PIN));
+}
+#endif
+/* EOF */
@@ -0,0 +1,75 @@
+/**
+ * @file  alarm.h
+ * @brief Headers and definitions for the threshold alarm output
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef ALARM_H
+#define ALARM_H
+#include "types.h"
+
+/* Define to 1 to add the threshold alarm (ALARM command) */
+#ifndef ALARM_OUTPUT
+#define ALARM_OUTPUT 0
+#endif
+
+/* PA02 : IRQ line of the PMOD connector (shared with the RS-485 DE) */
+#define ALARM_PIN 2
+
+/* Channels */
+#define ALARM_RH   0
+#define ALARM_TEMP 1
+
+/* Alarm state (also into the status of samples, see SAMPLE_ALARM_Pos) */
+#define ALARM_RH_LOW    (1 << 0)
+#define ALARM_RH_HIGH   (1 << 1)
+#define ALARM_TEMP_LOW  (1 << 2)
+#define ALARM_TEMP_HIGH (1 << 3)
+
+/**
+ * Thresholds of a channel (1/100 unit). The high alarm is set when the value
+ * goes above "high" and cleared when it goes below "high - hyst", the low
+ * alarm is set below "low" and cleared above "low + hyst".
+ */
+struct alarm_chan
+{
+	u16 enable;
+	u16 hyst;
+	int low;
+	int high;
+};
+
+struct alarm_conf
+{
+	u8  enable;       /* Thresholds are checked for each sample  */
+	u8  active_low;   /* Output level when an alarm is active    */
+	u16 reserved;
+	struct alarm_chan chan[2];
+};
+
+void alarm_default(struct alarm_conf *conf);
+#if ALARM_OUTPUT
+void alarm_init(void);
+void alarm_update(uint chan, int value, int error, u32 t0);
+uint alarm_state(void);
+void alarm_cmd(int argc, char **argv);
+#else
+static inline void alarm_init(void) { }
+static inline void alarm_update(uint chan, int value, int error, u32 t0)
+{
+	(void)chan; (void)value; (void)error; (void)t0;
+}
+static inline uint alarm_state(void) { return(0); }
+#endif
+
+#endif
+/* EOF */
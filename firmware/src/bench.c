@@ -0,0 +1,149 @@
+/**
+ * @file  bench.c
+ * @brief Compare execution time of code into flash and into SRAM
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "bench.h"
+#include "cmd.h"
+#include "hardware.h"
+#include "time.h"
+
+static u32 bench_flash(u32 n);
+RAMFUNC static u32 bench_ram(u32 n);
+static u32 bench_div(u32 n);
+static u32 bench_run(u32 (*fct)(u32 n));
+
+/* Operands of the division test (volatile : not computed at build time) */
+static volatile u32 bench_num = 0x7FFFFFFF;
+static volatile u32 bench_den = 3;
+
+/**
+ * @brief Benchmark loop : shift and xor (LFSR), like CRC and bit loops
+ *
+ * Always inlined, so the flash and SRAM versions have the same code.
+ *
+ * @param n Number of iterations
+ * @return u32 Result (to not be removed by the compiler)
+ */
+static inline __attribute__((always_inline)) u32 bench_loop(u32 n)
+{
+	u32 x = 0x12345678;
+
+	while (n--)
+		x = (x >> 1) ^ ((0 - (x & 1)) & 0xEDB88320);
+	return(x);
+}
+
+/**
+ * @brief Handler of the "BENCH" command
+ *
+ * The same loop is executed from flash and from SRAM with each setting of
+ * flash wait states (RWS), then the division helper (into SRAM) is called
+ * from flash. A line with the number of CPU cycles of the three tests is
+ * sent for each setting. The CPU runs at 8MHz, wait states are set to get
+ * the cycle counts of a faster clock (see Readme).
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void bench_cmd(int argc, char **argv)
+{
+	u32 ctrlb;
+	u32 rws;
+
+	(void)argv;
+
+	if (argc != 1)
+	{
+		cmd_error();
+		return;
+	}
+	ctrlb = reg_rd(NVM_ADDR + NVMCTRL_CTRLB);
+	for (rws = 0; rws <= BENCH_RWS_MAX; rws++)
+	{
+		/* Set RWS (NVMCTRL CTRLB bits 1-4) */
+		reg_wr(NVM_ADDR + NVMCTRL_CTRLB, (ctrlb & ~NVMCTRL_CTRLB_RWS_Msk) |
+		       FIELD(NVMCTRL_CTRLB_RWS, rws));
+		cmd_puts("BENCH");
+		cmd_putint(rws);
+		cmd_putint(bench_run(bench_flash));
+		cmd_putint(bench_run(bench_ram));
+		cmd_putint(bench_run(bench_div));
+		cmd_puts("\r\n");
+	}
+	reg_wr(NVM_ADDR + NVMCTRL_CTRLB, ctrlb);
+	cmd_ok();
+}
+
+/**
+ * @brief Run a benchmark function and count CPU cycles
+ *
+ * Best of 4 runs, to ignore the runs interrupted by a handler.
+ *
+ * @param fct Pointer to the benchmark function
+ * @return u32 Number of cycles (including the call)
+ */
+static u32 bench_run(u32 (*fct)(u32 n))
+{
+	u32 best = 0xFFFFFFFF;
+	u32 t0, t;
+	int i;
+
+	for (i = 0; i < 4; i++)
+	{
+		t0 = time_cycles();
+		fct(BENCH_LOOPS);
+		t = time_cycles() - t0;
+		if (t < best)
+			best = t;
+	}
+	return(best);
+}
+
+/**
+ * @brief Benchmark loop executed from flash
+ *
+ * @param n Number of iterations
+ * @return u32 Result of the loop
+ */
+static u32 bench_flash(u32 n)
+{
+	return(bench_loop(n));
+}
+
+/**
+ * @brief Benchmark loop executed from SRAM
+ *
+ * @param n Number of iterations
+ * @return u32 Result of the loop
+ */
+RAMFUNC static u32 bench_ram(u32 n)
+{
+	return(bench_loop(n));
+}
+
+/**
+ * @brief Call the division helper (__aeabi_uidiv) from flash
+ *
+ * @param n Number of divisions
+ * @return u32 Sum of results
+ */
+static u32 bench_div(u32 n)
+{
+	u32 sum = 0;
+
+	while (n--)
+		sum += bench_num / bench_den;
+	return(sum);
+}
+/* EOF */
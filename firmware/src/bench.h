@@ -0,0 +1,32 @@
+/**
+ * @file  bench.h
+ * @brief Headers and definitions for the flash/SRAM execution benchmark
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+#include "types.h"
+
+/* Define to 1 to add the BENCH command */
+#ifndef BENCH_CMD
+#define BENCH_CMD   0
+#endif
+/* Number of iterations of the benchmark loop */
+#define BENCH_LOOPS 256
+/* Max number of flash wait states to test (NVMCTRL RWS) */
+#define BENCH_RWS_MAX 3
+
+void bench_cmd(int argc, char **argv);
+
+#endif
+/* EOF */
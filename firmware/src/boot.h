@@ -0,0 +1,54 @@
+/**
+ * @file  boot.h
+ * @brief Definitions shared by the bootloader and the application
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BOOT_H
+#define BOOT_H
+
+/* Flash layout : bootloader into first rows, application above (see
+ * BOOT_SIZE into pmod-trh.ld) */
+#define BOOT_SIZE      0x400
+#define BOOT_APP_ADDR  0x400
+#define BOOT_APP_SIZE  (0x2000 - BOOT_APP_ADDR)
+#define BOOT_ROW_SIZE  256
+#define BOOT_BLOCK     64        /* Data per WRITE request (one page)  */
+
+/* Last 8 bytes of RAM are not used by the application (see pmod-trh.ld).
+ * When the application writes magic and ~magic here before a reset, the
+ * bootloader stays active instead of starting the application. */
+#define BOOT_MAILBOX   0x20000FF8
+#define BOOT_MAGIC     0x544F4F42 /* "BOOT" */
+
+#define BOOT_BAUD      230400
+#define BOOT_VERSION   1
+
+/* Protocol : request  A5 <cmd> <len> <addr:16> <data:len> <crc:16>
+ *            response 5A <status> <len> <data:len> <crc:16>
+ * Little endian. CRC-16/Modbus of all bytes after start of frame. */
+#define BOOT_SOF_REQ    0xA5
+#define BOOT_SOF_RSP    0x5A
+#define BOOT_CMD_INFO   0x01  /* Get version and flash layout          */
+#define BOOT_CMD_ERASE  0x02  /* Erase the whole application area      */
+#define BOOT_CMD_WRITE  0x03  /* Write one block (addr = offset)       */
+#define BOOT_CMD_VERIFY 0x04  /* Check image (size:16, crc:16) and commit */
+#define BOOT_CMD_RUN    0x05  /* Reset and start application           */
+/* Status of a response */
+#define BOOT_OK         0x00
+#define BOOT_ERR_CRC    0x01
+#define BOOT_ERR_PARAM  0x02
+#define BOOT_ERR_VERIFY 0x03
+#define BOOT_ERR_FLASH  0x04
+
+#endif
+/* EOF */
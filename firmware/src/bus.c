@@ -0,0 +1,234 @@
+/**
+ * @file  bus.c
+ * @brief Multi-drop (RS-485) bus : addressing, polling and TDMA slots
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "bus.h"
+#include "cmd.h"
+#include "nvconf.h"
+#include "time.h"
+#include "uart.h"
+
+#if BUS_RS485
+static void bus_tick(u32 now);
+
+/* TDMA schedule (in ms from start of cycle) */
+static u32 bus_cycle;
+static u32 bus_start;
+static u32 bus_end;
+static volatile u32 bus_pos;
+/* Last sample, for READ requests */
+static struct sample bus_last;
+static int bus_valid;
+static int bus_read;
+#endif
+
+/**
+ * @brief Set default bus settings (point to point)
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void bus_default(struct bus_conf *conf)
+{
+	conf->mode    = BUS_P2P;
+	conf->slots   = 8;
+	conf->slot_ms = 100;
+}
+
+#if BUS_RS485
+/**
+ * @brief Initialize bus mode from configuration (after uart_init)
+ *
+ */
+void bus_init(void)
+{
+	const struct bus_conf *conf = &nvconf.bus;
+	u32 slot;
+
+	bus_valid = 0;
+	bus_read  = 0;
+	if (conf->mode == BUS_P2P)
+		return;
+
+	/* RS-485 : driver enabled only during transmission */
+	uart_de_enable();
+
+	if (conf->mode != BUS_TDMA)
+		return;
+	/* Settings saved by an older firmware may have a longer cycle */
+	if ((u32)conf->slots * conf->slot_ms > BUS_CYCLE_MAX)
+		nvconf.bus.slot_ms = BUS_CYCLE_MAX / conf->slots;
+	slot = nvconf.modbus_addr % conf->slots;
+	bus_cycle = conf->slots * conf->slot_ms;
+	bus_start = slot * conf->slot_ms;
+	bus_end   = bus_start + conf->slot_ms - BUS_GUARD_MS;
+	bus_pos   = 0;
+	/* Wait for our slot before sending anything */
+	uart_tx_gate(0);
+	time_hook(bus_tick);
+}
+
+/**
+ * @brief Test if a command line is for this node
+ *
+ * @param line Pointer to the received command line
+ * @return char* Pointer to the command (after the address), or null if the
+ *               line must be ignored
+ */
+char *bus_match(char *line)
+{
+	uint addr = 0;
+
+	if (nvconf.bus.mode == BUS_P2P)
+		return(line);
+
+	if (*line++ != '@')
+		return(0);
+	while ((*line >= '0') && (*line <= '9'))
+	{
+		addr = (addr * 10) + (*line++ - '0');
+		if (addr > 255)
+			return(0);
+	}
+	if (addr != nvconf.modbus_addr)
+		return(0);
+	return(line);
+}
+
+/**
+ * @brief Remember a sample and test if it can be sent now
+ *
+ * @param s Pointer to the last acquired sample
+ * @return integer One if the sample can be sent (zero in POLL mode)
+ */
+int bus_output(const struct sample *s)
+{
+	bus_last  = *s;
+	bus_valid = 1;
+	return(nvconf.bus.mode != BUS_POLL);
+}
+
+/**
+ * @brief Get the sample requested by a READ command (if any)
+ *
+ * @return struct sample* Pointer to the last sample, or null if no request
+ */
+const struct sample *bus_request(void)
+{
+	if ((bus_read == 0) || (bus_valid == 0))
+		return(0);
+	bus_read = 0;
+	return(&bus_last);
+}
+
+/**
+ * @brief Handler of the "BUS" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void bus_cmd(int argc, char **argv)
+{
+	struct bus_conf *conf = &nvconf.bus;
+	int a, b;
+
+	if (argc == 1)
+	{
+		if (conf->mode == BUS_TDMA)
+		{
+			cmd_puts("BUS TDMA");
+			cmd_putint(conf->slot_ms);
+			cmd_putint(conf->slots);
+		}
+		else
+			cmd_puts((conf->mode == BUS_POLL) ? "BUS POLL" : "BUS OFF");
+		cmd_puts("\r\nBUS ADDR");
+		cmd_putint(nvconf.modbus_addr);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "OFF"))
+		conf->mode = BUS_P2P;
+	else if ((argc == 2) && cmd_match(argv[1], "POLL"))
+		conf->mode = BUS_POLL;
+	else if ((argc == 4) && cmd_match(argv[1], "TDMA"))
+	{
+		if (cmd_atoi(argv[2], &a) || cmd_atoi(argv[3], &b))
+			goto err;
+		if ((a < BUS_SLOT_MIN) || (a > BUS_SLOT_MAX))
+			goto err;
+		if ((b < 2) || (a * b > BUS_CYCLE_MAX))
+			goto err;
+		/* Slot 0 is for the master */
+		if ((b < 2) || (b > BUS_SLOTS_MAX) || ((nvconf.modbus_addr % b) == 0))
+			goto err;
+		conf->mode    = BUS_TDMA;
+		conf->slot_ms = a;
+		conf->slots   = b;
+	}
+	else if ((argc == 3) && cmd_match(argv[1], "ADDR"))
+	{
+		if (cmd_atoi(argv[2], &a) || (a < 1) || (a > 247))
+			goto err;
+		if ((conf->mode == BUS_TDMA) && ((a % conf->slots) == 0))
+			goto err;
+		nvconf.modbus_addr = a;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Handler of the "READ" command : send the last sample
+ *
+ * The sample line (followed by OK) is sent by the main loop, see
+ * bus_request().
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void bus_read_cmd(int argc, char **argv)
+{
+	(void)argv;
+
+	if (argc != 1)
+	{
+		cmd_error();
+		return;
+	}
+	bus_read = 1;
+}
+
+/**
+ * @brief Update the TDMA schedule (called by SysTick interrupt, each ms)
+ *
+ * @param now Current time (ms)
+ */
+static void bus_tick(u32 now)
+{
+	u32 syn;
+
+	/* Cycle is restarted by the master (SYN), or runs on local clock */
+	if (uart_rx_syn(&syn))
+		bus_pos = now - syn;
+	else
+		bus_pos++;
+	if (bus_pos >= bus_cycle)
+		bus_pos = 0;
+	uart_tx_gate((bus_pos >= bus_start) && (bus_pos < bus_end));
+}
+#endif
+/* EOF */
@@ -0,0 +1,72 @@
+/**
+ * @file  bus.h
+ * @brief Headers and definitions for multi-drop (RS-485) bus modes
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef BUS_H
+#define BUS_H
+#include "sampler.h"
+#include "types.h"
+
+/* Define to 1 to add the RS-485 bus modes (BUS and READ commands) */
+#ifndef BUS_RS485
+#define BUS_RS485  0
+#endif
+
+/* Bus modes */
+#define BUS_P2P   0  /* Point to point : lines are sent as soon as ready */
+#define BUS_POLL  1  /* RS-485, a sample is sent on request (READ)       */
+#define BUS_TDMA  2  /* RS-485, lines are sent into the slot of the node */
+
+/* Time kept free at end of a slot (ms) : last bytes and clock drift */
+#define BUS_GUARD_MS  3
+#define BUS_SLOT_MIN  10
+#define BUS_SLOT_MAX  (BUS_CYCLE_MAX / 2)
+#define BUS_SLOTS_MAX 64
+/* Longest TDMA cycle (ms). A full transmit FIFO waits for the next slot :
+ * this must stay well under the watchdog early warning (2s) */
+#define BUS_CYCLE_MAX 1000
+
+/**
+ * Multi-drop settings. The node address is shared with Modbus. In POLL and
+ * TDMA modes, only command lines starting with "@<address>" are executed.
+ * In TDMA mode the cycle is divided into "slots" slots of "slot_ms", the
+ * node transmits only into slot (address modulo slots). Slot 0 is kept for
+ * the master, that can synchronize all nodes by sending a SYN byte (0x16)
+ * at the start of each cycle.
+ */
+struct bus_conf
+{
+	u8  mode;
+	u8  slots;        /* Number of slots per cycle (TDMA)          */
+	u16 slot_ms;      /* Length of a slot (ms)                     */
+};
+
+void bus_default(struct bus_conf *conf);
+#if BUS_RS485
+void bus_init(void);
+char *bus_match(char *line);
+int  bus_output(const struct sample *s);
+const struct sample *bus_request(void);
+void bus_cmd(int argc, char **argv);
+void bus_read_cmd(int argc, char **argv);
+#else
+/* Point to point only : all lines are executed, all samples are sent */
+static inline void bus_init(void) { }
+static inline char *bus_match(char *line) { return(line); }
+static inline int bus_output(const struct sample *s) { (void)s; return(1); }
+static inline const struct sample *bus_request(void) { return(0); }
+#endif
+
+#endif
+/* EOF */
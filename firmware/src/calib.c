@@ -0,0 +1,165 @@
+/**
+ * @file  calib.c
+ * @brief Per-device calibration of humidity and temperature
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "calib.h"
+#include "cmd.h"
+#include "fixmath.h"
+#include "nvconf.h"
+
+static void calib_print(const char *name, const struct calib_chan *cal);
+
+/**
+ * @brief Set default (identity) calibration
+ *
+ * @param cal Pointer to the calibration to initialize
+ */
+void calib_default(struct calib_chan *cal)
+{
+	cal->offset = 0;
+	cal->gain   = CALIB_GAIN_ONE;
+	cal->knee   = 0;
+	cal->gain2  = 0;
+}
+
+/**
+ * @brief Apply calibration to a raw value
+ *
+ * @param cal Pointer to the calibration coefficients
+ * @param x   Raw value (1/100 unit)
+ * @return integer Calibrated value (1/100 unit)
+ */
+int calib_apply(const struct calib_chan *cal, int x)
+{
+	int y;
+
+	if ((cal->gain2 == 0) || (x < cal->knee))
+		y = fx_mul(x, cal->gain);
+	else
+		y = fx_mul(cal->knee, cal->gain) + fx_mul(x - cal->knee, cal->gain2);
+
+	return(y + cal->offset);
+}
+
+/**
+ * @brief Apply calibration of the humidity channel
+ *
+ * @param rh Raw relative humidity (1/100 %)
+ * @return unsigned integer Calibrated humidity, limited to 0 - 100%
+ */
+unsigned int calib_rh(int rh)
+{
+	int v;
+
+	v = calib_apply(&nvconf.cal_rh, rh);
+	if (v < 0)
+		v = 0;
+	if (v > 10000)
+		v = 10000;
+	return(v);
+}
+
+/**
+ * @brief Apply calibration of the temperature channel
+ *
+ * @param temp Raw temperature (1/100 deg C)
+ * @return integer Calibrated temperature (1/100 deg C)
+ */
+int calib_temp(int temp)
+{
+	return(calib_apply(&nvconf.cal_temp, temp));
+}
+
+/**
+ * @brief Handler of the "CAL" command
+ *
+ * CAL                                   Print current calibration
+ * CAL RESET                             Restore default calibration
+ * CAL <RH|TEMP> ofs gain [knee gain2]   Set calibration of one channel
+ *
+ * Offset and knee are in 1/100 unit, gains are in 1/10000 (10000 = 1.0,
+ * up to CALIB_GAIN_MAX).
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void calib_cmd(int argc, char **argv)
+{
+	struct calib_chan cal;
+	struct calib_chan *target;
+	int v[4];
+	int i;
+
+	if (argc == 1)
+	{
+		calib_print("RH",   &nvconf.cal_rh);
+		calib_print("TEMP", &nvconf.cal_temp);
+		cmd_ok();
+		return;
+	}
+	if ((argc == 2) && cmd_match(argv[1], "RESET"))
+	{
+		calib_default(&nvconf.cal_rh);
+		calib_default(&nvconf.cal_temp);
+		cmd_ok();
+		return;
+	}
+
+	if (cmd_match(argv[1], "RH"))
+		target = &nvconf.cal_rh;
+	else if (cmd_match(argv[1], "TEMP"))
+		target = &nvconf.cal_temp;
+	else
+		goto err;
+	if ((argc != 4) && (argc != 6))
+		goto err;
+
+	v[2] = 0;
+	v[3] = 0;
+	for (i = 0; i < (argc - 2); i++)
+	{
+		if (cmd_atoi(argv[i + 2], &v[i]))
+			goto err;
+	}
+	/* Gains (1/10000) to Q16 : 65536 / 10000 = 4096 / 625 */
+	if (((uint)v[1] > CALIB_GAIN_MAX) || ((uint)v[3] > CALIB_GAIN_MAX))
+		goto err;
+	cal.offset = v[0];
+	cal.gain   = ((uint)v[1] * 4096) / 625;
+	cal.knee   = v[2];
+	cal.gain2  = ((uint)v[3] * 4096) / 625;
+	*target = cal;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Print the calibration of one channel
+ *
+ * @param name Name of the channel
+ * @param cal  Pointer to the calibration to print
+ */
+static void calib_print(const char *name, const struct calib_chan *cal)
+{
+	cmd_puts("CAL ");
+	cmd_puts(name);
+	cmd_putint(cal->offset);
+	cmd_putint(fx_mul(cal->gain, 10000));
+	cmd_putint(cal->knee);
+	cmd_putint(fx_mul(cal->gain2, 10000));
+	cmd_puts("\r\n");
+}
+/* EOF */
@@ -0,0 +1,46 @@
+/**
+ * @file  calib.h
+ * @brief Headers and definitions for sensor calibration
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef CALIB_H
+#define CALIB_H
+#include "types.h"
+
+/* Gain of 1.0 (Q16) */
+#define CALIB_GAIN_ONE 65536
+/* Max gain accepted by the CAL command (1/10000, 10.0) */
+#define CALIB_GAIN_MAX 100000
+
+/**
+ * Calibration of one channel (values in 1/100 unit, gains in Q16)
+ *   y = x.gain + offset                              if x < knee
+ *   y = knee.gain + (x - knee).gain2 + offset        if x >= knee
+ * The second segment is only used when gain2 is not zero.
+ */
+struct calib_chan
+{
+	int offset;
+	int gain;
+	int knee;
+	int gain2;
+};
+
+void calib_default(struct calib_chan *cal);
+int  calib_apply(const struct calib_chan *cal, int x);
+unsigned int calib_rh(int rh);
+int  calib_temp(int temp);
+void calib_cmd(int argc, char **argv);
+
+#endif
+/* EOF */
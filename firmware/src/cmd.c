@@ -0,0 +1,292 @@
+/**
+ * @file  cmd.c
+ * @brief Interpreter for commands received on the serial link
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "acq.h"
+#include "alarm.h"
+#include "bench.h"
+#include "bus.h"
+#include "calib.h"
+#include "irq.h"
+#include "cmd.h"
+#include "format.h"
+#include "modbus.h"
+#include "nvconf.h"
+#include "power.h"
+#include "report.h"
+#include "si7021.h"
+#include "stack.h"
+#include "stats.h"
+#include "trace.h"
+#include "uart.h"
+#include "update.h"
+#include "wdt.h"
+
+static void cmd_exec(char *line);
+
+/* List of supported commands */
+static const struct cmd_entry cmd_table[] = {
+#if SAMPLER_EXT
+	{ "ACQ",  acq_cmd    },
+#endif
+#if ALARM_OUTPUT
+	{ "ALARM", alarm_cmd },
+#endif
+#if BENCH_CMD
+	{ "BENCH", bench_cmd },
+#endif
+#if BUS_RS485
+	{ "BUS",  bus_cmd    },
+#endif
+	{ "CAL",  calib_cmd  },
+#if FORMAT_MACHINE
+	{ "FORMAT", format_cmd },
+#endif
+#if IRQ_STATS
+	{ "IRQ",  irq_cmd    },
+#endif
+#if STACK_CMD
+	{ "MEM",  stack_cmd  },
+#endif
+#if MODBUS_SLAVE
+	{ "MODE", modbus_cmd },
+#endif
+#if POWER_STATS
+	{ "POWER", power_cmd },
+#endif
+#if BUS_RS485
+	{ "READ", bus_read_cmd },
+#endif
+#if REPORT_RBE
+	{ "REPORT", report_cmd },
+#endif
+	{ "SAVE", nvconf_cmd },
+#if SI7021_CMD
+	{ "SENSOR", si7021_cmd },
+#endif
+#if STATS_WINDOW
+	{ "STATS", stats_cmd },
+#endif
+#if TRACE_SIZE > 0
+	{ "TRACE", trace_cmd },
+#endif
+#if BOOTLOADER
+	{ "UPDATE", update_cmd },
+#endif
+#if WDT_CMD
+	{ "WDT",  wdt_cmd    },
+#endif
+	{ 0, 0 }
+};
+
+static char cmd_line[CMD_LINE_SIZE];
+static uint cmd_len;
+static int  cmd_overflow;
+
+/**
+ * @brief Initialize the command interpreter
+ *
+ */
+void cmd_init(void)
+{
+	cmd_len = 0;
+	cmd_overflow = 0;
+}
+
+/**
+ * @brief Process received bytes, execute a command when a line is complete
+ *
+ * This function does not block and must be called periodically.
+ */
+void cmd_poll(void)
+{
+	int c;
+
+	while ((c = uart_getc()) >= 0)
+	{
+		/* End of line */
+		if ((c == '\r') || (c == '\n'))
+		{
+			if (cmd_overflow)
+				cmd_error();
+			else if (cmd_len)
+			{
+				cmd_line[cmd_len] = 0;
+				cmd_exec(cmd_line);
+			}
+			cmd_len = 0;
+			cmd_overflow = 0;
+		}
+		/* Backspace */
+		else if ((c == 0x08) || (c == 0x7F))
+		{
+			if (cmd_len)
+				cmd_len--;
+		}
+		else if (cmd_len < (CMD_LINE_SIZE - 1))
+			cmd_line[cmd_len++] = c;
+		else
+			cmd_overflow = 1;
+	}
+}
+
+/**
+ * @brief Convert a decimal string (with optional sign) into integer
+ *
+ * @param s Pointer to the string to convert
+ * @param v Pointer to a variable where the value can be stored
+ * @return integer Zero on success, -1 if the string is not a number or if
+ *                 the value does not fit into an int
+ */
+int cmd_atoi(const char *s, int *v)
+{
+	unsigned int n = 0;
+	int neg = 0;
+
+	if (*s == '-')
+	{
+		neg = 1;
+		s++;
+	}
+	else if (*s == '+')
+		s++;
+	if (*s == 0)
+		return(-1);
+	while (*s)
+	{
+		if ((*s < '0') || (*s > '9'))
+			return(-1);
+		/* Too many digits, the next value would overflow */
+		if (n > (0x7FFFFFFF / 10))
+			return(-1);
+		n = (n * 10) + (*s - '0');
+		s++;
+	}
+	if (n > 0x7FFFFFFF)
+		return(-1);
+	*v = neg ? -(int)n : (int)n;
+	return(0);
+}
+
+/**
+ * @brief Compare a string with a reference keyword (case insensitive)
+ *
+ * @param s   String to test
+ * @param ref Reference keyword (upper case)
+ * @return integer One if strings match, zero otherwise
+ */
+int cmd_match(const char *s, const char *ref)
+{
+	char c;
+
+	while (*ref)
+	{
+		c = *s++;
+		if ((c >= 'a') && (c <= 'z'))
+			c -= ('a' - 'A');
+		if (c != *ref++)
+			return(0);
+	}
+	return(*s == 0);
+}
+
+/**
+ * @brief Send a text-string as (part of) a response
+ *
+ * @param s Pointer to the null terminated text string
+ */
+void cmd_puts(const char *s)
+{
+	uart_puts((char *)s);
+}
+
+/**
+ * @brief Send a signed integer (preceded by a space) into a response
+ *
+ * @param v Value to send
+ */
+void cmd_putint(int v)
+{
+	uart_putc(' ');
+	if (v < 0)
+	{
+		uart_putc('-');
+		v = -v;
+	}
+	uart_putdec(v);
+}
+
+/**
+ * @brief Terminate a command with a success status
+ *
+ */
+void cmd_ok(void)
+{
+	uart_puts("OK\r\n");
+}
+
+/**
+ * @brief Terminate a command with an error status
+ *
+ */
+void cmd_error(void)
+{
+	uart_puts("ERROR\r\n");
+}
+
+/**
+ * @brief Split a command line into arguments and call the handler
+ *
+ * @param line Pointer to the command line (modified)
+ */
+static void cmd_exec(char *line)
+{
+	char *argv[CMD_ARGS];
+	int argc = 0;
+	int i;
+
+	/* On a shared bus, only lines sent to this node are executed */
+	if ((line = bus_match(line)) == 0)
+		return;
+	/* Split line into words */
+	while (*line)
+	{
+		while (*line == ' ')
+			*line++ = 0;
+		if (*line == 0)
+			break;
+		if (argc == CMD_ARGS)
+		{
+			cmd_error();
+			return;
+		}
+		argv[argc++] = line;
+		while (*line && (*line != ' '))
+			line++;
+	}
+	if (argc == 0)
+		return;
+
+	/* Search the command and call handler */
+	for (i = 0; cmd_table[i].name; i++)
+	{
+		if (cmd_match(argv[0], cmd_table[i].name))
+		{
+			cmd_table[i].fct(argc, argv);
+			return;
+		}
+	}
+	cmd_error();
+}
+/* EOF */
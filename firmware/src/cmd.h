@@ -0,0 +1,42 @@
+/**
+ * @file  cmd.h
+ * @brief Headers and definitions for the serial command interpreter
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef CMD_H
+#define CMD_H
+#include "types.h"
+
+/* Max length of a command line (including null byte) */
+#define CMD_LINE_SIZE 48
+/* Max number of arguments (including command name) */
+#define CMD_ARGS      8
+
+struct cmd_entry
+{
+	const char *name;
+	void (*fct)(int argc, char **argv);
+};
+
+void cmd_init(void);
+void cmd_poll(void);
+/* Helpers for command handlers */
+int  cmd_atoi (const char *s, int *v);
+int  cmd_match(const char *s, const char *ref);
+void cmd_puts (const char *s);
+void cmd_putint(int v);
+void cmd_ok(void);
+void cmd_error(void);
+
+#endif
+/* EOF */
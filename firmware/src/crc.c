@@ -0,0 +1,45 @@
+/**
+ * @file  crc.c
+ * @brief CRC computation (CRC-16, Modbus polynomial)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "crc.h"
+
+/* Reflected polynomial 0xA001, processed by nibble to keep table small */
+static const u16 crc16_tab[16] = {
+	0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+	0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400
+};
+
+/**
+ * @brief Update a CRC-16 (Modbus) with a block of data
+ *
+ * Executed from SRAM : called for each Modbus frame (received and sent)
+ * and for the whole configuration block.
+ *
+ * @param crc  Current value of the CRC (CRC16_INIT for a new one)
+ * @param data Pointer to the data to process
+ * @param len  Number of bytes to process
+ * @return u16 Updated value of the CRC
+ */
+RAMFUNC u16 crc16(u16 crc, const u8 *data, uint len)
+{
+	while (len--)
+	{
+		crc ^= *data++;
+		crc = (crc >> 4) ^ crc16_tab[crc & 0x0F];
+		crc = (crc >> 4) ^ crc16_tab[crc & 0x0F];
+	}
+	return(crc);
+}
+/* EOF */
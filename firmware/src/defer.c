@@ -0,0 +1,57 @@
+/**
+ * @file  defer.c
+ * @brief Deferred jobs, executed when main loop has nothing else to do
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "defer.h"
+
+static void (*defer_list[DEFER_SIZE])(void);
+static uint defer_count;
+
+/**
+ * @brief Register a job to execute later (when main loop is idle)
+ *
+ * This is used to keep non critical work (startup informations, ...) out of
+ * the path between reset and the first sample.
+ *
+ * @param fct Pointer to the function to call
+ * @return integer Zero on success, -1 if the list is full
+ */
+int defer(void (*fct)(void))
+{
+	if (defer_count >= DEFER_SIZE)
+		return(-1);
+	defer_list[defer_count++] = fct;
+	return(0);
+}
+
+/**
+ * @brief Execute the oldest deferred job (if any)
+ *
+ * @return integer One if a job has been executed, zero if list is empty
+ */
+int defer_run(void)
+{
+	void (*fct)(void);
+	uint i;
+
+	if (defer_count == 0)
+		return(0);
+	fct = defer_list[0];
+	defer_count--;
+	for (i = 0; i < defer_count; i++)
+		defer_list[i] = defer_list[i + 1];
+	fct();
+	return(1);
+}
+/* EOF */
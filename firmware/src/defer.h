@@ -0,0 +1,27 @@
+/**
+ * @file  defer.h
+ * @brief Headers and definitions for deferred (background) jobs
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef DEFER_H
+#define DEFER_H
+#include "types.h"
+
+/* Max number of jobs waiting to be executed */
+#define DEFER_SIZE 4
+
+int defer(void (*fct)(void));
+int defer_run(void);
+
+#endif
+/* EOF */
@@ -0,0 +1,220 @@
+/**
+ * @file  fixmath.c
+ * @brief Fixed point (Q16.16) arithmetic for processor without FPU
+ *
+ * The Cortex-M0+ has a 32x32 multiplier (32 bits result only) and no
+ * divider, and libgcc is not linked. All functions here only use 32 bits
+ * operations. Logarithm and exponential are computed with small tables and
+ * a linear interpolation.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "fixmath.h"
+
+/* log2(e) in Q20 */
+#define FX_LOG2E_Q20 1512775
+
+/* log2(1 + i/16) in Q16, for i = 0..15 (the value for i = 16 is 65536) */
+static const u16 fx_log2_tab[16] = {
+	    0,  5732, 11136, 16248, 21098, 25711, 30109, 34312,
+	38336, 42196, 45904, 49472, 52911, 56229, 59434, 62534
+};
+
+/* 2^(i/64) - 1 in Q16, for i = 0..63 (the value for i = 64 is 65536) */
+static const u16 fx_exp2_tab[64] = {
+	    0,   714,  1435,  2164,  2902,  3647,  4400,  5162,
+	 5932,  6710,  7496,  8292,  9096,  9908, 10730, 11560,
+	12400, 13249, 14106, 14974, 15850, 16737, 17633, 18538,
+	19454, 20379, 21315, 22260, 23216, 24183, 25160, 26148,
+	27146, 28155, 29175, 30207, 31249, 32303, 33369, 34446,
+	35534, 36635, 37747, 38872, 40009, 41158, 42320, 43495,
+	44682, 45882, 47095, 48322, 49562, 50815, 52082, 53363,
+	54658, 55966, 57289, 58627, 59979, 61346, 62727, 64124
+};
+
+/**
+ * @brief Multiply two Q16 values
+ *
+ * The product is computed from 16 bits partial products so no 64 bits
+ * arithmetic is needed. The result must fit into 32 bits.
+ *
+ * @param a First operand (Q16)
+ * @param b Second operand (Q16)
+ * @return integer Rounded result of (a * b) in Q16
+ */
+int fx_mul(int a, int b)
+{
+	u32 ua, ub;
+	u32 r;
+	int neg = 0;
+
+	if (a < 0)
+	{
+		ua  = -a;
+		neg = 1;
+	}
+	else
+		ua = a;
+	if (b < 0)
+	{
+		ub  = -b;
+		neg = !neg;
+	}
+	else
+		ub = b;
+
+	r  = ((ua >> 16) * (ub >> 16)) << 16;
+	r += (ua >> 16) * (ub & 0xFFFF);
+	r += (ua & 0xFFFF) * (ub >> 16);
+	r += ((ua & 0xFFFF) * (ub & 0xFFFF) + 0x8000) >> 16;
+
+	return(neg ? -(int)r : (int)r);
+}
+
+/**
+ * @brief Divide two values, result in Q16
+ *
+ * The integer part is computed by a standard division then the 16 bits of
+ * fractional part by a restoring (shift and subtract) loop.
+ *
+ * @param a Dividend
+ * @param b Divisor (same format as dividend, non zero)
+ * @return integer Rounded result of (a / b) in Q16
+ */
+int fx_div(int a, int b)
+{
+	u32 ua, ub;
+	u32 q, r;
+	int neg = 0;
+	int i;
+
+	if (a < 0)
+	{
+		ua  = -a;
+		neg = 1;
+	}
+	else
+		ua = a;
+	if (b < 0)
+	{
+		ub  = -b;
+		neg = !neg;
+	}
+	else
+		ub = b;
+
+	q = ua / ub;
+	r = ua - (q * ub);
+	for (i = 0; i < 16; i++)
+	{
+		q <<= 1;
+		r <<= 1;
+		if (r >= ub)
+		{
+			r -= ub;
+			q |= 1;
+		}
+	}
+	/* Round to nearest */
+	if ((r << 1) >= ub)
+		q++;
+
+	return(neg ? -(int)q : (int)q);
+}
+
+/**
+ * @brief Compute the base 2 logarithm of an integer
+ *
+ * @param x Input value (integer, must be >= 1)
+ * @return integer Value of log2(x) in Q16
+ */
+int fx_log2(u32 x)
+{
+	u32 n, f, i;
+	u32 y, next;
+
+	if (x == 0)
+		return(0);
+
+	/* Search the position of the MSB (integer part of the result) */
+	for (n = 0; (x >> n) > 1; n++)
+		;
+	/* Normalize the mantissa to [2^31 - 2^32[ */
+	x = x << (31 - n);
+	/* Interpolate the fractional part */
+	i = (x >> 27) & 0x0F;
+	f = (x >> 11) & 0xFFFF;
+	y    = fx_log2_tab[i];
+	next = (i < 15) ? fx_log2_tab[i + 1] : 65536;
+	y   += ((next - y) * f) >> 16;
+
+	return((n << 16) + y);
+}
+
+/**
+ * @brief Compute the natural exponential of a Q16 value
+ *
+ * The result must be lower than 2^15 (input lower than ~10.3).
+ *
+ * @param x Input value (Q16)
+ * @return integer Value of e^x in Q16
+ */
+int fx_exp(int x)
+{
+	int y, k;
+	u32 f, i, v, next;
+
+	/* e^x = 2^(x * log2(e)), log2(e) in Q20 for better precision */
+	y = (fx_mul(x, FX_LOG2E_Q20) + 8) >> 4;
+	/* Split integer and fractional part (floor) */
+	k = y >> 16;
+	f = (u32)y & 0xFFFF;
+	/* Interpolate 2^f */
+	i = f >> 10;
+	v    = fx_exp2_tab[i];
+	next = (i < 63) ? fx_exp2_tab[i + 1] : 65536;
+	v   += (((next - v) * ((f & 0x3FF) << 6)) >> 16) + 65536;
+
+	if (k >= 0)
+		return(v << k);
+	if (k < -31)
+		return(0);
+	return(v >> -k);
+}
+
+/**
+ * @brief Compute the integer square root
+ *
+ * @param x Input value
+ * @return u32 Largest integer r such as (r * r) <= x
+ */
+u32 fx_isqrt(u32 x)
+{
+	u32 r = 0;
+	u32 b = (1UL << 30);
+
+	while (b > x)
+		b >>= 2;
+	while (b)
+	{
+		if (x >= r + b)
+		{
+			x -= r + b;
+			r  = (r >> 1) + b;
+		}
+		else
+			r >>= 1;
+		b >>= 2;
+	}
+	return(r);
+}
+/* EOF */
@@ -0,0 +1,32 @@
+/**
+ * @file  fixmath.h
+ * @brief Headers and definitions for fixed point (Q16.16) arithmetic
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef FIXMATH_H
+#define FIXMATH_H
+#include "types.h"
+
+/* Value of 1.0 in Q16.16 */
+#define FX_ONE   65536
+/* Constants in Q16.16 */
+#define FX_LN2   45426  /* ln(2)   */
+
+int fx_mul (int a, int b);
+int fx_div (int a, int b);
+int fx_log2(u32 x);
+int fx_exp (int x);
+u32 fx_isqrt(u32 x);
+
+#endif
+/* EOF */
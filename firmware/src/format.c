@@ -0,0 +1,655 @@
+/**
+ * @file  format.c
+ * @brief Sample output formats : text, CSV, JSON lines and InfluxDB line protocol
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "bus.h"
+#include "cmd.h"
+#include "format.h"
+#include "metrics.h"
+#include "nvconf.h"
+#include "stats.h"
+#include "time.h"
+#include "uart.h"
+
+static void fmt_text(const struct sample *s);
+#if FORMAT_MACHINE
+static void fmt_csv(const struct sample *s);
+static void fmt_json(const struct sample *s);
+static void fmt_influx(const struct sample *s);
+#endif
+#if STATS_WINDOW
+static void fmt_result(const char *name, const struct stats_result *r);
+#endif
+#if FORMAT_MACHINE
+static void fmt_clock(u32 time, u32 *sec, u32 *us, int update);
+static void fmt_serial(void);
+static void fmt_time(u32 time, int ns);
+#endif
+static void fmt_fixed(int v, char sep);
+static void fmt_digits(u32 v, uint n);
+
+#if FORMAT_MACHINE
+static const char * const fmt_names[FORMAT_COUNT] = {
+	"TEXT", "CSV", "JSON", "INFLUX"
+};
+
+/* Serial number of the sensor */
+static u8  fmt_id[8];
+static int fmt_id_known;
+/* Device clock (extends the 32 bits sample time), and wall clock offset */
+static u32 fmt_ref_time;
+static u32 fmt_ref_sec;
+static u32 fmt_ref_us;
+static u32 fmt_ref_tick;
+static u32 fmt_epoch;
+#endif
+
+/**
+ * @brief Start output (send the header line of CSV format)
+ *
+ */
+void format_init(void)
+{
+#if FORMAT_MACHINE
+	if (nvconf.format != FORMAT_CSV)
+		return;
+#if STATS_WINDOW
+	if (nvconf.stats.window)
+	{
+		uart_puts("sn,time,seq,n,rh_n,rh_min,rh_mean,rh_max,rh_sd,"
+		          "temp_n,temp_min,temp_mean,temp_max,temp_sd\r\n");
+		return;
+	}
+#endif
+	uart_puts("sn,time,seq,rh,temp");
+#if METRICS_OUTPUT
+	uart_puts(",dew,ah,hi");
+#endif
+	uart_puts(",status\r\n");
+#endif
+}
+
+/**
+ * @brief Set the serial number of the sensor (sent into each line)
+ *
+ * @param id Pointer to the 8 bytes ID (null if not available)
+ */
+void format_set_id(const u8 *id)
+{
+#if FORMAT_MACHINE
+	int i;
+
+	for (i = 0; i < 8; i++)
+		fmt_id[i] = id ? id[i] : 0;
+	fmt_id_known = 1;
+#else
+	(void)id;
+#endif
+}
+
+/**
+ * @brief Test if samples can be sent
+ *
+ * Machine formats identify the device with the serial number of the
+ * sensor, read after the first sample (deferred). Samples wait into the
+ * sampler queue until it is known.
+ *
+ * @return integer Non-zero if samples can be sent
+ */
+int format_ready(void)
+{
+#if FORMAT_MACHINE
+	return((nvconf.format == FORMAT_TEXT) || fmt_id_known);
+#else
+	return(1);
+#endif
+}
+
+/**
+ * @brief Test if informative text (banner, ...) can be sent
+ *
+ * @return integer Non-zero for text output on a point to point link
+ */
+int format_verbose(void)
+{
+	return((nvconf.format == FORMAT_TEXT) && (nvconf.bus.mode != BUS_POLL));
+}
+
+/**
+ * @brief Send a sample with the selected format
+ *
+ * Values are converted and sent directly into the UART transmit FIFO, no
+ * buffer is used.
+ *
+ * @param s Pointer to the sample to send
+ */
+void format_sample(const struct sample *s)
+{
+	switch (nvconf.format)
+	{
+#if FORMAT_MACHINE
+		case FORMAT_CSV:
+			fmt_csv(s);
+			break;
+		case FORMAT_JSON:
+			fmt_json(s);
+			break;
+		case FORMAT_INFLUX:
+			fmt_influx(s);
+			break;
+#endif
+		default:
+			fmt_text(s);
+			break;
+	}
+}
+
+#if STATS_WINDOW
+/**
+ * @brief Send the summary of a statistics window with the selected format
+ *
+ * Values of a channel without any valid sample into the window are not
+ * sent (empty CSV fields).
+ *
+ * @param st Pointer to the summary to send
+ */
+void format_stats(const struct stats_summary *st)
+{
+	int fmt = nvconf.format;
+
+	if (fmt == FORMAT_TEXT)
+	{
+		uart_puts("STATS N=");
+		uart_putdec(st->samples);
+		uart_puts(" SEQ=");
+		uart_putdec(st->seq);
+		if (st->errors)
+		{
+			uart_puts(" ERR=");
+			uart_putdec(st->errors);
+		}
+	}
+#if FORMAT_MACHINE
+	else if (fmt == FORMAT_INFLUX)
+	{
+		uart_puts(FORMAT_INFLUX_NAME "_stats,sn=");
+		fmt_serial();
+		uart_puts(" n=");
+		uart_putdec(st->samples);
+		uart_puts("i,errors=");
+		uart_putdec(st->errors);
+		uart_puts("i,seq=");
+		uart_putdec(st->seq);
+		uart_putc('i');
+	}
+	else
+	{
+		uart_puts((fmt == FORMAT_JSON) ? "{\"sn\":\"" : "");
+		fmt_serial();
+		uart_puts((fmt == FORMAT_JSON) ? "\",\"time\":" : ",");
+		fmt_time(st->time, 0);
+		uart_puts((fmt == FORMAT_JSON) ? ",\"seq\":" : ",");
+		uart_putdec(st->seq);
+		uart_puts((fmt == FORMAT_JSON) ? ",\"n\":" : ",");
+		uart_putdec(st->samples);
+	}
+#endif
+	fmt_result("RH",   &st->rh);
+	fmt_result("TEMP", &st->temp);
+
+#if FORMAT_MACHINE
+	if (fmt == FORMAT_INFLUX)
+	{
+		if (fmt_epoch)
+		{
+			uart_putc(' ');
+			fmt_time(st->time, 1);
+		}
+		uart_putc('\n');
+	}
+	else
+		uart_puts((fmt == FORMAT_JSON) ? "}\r\n" : "\r\n");
+#else
+	uart_puts("\r\n");
+#endif
+}
+#endif
+
+#if FORMAT_MACHINE
+/**
+ * @brief Handler of the "FORMAT" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void format_cmd(int argc, char **argv)
+{
+	u32 sec, us;
+	int v;
+	uint i;
+
+	if (argc == 1)
+	{
+		cmd_puts("FORMAT ");
+		cmd_puts(fmt_names[nvconf.format]);
+		cmd_puts("\r\nFORMAT TIME");
+		fmt_clock(sampler_time(), &sec, &us, 0);
+		cmd_putint(fmt_epoch ? (int)(fmt_epoch + sec) : 0);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 3) && cmd_match(argv[1], "TIME"))
+	{
+		/* Wall clock (unix time, in seconds) */
+		if (cmd_atoi(argv[2], &v) || (v <= 0))
+			goto err;
+		fmt_clock(sampler_time(), &sec, &us, 0);
+		fmt_epoch = v - sec;
+	}
+	else if (argc == 2)
+	{
+		for (i = 0; i < FORMAT_COUNT; i++)
+		{
+			if (cmd_match(argv[1], fmt_names[i]))
+				break;
+		}
+		if (i == FORMAT_COUNT)
+			goto err;
+		nvconf.format = i;
+		cmd_ok();
+		format_init();
+		return;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+#endif
+
+/**
+ * @brief Text format : RH=45,12 TEMP=23,05 SEQ=12 PHASE=31
+ *
+ * @param s Pointer to the sample to send
+ */
+static void fmt_text(const struct sample *s)
+{
+	uart_puts("RH=");
+	if (s->status & SAMPLE_ERR_RH)
+		uart_puts("ERROR");
+	else
+		fmt_fixed(s->rh, ',');
+	uart_puts(" TEMP=");
+	if (s->status & SAMPLE_ERR_TEMP)
+		uart_puts("ERROR");
+	else
+		fmt_fixed(s->temp, ',');
+#if METRICS_OUTPUT
+	/* Derived values, only when both RH and temperature are valid */
+	if ((s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP)) == 0)
+	{
+		uart_puts(" DEW=");
+		fmt_fixed(metrics_dewpoint(s->rh, s->temp), ',');
+		uart_puts(" AH=");
+		fmt_fixed(metrics_abs_humidity(s->rh, s->temp), ',');
+		uart_puts(" HI=");
+		fmt_fixed(metrics_heat_index(s->rh, s->temp), ',');
+	}
+#endif
+	/* Trigger sequence and phase error (us) for jitter analysis */
+	uart_puts(" SEQ=");
+	uart_putdec(s->seq);
+	uart_puts(" PHASE=");
+	uart_putdec(s->phase);
+	/* Threshold alarm state (only when enabled) */
+	if (nvconf.alarm.enable)
+	{
+		uart_puts(" ALARM=");
+		uart_putdec((s->status & SAMPLE_ALARM_Msk) >> SAMPLE_ALARM_Pos);
+	}
+	uart_puts("\r\n");
+}
+
+#if FORMAT_MACHINE
+/**
+ * @brief CSV format, a value in error is an empty field
+ *
+ * @param s Pointer to the sample to send
+ */
+static void fmt_csv(const struct sample *s)
+{
+	fmt_serial();
+	uart_putc(',');
+	fmt_time(s->time, 0);
+	uart_putc(',');
+	uart_putdec(s->seq);
+	uart_putc(',');
+	if ((s->status & SAMPLE_ERR_RH) == 0)
+		fmt_fixed(s->rh, '.');
+	uart_putc(',');
+	if ((s->status & SAMPLE_ERR_TEMP) == 0)
+		fmt_fixed(s->temp, '.');
+#if METRICS_OUTPUT
+	if ((s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP)) == 0)
+	{
+		uart_putc(',');
+		fmt_fixed(metrics_dewpoint(s->rh, s->temp), '.');
+		uart_putc(',');
+		fmt_fixed(metrics_abs_humidity(s->rh, s->temp), '.');
+		uart_putc(',');
+		fmt_fixed(metrics_heat_index(s->rh, s->temp), '.');
+	}
+	else
+		uart_puts(",,,");
+#endif
+	uart_putc(',');
+	uart_putdec(s->status);
+	uart_puts("\r\n");
+}
+
+/**
+ * @brief JSON lines format, a value in error is null
+ *
+ * @param s Pointer to the sample to send
+ */
+static void fmt_json(const struct sample *s)
+{
+	uart_puts("{\"sn\":\"");
+	fmt_serial();
+	uart_puts("\",\"time\":");
+	fmt_time(s->time, 0);
+	uart_puts(",\"seq\":");
+	uart_putdec(s->seq);
+	uart_puts(",\"rh\":");
+	if (s->status & SAMPLE_ERR_RH)
+		uart_puts("null");
+	else
+		fmt_fixed(s->rh, '.');
+	uart_puts(",\"temp\":");
+	if (s->status & SAMPLE_ERR_TEMP)
+		uart_puts("null");
+	else
+		fmt_fixed(s->temp, '.');
+#if METRICS_OUTPUT
+	if ((s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP)) == 0)
+	{
+		uart_puts(",\"dew\":");
+		fmt_fixed(metrics_dewpoint(s->rh, s->temp), '.');
+		uart_puts(",\"ah\":");
+		fmt_fixed(metrics_abs_humidity(s->rh, s->temp), '.');
+		uart_puts(",\"hi\":");
+		fmt_fixed(metrics_heat_index(s->rh, s->temp), '.');
+	}
+#endif
+	uart_puts(",\"status\":");
+	uart_putdec(s->status);
+	uart_puts("}\r\n");
+}
+
+/**
+ * @brief InfluxDB line protocol, values in error are not sent
+ *
+ * The timestamp (ns) is only sent when the wall clock has been set
+ * (FORMAT TIME), otherwise the server time is used.
+ *
+ * @param s Pointer to the sample to send
+ */
+static void fmt_influx(const struct sample *s)
+{
+	uart_puts(FORMAT_INFLUX_NAME ",sn=");
+	fmt_serial();
+	uart_puts(" status=");
+	uart_putdec(s->status);
+	uart_puts("i,seq=");
+	uart_putdec(s->seq);
+	uart_putc('i');
+	if ((s->status & SAMPLE_ERR_RH) == 0)
+	{
+		uart_puts(",rh=");
+		fmt_fixed(s->rh, '.');
+	}
+	if ((s->status & SAMPLE_ERR_TEMP) == 0)
+	{
+		uart_puts(",temp=");
+		fmt_fixed(s->temp, '.');
+	}
+#if METRICS_OUTPUT
+	if ((s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP)) == 0)
+	{
+		uart_puts(",dew=");
+		fmt_fixed(metrics_dewpoint(s->rh, s->temp), '.');
+		uart_puts(",ah=");
+		fmt_fixed(metrics_abs_humidity(s->rh, s->temp), '.');
+		uart_puts(",hi=");
+		fmt_fixed(metrics_heat_index(s->rh, s->temp), '.');
+	}
+#endif
+	if (fmt_epoch)
+	{
+		uart_putc(' ');
+		fmt_time(s->time, 1);
+	}
+	uart_putc('\n');
+}
+#endif
+
+#if STATS_WINDOW
+/**
+ * @brief Send the statistics of one channel (part of a summary line)
+ *
+ * @param name Channel name, upper case (text format)
+ * @param r    Pointer to the result of the channel
+ */
+static void fmt_result(const char *name, const struct stats_result *r)
+{
+	static const char * const keys[4] = { "MIN", "MEAN", "MAX", "SD" };
+	int v[4];
+	const char *p;
+	int i;
+
+	v[0] = r->min;
+	v[1] = r->mean;
+	v[2] = r->max;
+	v[3] = r->sd;
+
+#if FORMAT_MACHINE
+	if (nvconf.format == FORMAT_CSV)
+	{
+		uart_putc(',');
+		uart_putdec(r->count);
+		for (i = 0; i < 4; i++)
+		{
+			uart_putc(',');
+			if (r->count)
+				fmt_fixed(v[i], '.');
+		}
+		return;
+	}
+#endif
+	if (r->count == 0)
+		return;
+
+#if FORMAT_MACHINE
+	if (nvconf.format == FORMAT_JSON)
+	{
+		uart_puts(",\"");
+		for (p = name; *p; p++)
+			uart_putc(*p | 0x20);
+		uart_puts("\":{\"n\":");
+		uart_putdec(r->count);
+	}
+#endif
+	for (i = 0; i < 4; i++)
+	{
+		/* Text is "RH_MIN=", influx "rh_min=", json "min": */
+		uart_putc((nvconf.format == FORMAT_TEXT) ? ' ' : ',');
+		if (nvconf.format == FORMAT_JSON)
+			uart_putc('"');
+		else
+		{
+			for (p = name; *p; p++)
+				uart_putc((nvconf.format == FORMAT_TEXT) ? *p : (*p | 0x20));
+			uart_putc('_');
+		}
+		for (p = keys[i]; *p; p++)
+			uart_putc((nvconf.format == FORMAT_TEXT) ? *p : (*p | 0x20));
+		uart_puts((nvconf.format == FORMAT_JSON) ? "\":" : "=");
+		fmt_fixed(v[i], (nvconf.format == FORMAT_TEXT) ? ',' : '.');
+	}
+#if FORMAT_MACHINE
+	if (nvconf.format == FORMAT_JSON)
+		uart_putc('}');
+#endif
+}
+#endif
+
+#if FORMAT_MACHINE
+/**
+ * @brief Convert a sample time into device time (seconds and us)
+ *
+ * Sample time is a 32 bits counter of us (wraps after 71 minutes). It is
+ * extended using a reference that format_tick() moves every second, so a
+ * sample is converted correctly up to 35 minutes before or after it (queued
+ * samples can be older than the reference).
+ *
+ * @param time   Sample time (us)
+ * @param sec    Pointer to a variable where seconds can be stored
+ * @param us     Pointer to a variable where microseconds can be stored
+ * @param update Non-zero to use this time as the new reference
+ */
+static void fmt_clock(u32 time, u32 *sec, u32 *us, int update)
+{
+	int d;
+	u32 v;
+
+	d = (int)(time - fmt_ref_time);
+	if (d >= 0)
+	{
+		v    = fmt_ref_us + (u32)d;
+		*sec = fmt_ref_sec + (v / 1000000);
+		*us  = v % 1000000;
+	}
+	else
+	{
+		v    = (u32)(-d);
+		*sec = fmt_ref_sec - (v / 1000000);
+		v    = v % 1000000;
+		if (v > fmt_ref_us)
+		{
+			*sec -= 1;
+			*us = fmt_ref_us + 1000000 - v;
+		}
+		else
+			*us = fmt_ref_us - v;
+	}
+	if (update)
+	{
+		fmt_ref_time = time;
+		fmt_ref_sec  = *sec;
+		fmt_ref_us   = *us;
+	}
+}
+
+/**
+ * @brief Move the reference of the device clock (called by main loop)
+ *
+ * The reference is advanced once per second even when no line is sent
+ * (report-by-exception, statistics, external trigger, bus slave) so the
+ * sample time never wraps between two conversions.
+ *
+ */
+void format_tick(void)
+{
+	u32 sec, us;
+
+	if (time_since(fmt_ref_tick) < 1000)
+		return;
+	fmt_ref_tick = time_now();
+	fmt_clock(sampler_time(), &sec, &us, 1);
+}
+
+/**
+ * @brief Send the serial number of the sensor (16 hex digits)
+ *
+ */
+static void fmt_serial(void)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		uart_puthex(fmt_id[i], 8);
+}
+
+/**
+ * @brief Send the time of a sample
+ *
+ * Unix time when the wall clock is known, else time since startup.
+ *
+ * @param time Sample time (us)
+ * @param ns   Non-zero for an integer number of ns, else seconds with 6
+ *             decimals
+ */
+static void fmt_time(u32 time, int ns)
+{
+	u32 sec, us;
+
+	fmt_clock(time, &sec, &us, 1);
+	uart_putdec(fmt_epoch + sec);
+	if (ns == 0)
+		uart_putc('.');
+	fmt_digits(us, 6);
+	if (ns)
+		uart_puts("000");
+}
+#endif
+
+/**
+ * @brief Send a value in hundredths as a decimal number ("-12,05")
+ *
+ * @param v   Value to send (in 1/100 unit)
+ * @param sep Decimal separator
+ */
+static void fmt_fixed(int v, char sep)
+{
+	unsigned int u;
+
+	if (v < 0)
+	{
+		uart_putc('-');
+		u = -v;
+	}
+	else
+		u = v;
+	uart_putdec(u / 100);
+	uart_putc(sep);
+	fmt_digits(u % 100, 2);
+}
+
+/**
+ * @brief Send the last n digits of a value (with leading zeros)
+ *
+ * @param v Value to send
+ * @param n Number of digits
+ */
+static void fmt_digits(u32 v, uint n)
+{
+	u32 div = 1;
+
+	while (--n)
+		div *= 10;
+	for ( ; div; div /= 10)
+		uart_putc('0' + ((v / div) % 10));
+}
+/* EOF */
@@ -0,0 +1,59 @@
+/**
+ * @file  format.h
+ * @brief Headers and definitions for sample output formats
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef FORMAT_H
+#define FORMAT_H
+#include "sampler.h"
+#include "stats.h"
+#include "types.h"
+
+/* Define to 1 to add the machine formats (CSV, JSON, InfluxDB) */
+#ifndef FORMAT_MACHINE
+#define FORMAT_MACHINE 0
+#endif
+
+/* Output formats */
+#define FORMAT_TEXT    0  /* RH=45,12 TEMP=23,05 SEQ=12 PHASE=31         */
+#define FORMAT_CSV     1  /* sn,time,seq,rh,temp,status                   */
+#define FORMAT_JSON    2  /* {"sn":"..","time":..,"rh":45.12,...}         */
+#define FORMAT_INFLUX  3  /* trh,sn=.. status=0i,rh=45.12,... [timestamp] */
+#if FORMAT_MACHINE
+#define FORMAT_COUNT   4
+#else
+#define FORMAT_COUNT   1
+#endif
+
+/* Format used when no configuration is saved */
+#define FORMAT_DEFAULT FORMAT_TEXT
+/* Measurement name for the InfluxDB line protocol */
+#define FORMAT_INFLUX_NAME "trh"
+
+void format_init(void);
+void format_set_id(const u8 *id);
+int  format_ready(void);
+int  format_verbose(void);
+void format_sample(const struct sample *s);
+#if STATS_WINDOW
+void format_stats(const struct stats_summary *st);
+#endif
+#if FORMAT_MACHINE
+void format_tick(void);
+void format_cmd(int argc, char **argv);
+#else
+static inline void format_tick(void) { }
+#endif
+
+#endif
+/* EOF */
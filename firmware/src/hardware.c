@@ -24,13 +24,14 @@ static inline void hw_init_clock(void);
 void hw_init(void)
 {
 	/* Update NVM (flash memory wait-state before any clock config */
-	reg_wr(NVM_ADDR + 0x04, (0 << 1)); /* Default: 0 = no wait state */
+	/* Default: 0 = no wait state */
+	reg_wr(NVM_ADDR + NVMCTRL_CTRLB, FIELD(NVMCTRL_CTRLB_RWS, 0));
 
 	/* Use PM to configure clock sources */
-	reg8_wr(PM_ADDR + 0x08, 0x00); /* CPU  clock select (CPUSEL)  */
-	reg8_wr(PM_ADDR + 0x09, 0x00); /* APBA clock select (APBASEL) */
-	reg8_wr(PM_ADDR + 0x0A, 0x00); /* APBB clock select (APBBSEL) */
-	reg8_wr(PM_ADDR + 0x0B, 0x00); /* APBC clock select (APBCSEL) */
+	reg8_wr(PM_ADDR + PM_CPUSEL,  0x00); /* CPU  clock select (CPUSEL)  */
+	reg8_wr(PM_ADDR + PM_APBASEL, 0x00); /* APBA clock select (APBASEL) */
+	reg8_wr(PM_ADDR + PM_APBBSEL, 0x00); /* APBB clock select (APBBSEL) */
+	reg8_wr(PM_ADDR + PM_APBCSEL, 0x00); /* APBC clock select (APBCSEL) */
 	
 	hw_init_clock();
 }
@@ -44,36 +45,38 @@ static inline void hw_init_clock(void)
 	u32 v;
 
 	/* Configure internal 8MHz oscillator */
-	v = reg_rd(SYSCTRL_ADDR + 0x20); /* Read OSC8M config register */
-	v &= 0xFFFFFC3F;                 /* Clear prescaler and OnDemand flag */
-	reg_wr(SYSCTRL_ADDR + 0x20, v);  /* Write-back OSC8M */
+	v = reg_rd(SYSCTRL_ADDR + SYSCTRL_OSC8M); /* Read OSC8M config register */
+	/* Clear prescaler and OnDemand flag */
+	v &= ~(SYSCTRL_OSC8M_PRESC_Msk | SYSCTRL_OSC8M_ONDEMAND | SYSCTRL_OSC8M_RUNSTDBY);
+	reg_wr(SYSCTRL_ADDR + SYSCTRL_OSC8M, v);  /* Write-back OSC8M */
 	/* Wait for internal 8MHz oscillator stable and ready */
-	while( ! (reg_rd(SYSCTRL_ADDR + 0x0C) & 0x08))
+	while( ! (reg_rd(SYSCTRL_ADDR + SYSCTRL_PCLKSR) & SYSCTRL_PCLKSR_OSC8MRDY))
 		;
 
 	/* Wait end of clock domains synchronization */
-	while (reg8_rd(GCLK_ADDR + 0x01) & 0x80)
+	while (reg8_rd(GCLK_ADDR + GCLK_STATUS) & GCLK_STATUS_SYNCBUSY)
 		;
 
 	/* Set Divisor for GCLK0 : enabled, OSC8M, no divisor */
-	reg_wr(GCLK_ADDR + 0x08, (1 <<  8) | 0x00);
-	reg_wr(GCLK_ADDR + 0x04, (1 << 16) | (0x06 << 8) | 0x00);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 0));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, GCLK_GENCTRL_GENEN |
+	       FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 0));
 #ifdef not_defined
 	/* Set Divisor for GCLK1 : disabled */
-	reg_wr(GCLK_ADDR + 0x08, (1 << 8) | 0x01);
-	reg_wr(GCLK_ADDR + 0x04, (0 << 16) | (0x06 << 8) | 0x01);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 1));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 1));
 	/* Set Divisor for GCLK2 : disabled */
-	reg_wr(GCLK_ADDR + 0x08, (1 << 8) | 0x02);
-	reg_wr(GCLK_ADDR + 0x04, (0 << 16) | (0x06 << 8) | 0x02);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 2));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 2));
 	/* Set Divisor for GCLK3 : disabled */
-	reg_wr(GCLK_ADDR + 0x08, (1 << 8) | 0x03);
-	reg_wr(GCLK_ADDR + 0x04, (0 << 16) | (0x06 << 8) | 0x03);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 3));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 3));
 	/* Set Divisor for GCLK4 : disabled */
-	reg_wr(GCLK_ADDR + 0x08, (1 << 8) | 0x04);
-	reg_wr(GCLK_ADDR + 0x04, (0 << 16) | (0x06 << 8) | 0x04);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 4));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 4));
 	/* Set Divisor for GCLK5 : disabled */
-	reg_wr(GCLK_ADDR + 0x08, (1 << 8) | 0x05);
-	reg_wr(GCLK_ADDR + 0x04, (0 << 16) | (0x06 << 8) | 0x05);
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 1) | FIELD(GCLK_GENDIV_ID, 5));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSC8M) | FIELD(GCLK_GENCTRL_ID, 5));
 #endif
 }
 /* EOF */
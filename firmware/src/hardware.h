@@ -15,6 +15,7 @@
  */
 #ifndef HARDWARE_H
 #define HARDWARE_H
+#include "regs.h"
 #include "types.h"
 
 /* AHB-APB Bridge A */
@@ -40,6 +41,14 @@
 #define TC1_ADDR     ((u32)0x42001800)
 #define TC2_ADDR     ((u32)0x42001C00)
 #define ADC_ADDR     ((u32)0x42002000)
+/* Single-cycle IO port (PORT registers) */
+#define PORT_IOBUS   ((u32)0x60000000)
+
+/* Execute a function from SRAM (copied with .data by Reset_Handler). SRAM is
+ * out of range of a "bl" from flash, so calls are made through a register */
+#define RAMFUNC __attribute__((section(".ramfunc"), long_call, noinline))
+/* Variable kept over a reset : not initialized nor cleared by Reset_Handler */
+#define NOINIT  __attribute__((section(".noinit")))
 
 void hw_init(void);
 
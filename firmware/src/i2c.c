@@ -15,6 +15,7 @@
  */
 #include "hardware.h"
 #include "i2c.h"
+#include "power.h"
 
 /* Bus frequency : ~100kHz with 8MHz GCLK */
 #define CONF_I2C_BAUD (35 & 0xFF)
@@ -33,32 +34,34 @@ void i2c_init(void)
 	/* 1) Enable peripheral and set clocks */
 
 	/* Enable SERCOM0 clock (APBCMASK) */
-	reg_set(PM_ADDR + 0x20, (1 << 2));
+	reg_set(PM_ADDR + PM_APBCMASK, PM_APBCMASK_SERCOM0);
 	/* Set GCLK for SERCOM0 (generic clock generator 0) */
-	reg16_wr (GCLK_ADDR + 0x02, (1 << 14) | (0 << 8) | 14);
+	reg16_wr (GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	          FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_SERCOM0));
 
 	/* 2) Initialize sercom/I2C block   */
 
 	/* Reset sercom (set SWRST)     */
-	reg_wr((I2C_ADDR + 0x00), 0x01);
+	reg_wr((I2C_ADDR + SERCOM_CTRLA), SERCOM_CTRLA_SWRST);
 	/* Wait end of software reset */
-	while( reg_rd(I2C_ADDR + 0x00) & 0x01)
+	while( reg_rd(I2C_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_SWRST)
 		;
 	/* Configure interface */
-	reg_wr(I2C_ADDR + 0x00, (5 << 2));
-	reg_wr(I2C_ADDR + 0x04, 0);
+	reg_wr(I2C_ADDR + SERCOM_CTRLA, FIELD(SERCOM_CTRLA_MODE, SERCOM_MODE_I2C_MASTER));
+	reg_wr(I2C_ADDR + SERCOM_CTRLB, 0);
 	/* Configure Baudrate */
-	reg16_wr(I2C_ADDR + 0x0C, CONF_I2C_BAUD);
+	reg16_wr(I2C_ADDR + SERCOM_BAUD, CONF_I2C_BAUD);
 	/* Set ENABLE into CTRLA */
-	reg_set(I2C_ADDR + 0x00, (1 << 1));
+	reg_set(I2C_ADDR + SERCOM_CTRLA, SERCOM_CTRLA_ENABLE);
 
 	/* 3) Configure pins (IOs) */
 
 	/* PINCFG: Enable PMUX for SCL/SDA pins */
-	reg8_wr(0x60000000 + 0x4E, 0x01); /* PA14 : SDA */
-	reg8_wr(0x60000000 + 0x4F, 0x01); /* PA15 : SCL */
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(14), PORT_PINCFG_PMUXEN); /* PA14 : SDA */
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(15), PORT_PINCFG_PMUXEN); /* PA15 : SCL */
 	/* Set peripheral function C (SERCOM) for PA14 and PA15 */
-	reg8_wr(0x60000000 + 0x37, (0x02 << 4) | (0x02 << 0));
+	reg8_wr(PORT_IOBUS + PORT_PMUX(14), FIELD(PORT_PMUX_PMUXO, PORT_FUNC_C) |
+	                                    FIELD(PORT_PMUX_PMUXE, PORT_FUNC_C));
 }
 
 /**
@@ -72,41 +75,44 @@ int i2c_read (unsigned char *data, int again)
 {
 	unsigned long v;
 	unsigned int  i;
+	uint state;
 
 #ifdef I2C_DEBUG
 	/* Verify that I2C sercom is enabled and ready */
-	if ((reg_rd(I2C_ADDR + 0x00) & (1 << 1)) == 0)
+	if ((reg_rd(I2C_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_ENABLE) == 0)
 		return(-9);
 #endif
 
 	/* Wait end of transmission (SB or ERROR) */
+	state = power_enter(POWER_I2C);
 	for (i = 0; i < I2C_RD_WAIT; i++)
 	{
 		/* Read INTFLAG */
-		v = reg8_rd(I2C_ADDR + 0x18);
-		if (v & 0x83)
+		v = reg8_rd(I2C_ADDR + SERCOM_INTFLAG);
+		if (v & (SERCOM_I2CM_INT_ERROR | SERCOM_I2CM_INT_SB | SERCOM_I2CM_INT_MB))
 			break;
 		/* Read STATUS */
-		v = reg16_rd(I2C_ADDR + 0x1A);
+		v = reg16_rd(I2C_ADDR + SERCOM_STATUS);
 	}
+	power_enter(state);
 	/* In case of timeout during wait, abort */
 	if (i == I2C_RD_WAIT)
 		return(-1);
 	/* In case of an error, abort */
-	if (v & 0x81)
+	if (v & (SERCOM_I2CM_INT_ERROR | SERCOM_I2CM_INT_MB))
 		return(-2);
 
 	/* Read received byte */
-	v = reg16_rd(I2C_ADDR + 0x28);
+	v = reg16_rd(I2C_ADDR + SERCOM_DATA);
 	if (data)
 		*data = (v & 0xFF);
 
 	/* If "again" flag is set, initiate another read */
 	if (again)
-		reg_wr(I2C_ADDR + 0x04, (2 << 16));
+		reg_wr(I2C_ADDR + SERCOM_CTRLB, FIELD(SERCOM_I2CM_CTRLB_CMD, SERCOM_I2CM_CMD_READ));
 	/* Else (last byte) set the acknowledge value to NACK */
 	else
-		reg_wr(I2C_ADDR + 0x04, (1 << 18));
+		reg_wr(I2C_ADDR + SERCOM_CTRLB, SERCOM_I2CM_CTRLB_ACKACT);
 
 	return(0);
 }
@@ -122,49 +128,52 @@ int i2c_start(unsigned short addr, int rw)
 {
 	unsigned long v;
 	unsigned int  i;
+	uint state;
 
 #ifdef I2C_DEBUG
 	/* Verify that I2C sercom is enabled and ready */
-	if ((reg_rd(I2C_ADDR + 0x00) & (1 << 1)) == 0)
+	if ((reg_rd(I2C_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_ENABLE) == 0)
 		return(-9);
 #endif
 
 	/* If a previous error has not been cleared */
-	v = reg8_rd(I2C_ADDR + 0x18);
-	if (v & 0x80)
+	v = reg8_rd(I2C_ADDR + SERCOM_INTFLAG);
+	if (v & SERCOM_I2CM_INT_ERROR)
 	{
 		/* Read STATUS */
-		v = reg16_rd(I2C_ADDR + 0x1A);
+		v = reg16_rd(I2C_ADDR + SERCOM_STATUS);
 		/* Clear it now ! */
-		reg8_wr(I2C_ADDR + 0x18, 0x80);
+		reg8_wr(I2C_ADDR + SERCOM_INTFLAG, SERCOM_I2CM_INT_ERROR);
 	}
 
 	/* Send START, slave address and rw bit */
 	v = ((addr << 1) & 0x7FE) | (rw & 1);
-	reg_wr(I2C_ADDR + 0x24, v);
+	reg_wr(I2C_ADDR + SERCOM_ADDR, v);
 
 	/* Wait for MB or ERROR */
+	state = power_enter(POWER_I2C);
 	for (i = 0; i < I2C_ST_WAIT; i++)
 	{
-		v = reg8_rd(I2C_ADDR + 0x18);
-		if (v & 0x83)
+		v = reg8_rd(I2C_ADDR + SERCOM_INTFLAG);
+		if (v & (SERCOM_I2CM_INT_ERROR | SERCOM_I2CM_INT_SB | SERCOM_I2CM_INT_MB))
 			break;
 	}
+	power_enter(state);
 	/* In case of timeout during wait, abort */
 	if (i == I2C_ST_WAIT)
 		goto err;
 
 	/* Read STATUS */
-	v = reg16_rd(I2C_ADDR + 0x1A);
-	if (v & 0x07)
+	v = reg16_rd(I2C_ADDR + SERCOM_STATUS);
+	if (v & (SERCOM_I2CM_STATUS_RXNACK | SERCOM_I2CM_STATUS_ARBLOST | SERCOM_I2CM_STATUS_BUSERR))
 		goto err;
 
 	return(0);
 err:
 	/* Send a STOP condition */
-	reg_wr(I2C_ADDR + 0x04, (0x03 << 16));
+	reg_wr(I2C_ADDR + SERCOM_CTRLB, FIELD(SERCOM_I2CM_CTRLB_CMD, SERCOM_I2CM_CMD_STOP));
 	/* Clear the ERROR bit */
-	reg8_wr(I2C_ADDR + 0x18, 0x80);
+	reg8_wr(I2C_ADDR + SERCOM_INTFLAG, SERCOM_I2CM_INT_ERROR);
 	return(-1);
 }
 
@@ -179,15 +188,15 @@ int i2c_stop(void)
 
 #ifdef I2C_DEBUG
 	/* Verify that I2C sercom is enabled and ready */
-	if ((reg_rd(I2C_ADDR + 0x00) & (1 << 1)) == 0)
+	if ((reg_rd(I2C_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_ENABLE) == 0)
 		return(-9);
 #endif
 
 	/* Read the current acknowledge value */
-	v = reg_rd(I2C_ADDR + 0x04) & (1 << 18);
+	v = reg_rd(I2C_ADDR + SERCOM_CTRLB) & SERCOM_I2CM_CTRLB_ACKACT;
 
 	/* Send a STOP condition */
-	reg_wr(I2C_ADDR + 0x04, v | (0x03 << 16));
+	reg_wr(I2C_ADDR + SERCOM_CTRLB, v | FIELD(SERCOM_I2CM_CTRLB_CMD, SERCOM_I2CM_CMD_STOP));
 
 	return(0);
 }
@@ -201,23 +210,26 @@ int i2c_stop(void)
 int i2c_write(unsigned char data)
 {
 	unsigned long v;
+	uint state;
 
 #ifdef I2C_DEBUG
 	/* Verify that I2C sercom is enabled and ready */
-	if ((reg_rd(I2C_ADDR + 0x00) & (1 << 1)) == 0)
+	if ((reg_rd(I2C_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_ENABLE) == 0)
 		return(-9);
 #endif
 
-	v = reg8_rd(I2C_ADDR + 0x18);
+	v = reg8_rd(I2C_ADDR + SERCOM_INTFLAG);
 
-	reg16_wr(I2C_ADDR + 0x28, data);
+	reg16_wr(I2C_ADDR + SERCOM_DATA, data);
 
 	/* Wait for MB or ERROR */
+	state = power_enter(POWER_I2C);
 	do
-		v = reg8_rd(I2C_ADDR + 0x18);
-	while ( (v & 0x81) == 0);
+		v = reg8_rd(I2C_ADDR + SERCOM_INTFLAG);
+	while ( (v & (SERCOM_I2CM_INT_ERROR | SERCOM_I2CM_INT_MB)) == 0);
+	power_enter(state);
 
-	if (v & 0x80)
+	if (v & SERCOM_I2CM_INT_ERROR)
 		return(-1);
 
 	return(0);
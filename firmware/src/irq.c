@@ -0,0 +1,185 @@
+/**
+ * @file  irq.c
+ * @brief Interrupt priorities, critical sections and ISR timing statistics
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "irq.h"
+#include "time.h"
+
+struct irq_prio
+{
+	u8 irq;
+	u8 prio;
+};
+
+/*
+ * Priority plan. The sampling triggers (timer or external) only read the
+ * time and must not be delayed (phase error), the watchdog early warning
+ * must interrupt a stalled handler. The UART receiver has a 2 bytes buffer
+ * (about 2ms at 9600 bauds) and must preempt the other handlers. SysTick
+ * and Modbus end of frame are not time critical, everything else is at the
+ * lowest level.
+ */
+static const struct irq_prio irq_table[] = {
+	{ TC1_IRQn,     IRQ_PRIO_HIGHEST },
+	{ EIC_IRQn,     IRQ_PRIO_HIGHEST },
+	{ WDT_IRQn,     IRQ_PRIO_HIGHEST },
+	{ SERCOM1_IRQn, IRQ_PRIO_HIGH    },
+	{ TC2_IRQn,     IRQ_PRIO_NORMAL  },
+};
+#define IRQ_TABLE_SIZE (sizeof(irq_table) / sizeof(irq_table[0]))
+#define IRQ_PRIO_TICK  IRQ_PRIO_NORMAL
+
+#if IRQ_STATS
+struct irq_stat
+{
+	u32 count;
+	u32 lat_count; /* Number of latency measurements */
+	u32 lat_max;   /* Max entry latency (cycles)     */
+	u32 dur_max;   /* Max handler duration (cycles)  */
+};
+static struct irq_stat irq_stats[IRQ_ID_COUNT];
+static const char * const irq_names[IRQ_ID_COUNT] = {
+	"SAMPLER", "UART", "TICK", "MODBUS", "TRIGGER"
+};
+static const u8 irq_prios[IRQ_ID_COUNT] = {
+	IRQ_PRIO_HIGHEST, IRQ_PRIO_HIGH, IRQ_PRIO_TICK, IRQ_PRIO_NORMAL,
+	IRQ_PRIO_HIGHEST
+};
+#endif
+
+static void irq_set_prio(uint irq, uint prio);
+
+/**
+ * @brief Apply the priority plan (before enabling peripherals interrupts)
+ *
+ */
+void irq_init(void)
+{
+	uint i;
+
+	/* All lines to the lowest level, then apply the table */
+	for (i = 0; i < 32; i++)
+		irq_set_prio(i, IRQ_PRIO_LOW);
+	for (i = 0; i < IRQ_TABLE_SIZE; i++)
+		irq_set_prio(irq_table[i].irq, irq_table[i].prio);
+	/* SysTick (system handler priority 3) */
+	reg_wr(SCB_SHPR3, (reg_rd(SCB_SHPR3) & ~SCB_SHPR3_SYSTICK_Msk) |
+	                  FIELD(SCB_SHPR3_SYSTICK, IRQ_PRIO_TICK));
+}
+
+#if IRQ_STATS
+/**
+ * @brief Update the statistics of a handler (called at the end of it)
+ *
+ * Duration is measured with the SysTick counter, from the stamp taken at
+ * entry to now, so handlers must be shorter than one tick (1ms).
+ *
+ * @param id      Identifier of the handler (IRQ_ID_xx)
+ * @param latency Delay (cycles) between the event and the entry of the
+ *                handler, or IRQ_LAT_NONE if unknown
+ * @param stamp   Value returned by irq_stamp() at entry
+ */
+void irq_account(uint id, u32 latency, u32 stamp)
+{
+	struct irq_stat *st = &irq_stats[id];
+	u32 end, dur;
+	u32 primask;
+
+	end = irq_stamp();
+	/* SysTick counts down, and reloads at zero */
+	dur = (stamp >= end) ? (stamp - end) : (stamp + TIME_CYCLES_MS - end);
+
+	primask = irq_save();
+	st->count++;
+	if (latency != IRQ_LAT_NONE)
+	{
+		st->lat_count++;
+		if (latency > st->lat_max)
+			st->lat_max = latency;
+	}
+	if (dur > st->dur_max)
+		st->dur_max = dur;
+	irq_restore(primask);
+}
+
+/**
+ * @brief Handler of the "IRQ" command : print or reset statistics
+ *
+ * For each handler : priority, number of calls, max entry latency and max
+ * duration (in CPU cycles, 8 per us). A latency of -1 means not measured
+ * (the handler does not know when its event occurred).
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void irq_cmd(int argc, char **argv)
+{
+	struct irq_stat st;
+	u32 primask;
+	uint i;
+
+	if ((argc == 2) && cmd_match(argv[1], "RESET"))
+	{
+		primask = irq_save();
+		for (i = 0; i < IRQ_ID_COUNT; i++)
+		{
+			irq_stats[i].count     = 0;
+			irq_stats[i].lat_count = 0;
+			irq_stats[i].lat_max   = 0;
+			irq_stats[i].dur_max   = 0;
+		}
+		irq_restore(primask);
+	}
+	else if (argc == 1)
+	{
+		for (i = 0; i < IRQ_ID_COUNT; i++)
+		{
+			primask = irq_save();
+			st = irq_stats[i];
+			irq_restore(primask);
+			cmd_puts("IRQ ");
+			cmd_puts(irq_names[i]);
+			cmd_putint(irq_prios[i]);
+			cmd_putint(st.count);
+			cmd_putint(st.lat_count ? (int)st.lat_max : -1);
+			cmd_putint(st.dur_max);
+			cmd_puts("\r\n");
+		}
+	}
+	else
+	{
+		cmd_error();
+		return;
+	}
+	cmd_ok();
+}
+#endif
+
+/**
+ * @brief Set the priority of an interrupt line
+ *
+ * @param irq  Interrupt line (xx_IRQn)
+ * @param prio Priority level (IRQ_PRIO_xx)
+ */
+static void irq_set_prio(uint irq, uint prio)
+{
+	u32 v;
+
+	v  = reg_rd(NVIC_IPR(irq));
+	v &= ~(0xFFu << (NVIC_IPR_SHIFT(irq) - 6));
+	v |= (prio << NVIC_IPR_SHIFT(irq));
+	reg_wr(NVIC_IPR(irq), v);
+}
+/* EOF */
@@ -0,0 +1,92 @@
+/**
+ * @file  irq.h
+ * @brief Interrupt priorities, critical sections and ISR timing statistics
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef IRQ_H
+#define IRQ_H
+#include "hardware.h"
+#include "types.h"
+
+/* Priority levels (Cortex-M0+ : 2 bits, lower value is more urgent) */
+#define IRQ_PRIO_HIGHEST 0
+#define IRQ_PRIO_HIGH    1
+#define IRQ_PRIO_NORMAL  2
+#define IRQ_PRIO_LOW     3
+
+/* Define to 1 to add ISR latency/duration measurement */
+#ifndef IRQ_STATS
+#define IRQ_STATS 0
+#endif
+
+/* Measured interrupt handlers */
+#define IRQ_ID_SAMPLER 0  /* TC1 : sampling trigger        */
+#define IRQ_ID_UART    1  /* SERCOM1 : serial link          */
+#define IRQ_ID_TICK    2  /* SysTick : time base            */
+#define IRQ_ID_MODBUS  3  /* TC2 : Modbus end of frame      */
+#define IRQ_ID_TRIGGER 4  /* EIC : external trigger         */
+#define IRQ_ID_COUNT   5
+/* Latency not known by the handler (no event timestamp) */
+#define IRQ_LAT_NONE   0xFFFFFFFF
+
+void irq_init(void);
+
+/**
+ * @brief Enter a critical section (disable interrupts)
+ *
+ * Critical sections can be nested, and can be used into an interrupt
+ * handler : the previous state is restored by irq_restore().
+ *
+ * @return u32 Previous interrupt mask (PRIMASK)
+ */
+static inline u32 irq_save(void)
+{
+	u32 primask;
+
+	asm volatile("mrs %0, primask \n"
+	             "cpsid i         \n" : "=r" (primask) : : "memory");
+	return(primask);
+}
+
+/**
+ * @brief Leave a critical section
+ *
+ * @param primask Interrupt mask returned by irq_save()
+ */
+static inline void irq_restore(u32 primask)
+{
+	asm volatile("msr primask, %0" : : "r" (primask) : "memory");
+}
+
+#if IRQ_STATS
+/**
+ * @brief Get a timestamp at ISR entry (SysTick counter, counts down)
+ *
+ * @return u32 Current value of the SysTick counter
+ */
+static inline u32 irq_stamp(void)
+{
+	return(reg_rd(SYST_CVR));
+}
+void irq_account(uint id, u32 latency, u32 stamp);
+void irq_cmd(int argc, char **argv);
+#else
+static inline u32  irq_stamp(void) { return(0); }
+static inline void irq_account(uint id, u32 latency, u32 stamp)
+{
+	(void)id; (void)latency; (void)stamp;
+}
+#endif
+
+#endif
+/* EOF */
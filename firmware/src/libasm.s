@@ -17,8 +17,13 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
  * OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
+
+@ Division routines are executed from SRAM (.ramfunc, see pmod-trh.ld) so
+@ their loops do not depend on flash wait states. Switch helpers stay into
+@ flash, they are called with a short branch from the switch code.
+
 	.syntax unified
-	.text
+	.section .ramfunc,"ax",%progbits
 	.thumb
 	.cpu cortex-m0
 
@@ -67,7 +72,7 @@ L_neg_result:
 /* ------------------------------------------------------------------------- */
 
 	.syntax unified
-	.text
+	.section .ramfunc,"ax",%progbits
 	.thumb
 	.cpu cortex-m0
 
@@ -140,7 +145,7 @@ L_dont_sub0:
 /* ------------------------------------------------------------------------- */
 
 	.syntax unified
-	.text
+	.section .ramfunc,"ax",%progbits
 	.thumb
 	.cpu cortex-m0
 
@@ -165,6 +170,7 @@ __aeabi_ldiv0:
 
 /* ------------------------------------------------------------------------- */
 
+	.text
 	.force_thumb
 	.syntax unified
 	.globl __gnu_thumb1_case_uqi
@@ -193,6 +199,9 @@ __gnu_thumb1_case_uhi:
 	pop     {r0, r1}
 	bx      lr
 
+/* ------------------------------------------------------------------------- */
+
+	.section .ramfunc,"ax",%progbits
 	.thumb_func
 	.global __aeabi_idivmod
 __aeabi_idivmod:
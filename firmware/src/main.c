@@ -13,12 +13,37 @@
  * for more details.
  * This program is distributed WITHOUT ANY WARRANTY.
  */
+#include "acq.h"
+#include "alarm.h"
+#include "bus.h"
+#include "cmd.h"
+#include "defer.h"
+#include "format.h"
 #include "hardware.h"
 #include "i2c.h"
+#include "irq.h"
+#include "metrics.h"
+#include "modbus.h"
+#include "nvconf.h"
+#include "power.h"
+#include "report.h"
+#include "sampler.h"
 #include "si7021.h"
+#include "stats.h"
 #include "time.h"
+#include "trace.h"
 #include "types.h"
 #include "uart.h"
+#include "wdt.h"
+
+static void acquire(struct sample *s);
+static void boot_info(void);
+#if MODBUS_SLAVE
+static void boot_modbus(void);
+#endif
+
+/* Cycles between reset and the end of first acquisition */
+static u32 boot_latency;
 
 /**
  * @brief Entry point of the C code (called by reset handler)
@@ -27,24 +52,205 @@
  */
 int main(void)
 {
-	unsigned char id[8];
-	unsigned int rh;
-	int temp;
-	u32 tm;
-	int i;
+	const struct sample *req;
+	struct sample smp;
+	int out;
 
 	/* Initialize clocks and low-level hardware */
 	hw_init();
+	/* Set interrupt priorities before any interrupt is enabled */
+	irq_init();
+	/* Watchdog, and state kept by the previous run (warm restart) */
+	wdt_init();
 	time_init();
+	/* Load persistent configuration (calibration, ...) */
+	nvconf_load();
 	/* Initialize peripherals */
 	i2c_init();
 	uart_init();
-	/* Initialize sensor driver */
+	/* RS-485 driver enable and TDMA slots (if enabled) */
+	bus_init();
+	/* Threshold alarm output (pin is free when the bus is not used) */
+	alarm_init();
+	/* Initialize sensor driver (detect the variant) */
 	si7021_init();
 
-	uart_puts("PMOD-TRH: Started\r\n");
+#if MODBUS_SLAVE
+	/* Modbus RTU mode : no text output, values are read by the master */
+	if (nvconf.mode == MODE_MODBUS)
+	{
+		modbus_init(nvconf.modbus_addr);
+		/* Sensor ID is not needed to take the first sample */
+		defer(boot_modbus);
+		sampler_init(SAMPLER_PERIOD);
+		while(1)
+		{
+			wdt_kick();
+			if (sampler_trigger(&smp))
+			{
+				acquire(&smp);
+				modbus_update(&smp);
+			}
+			/* Save a configuration modified by a request (the
+			 * requests are answered by the TC2 interrupt) */
+			modbus_poll();
+			if (defer_run())
+				continue;
+
+			power_enter(POWER_IDLE);
+			asm volatile("cpsid i");
+			if ( ! sampler_pending() && ! modbus_pending())
+				asm volatile("wfi");
+			asm volatile("cpsie i");
+			power_enter(POWER_ACTIVE);
+		}
+	}
+#endif
+
+	cmd_init();
+
+	/* Banner only for text output (machine formats are line oriented) */
+	if (format_verbose())
+		uart_puts(wdt_warm() ? "PMOD-TRH: Restarted\r\n" :
+		                       "PMOD-TRH: Started\r\n");
+	/* When polled, nothing is sent without request (shared bus). After a
+	 * warm restart the output continues (no new header) */
+	if ((nvconf.bus.mode != BUS_POLL) && ! wdt_warm())
+		format_init();
+	/* Sensor informations are loaded after the first sample */
+	defer(boot_info);
+
+#ifdef METRICS_BENCH
+	defer(metrics_bench);
+#endif
+
+	/* Start periodic trigger */
+#if SAMPLER_EXT
+	/* External trigger on the IRQ line (not driven in point to point) */
+	if ((nvconf.acq.mode == ACQ_EXT) && (nvconf.bus.mode == BUS_P2P))
+		sampler_ext_init();
+	else
+#endif
+		sampler_init(SAMPLER_PERIOD);
+
+	while(1)
+	{
+		/* The watchdog supervises this loop (stall of any job) */
+		wdt_kick();
+		/* Keep the device clock reference fresh (32 bits us wraps) */
+		format_tick();
+		/* Process commands received from serial link */
+		cmd_poll();
+		/* If the sampler timer has fired, acquire a new sample */
+		if (sampler_trigger(&smp))
+		{
+			acquire(&smp);
+			sampler_push(&smp);
+		}
+		/* Send acquired samples (uart is buffered, does not block) */
+		if (format_ready() && sampler_pop(&smp))
+		{
+			out = bus_output(&smp);
+#if STATS_WINDOW
+			/* Statistics enabled : one summary per window */
+			if (nvconf.stats.window)
+			{
+				if (stats_add(&smp) && out)
+					format_stats(stats_summary());
+			}
+			else
+#endif
+			/* When report-by-exception is enabled, send only changes */
+			if (out && report_check(&smp))
+				format_sample(&smp);
+			continue;
+		}
+		/* Last sample requested by the bus master (READ command) */
+		if ((req = bus_request()) != 0)
+		{
+			format_sample(req);
+			cmd_ok();
+			continue;
+		}
+		/* Process background jobs (only when nothing else to do) */
+		if (defer_run())
+			continue;
+		/* Nothing to do, wait next interrupt */
+		power_enter(POWER_IDLE);
+		asm volatile("cpsid i");
+		if ( ! sampler_pending())
+			asm volatile("wfi");
+		asm volatile("cpsie i");
+		power_enter(POWER_ACTIVE);
+	}
+
+	return(0);
+}
+
+/**
+ * @brief Read sensor values (humidity and temperature) into a sample
+ *
+ * @param s Pointer to the sample to fill
+ */
+static void acquire(struct sample *s)
+{
+	u32 t0;
+	int err;
+
+	/* This is the hot path, can be recorded with "TRACE ARM" */
+	trace_begin();
+	/* Read current relative humidity */
+	err = si7021_rh(&s->rh);
+	/* Latency of the alarm is counted from the end of the conversion */
+	t0 = si7021_done();
+	/* Threshold alarm is updated as soon as the value is known */
+	alarm_update(ALARM_RH, s->rh, err, t0);
+	if (err)
+		s->status |= SAMPLE_ERR_RH;
+	/* Get temperature captured during RH measurement */
+	err = si7021_temp_last(&s->temp);
+	alarm_update(ALARM_TEMP, s->temp, err, t0);
+	if (err)
+		s->status |= SAMPLE_ERR_TEMP;
+	trace_end();
+	s->status |= (alarm_state() << SAMPLE_ALARM_Pos);
+
+	if (boot_latency == 0)
+		boot_latency = time_boot();
+	/* Charge used since the previous sample */
+	power_sample();
+}
+
+/**
+ * @brief Send informations about sensor and startup (deferred job)
+ *
+ * The serial number is always read, it identifies the device into the
+ * machine formats (CSV, JSON, InfluxDB).
+ */
+static void boot_info(void)
+{
+	unsigned char id[8];
+	int valid;
+	int temp;
+	int i;
+
+	valid = (si7021_read_id(id) == 0);
+	format_set_id(valid ? id : 0);
+	if ( ! format_verbose())
+		return;
+
+	/* Reason of the restart, when not a power-on */
+	if (wdt_reason() != WDT_RESET_POWER)
+	{
+		uart_puts(" * Reset ");
+		uart_puts((char *)wdt_reason_name());
+		uart_puts("\r\n");
+	}
 
-	if (si7021_read_id(id) == 0)
+	uart_puts(" * Sensor ");
+	uart_puts((char *)si7021_variant()->name);
+	uart_puts("\r\n");
+	if (valid)
 	{
 		uart_puts(" * Si7021 serial number ");
 		for(i = 0; i < 8; i++)
@@ -65,36 +271,22 @@ int main(void)
 		uart_puts("\r\n");
 	}
 
-	while(1)
-	{
-		/* Read current relative humidity */
-		uart_puts("RH=");
-		if (si7021_rh(&rh) == 0)
-		{
-			uart_putdec(rh / 100);
-			uart_putc(',');
-			uart_putdec(rh % 100);
-		}
-		else
-			uart_puts("ERROR");
-		/* Get temperature captured during RH measurement */
-		uart_puts(" TEMP=");
-		if (si7021_temp_last(&temp) == 0)
-		{
-			uart_putdec(temp / 100);
-			uart_putc(',');
-			uart_putdec(temp % 100);
-		}
-		else
-			uart_puts("ERROR");
-		uart_puts("\r\n");
+	/* Delay between reset and first sample (in us) */
+	uart_puts(" * Boot to first sample ");
+	uart_putdec(boot_latency / (TIME_CYCLES_MS / 1000));
+	uart_puts(" us\r\n");
+}
 
-		/* Wait 1sec */
-		tm = time_now();
-		while (time_since(tm) < 1000)
-			asm volatile("nop");
-	}
+#if MODBUS_SLAVE
+/**
+ * @brief Load sensor serial number into Modbus registers (deferred job)
+ *
+ */
+static void boot_modbus(void)
+{
+	unsigned char id[8];
 
-	return(0);
+	modbus_set_id((si7021_read_id(id) == 0) ? id : 0);
 }
+#endif
 /* EOF */
@@ -0,0 +1,243 @@
+/**
+ * @file  metrics.c
+ * @brief Derived metrics computed from humidity and temperature
+ *
+ * All values are computed in fixed point (Q16.16) from the sensor values in
+ * 1/100 unit, and returned in 1/100 unit. Dew point and vapour pressure use
+ * the Magnus formula (b = 17.62, c = 243.12 deg C), heat index uses the NWS
+ * algorithm (Rothfusz regression with adjustments).
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "fixmath.h"
+#include "metrics.h"
+#ifdef METRICS_BENCH
+#include "time.h"
+#include "uart.h"
+#endif
+
+/* Magnus coefficients (Q16) */
+#define MAGNUS_B   1154744   /* 17.62  */
+#define MAGNUS_C  15933112   /* 243.12 */
+/* Zero Celsius in Kelvin (Q16) */
+#define KELVIN_0  17901158   /* 273.15 */
+/* log2(10000) in Q16, used to compute ln(rh / 100%) */
+#define LOG2_10000  870824
+/* Absolute humidity factor (integer) : 6.112 hPa * 216.74 * 100 (1/100 g/m3) */
+#define AH_FACTOR   132471
+
+/* Heat index coefficients (Q16) for T/100 (deg F) and RH/100 (%) */
+#define HI_C0   -2777350   /*   -42.379     */
+#define HI_C1   13428426   /*   204.901523  */
+#define HI_C2   66475336   /*  1014.333127  */
+#define HI_C3 -147295705   /* -2247.5541    */
+#define HI_C4   -4481240   /*   -68.3783    */
+#define HI_C5  -35924981   /*  -548.1717    */
+#define HI_C6   80526705   /*  1228.74      */
+#define HI_C7   55890412   /*   852.82      */
+#define HI_C8  -13041664   /*  -199.0       */
+
+static int heat_regression(int tf, int r);
+static int magnus_ratio(int temp);
+static int to_hundredths(int v);
+
+/**
+ * @brief Compute the dew point
+ *
+ * @param rh   Relative humidity (1/100 %)
+ * @param temp Temperature (1/100 deg C)
+ * @return integer Dew point temperature (1/100 deg C)
+ */
+int metrics_dewpoint(unsigned int rh, int temp)
+{
+	int gamma;
+	int td;
+
+	/* Limit humidity to ]0 - 100] */
+	if (rh < 1)
+		rh = 1;
+	if (rh > 10000)
+		rh = 10000;
+
+	/* gamma = ln(RH/100) + (b.T / (c + T)) */
+	gamma = fx_mul(fx_log2(rh) - LOG2_10000, FX_LN2);
+	gamma += magnus_ratio(temp);
+	/* Td = c.gamma / (b - gamma) */
+	td = fx_div(fx_mul(MAGNUS_C, gamma), MAGNUS_B - gamma);
+
+	return(to_hundredths(td));
+}
+
+/**
+ * @brief Compute the absolute humidity (water vapour density)
+ *
+ * @param rh   Relative humidity (1/100 %)
+ * @param temp Temperature (1/100 deg C)
+ * @return integer Absolute humidity (1/100 g/m3)
+ */
+int metrics_abs_humidity(unsigned int rh, int temp)
+{
+	int t, v;
+
+	if (rh > 10000)
+		rh = 10000;
+	t = fx_div(temp, 100);
+
+	/* Saturation vapour pressure (/6.112hPa) : exp(b.T / (c + T)) */
+	v = fx_exp(magnus_ratio(temp));
+	/* Partial pressure of vapour (/6.112hPa) */
+	v = fx_mul(v, fx_div(rh, 10000));
+	/* AH = 216.74 * Pw(hPa) / (273.15 + T). The quotient is lower than 1.2 : it
+	 * is kept with 6 more bits (Q22), else its last bit is 0.02 g/m3 */
+	v = fx_div(v << 6, KELVIN_0 + t);
+
+	return((fx_mul(v, AH_FACTOR) + 32) >> 6);
+}
+
+/**
+ * @brief Compute the heat index (apparent temperature)
+ *
+ * NWS selects the simple formula or the regression when (HI + T) / 2 is
+ * lower or higher than 80F. Both differ by up to 1.2 deg C at this point,
+ * so they are blended linearly between 79F and 81F to avoid a step in the
+ * output. The high humidity adjustment is faded in the same way between 78F
+ * and 80F. Outside these bands the result is the NWS value.
+ *
+ * @param rh   Relative humidity (1/100 %)
+ * @param temp Temperature (1/100 deg C)
+ * @return integer Heat index (1/100 deg C)
+ */
+int metrics_heat_index(unsigned int rh, int temp)
+{
+	int tf, r;
+	int hi, avg;
+
+	if (rh > 10000)
+		rh = 10000;
+	/* Temperature in Fahrenheit and humidity in %, Q16 */
+	tf = fx_div(temp * 9, 500) + (32 << 16);
+	r  = fx_div(rh, 100);
+
+	/* Simple formula : 0.5 * (T + 61 + (T - 68) * 1.2 + RH * 0.094) */
+	hi = tf + (61 << 16) + fx_mul(tf - (68 << 16), 78643) + fx_mul(r, 6160);
+	hi = hi / 2;
+
+	avg = (hi + tf) / 2;
+	if (avg >= (81 << 16))
+		hi = heat_regression(tf, r);
+	else if (avg > (79 << 16))
+		hi += fx_mul(heat_regression(tf, r) - hi, (avg - (79 << 16)) / 2);
+
+	/* Convert back to Celsius */
+	return(to_hundredths(fx_div(hi - (32 << 16), (9 << 16) / 5)));
+}
+
+#ifdef METRICS_BENCH
+/**
+ * @brief Measure and print the number of cycles used by each function
+ *
+ */
+void metrics_bench(void)
+{
+	u32 t0, t1, t2, t3;
+	volatile int v;
+
+	t0 = time_cycles();
+	v  = metrics_dewpoint(4512, 2305);
+	t1 = time_cycles();
+	v  = metrics_abs_humidity(4512, 2305);
+	t2 = time_cycles();
+	v  = metrics_heat_index(7000, 3200);
+	t3 = time_cycles();
+	(void)v;
+
+	uart_puts("BENCH dewpoint=");
+	uart_putdec(t1 - t0);
+	uart_puts(" abs_humidity=");
+	uart_putdec(t2 - t1);
+	uart_puts(" heat_index=");
+	uart_putdec(t3 - t2);
+	uart_puts(" cycles\r\n");
+}
+#endif
+
+/**
+ * @brief Compute the heat index with the Rothfusz regression (and the NWS
+ *        adjustments for low and high humidity)
+ *
+ * @param tf Temperature (deg F, Q16)
+ * @param r  Relative humidity (%, Q16)
+ * @return integer Heat index (deg F, Q16)
+ */
+static int heat_regression(int tf, int r)
+{
+	int t, h, hh;
+	int hi;
+	int adj;
+
+	t  = tf / 100;
+	h  = r  / 100;
+	hh = fx_mul(h, h);
+	/* Polynomial in T whose coefficients are polynomials in RH :
+	 * (c0 + c2.h + c5.h2) + T.((c1 + c3.h + c7.h2) + T.(c4 + c6.h + c8.h2)) */
+	hi = HI_C4 + fx_mul(HI_C6, h) + fx_mul(HI_C8, hh);
+	hi = HI_C1 + fx_mul(HI_C3, h) + fx_mul(HI_C7, hh) + fx_mul(t, hi);
+	hi = HI_C0 + fx_mul(HI_C2, h) + fx_mul(HI_C5, hh) + fx_mul(t, hi);
+
+	/* Low humidity : ((13 - RH) / 4) * sqrt((17 - |T - 95|) / 17) */
+	if ((r < (13 << 16)) && (tf >= (80 << 16)) && (tf <= (112 << 16)))
+	{
+		adj = tf - (95 << 16);
+		if (adj < 0)
+			adj = -adj;
+		adj = fx_div((17 << 16) - adj, (17 << 16));
+		adj = fx_isqrt((u32)adj << 14) << 1;
+		hi -= fx_mul(((13 << 16) - r) / 4, adj);
+	}
+	/* High humidity : ((RH - 85) / 10) * ((87 - T) / 5), faded in from 78F
+	 * (NWS starts it at 80F with a step of up to 1.2 deg C) */
+	else if ((r > (85 << 16)) && (tf > (78 << 16)) && (tf <= (87 << 16)))
+	{
+		adj = fx_mul((r - (85 << 16)) / 10, ((87 << 16) - tf) / 5);
+		if (tf < (80 << 16))
+			adj = fx_mul(adj, (tf - (78 << 16)) / 2);
+		hi += adj;
+	}
+
+	return(hi);
+}
+
+/**
+ * @brief Compute the Magnus ratio b.T / (c + T)
+ *
+ * @param temp Temperature (1/100 deg C)
+ * @return integer Value of the ratio (Q16)
+ */
+static int magnus_ratio(int temp)
+{
+	int t;
+
+	t = fx_div(temp, 100);
+	return(fx_div(fx_mul(MAGNUS_B, t), MAGNUS_C + t));
+}
+
+/**
+ * @brief Convert a Q16 value into a rounded integer in 1/100 unit
+ *
+ * @param v Value to convert (Q16)
+ * @return integer Value in 1/100 unit
+ */
+static int to_hundredths(int v)
+{
+	return(fx_mul(v, 100));
+}
+/* EOF */
@@ -0,0 +1,34 @@
+/**
+ * @file  metrics.h
+ * @brief Headers and definitions for derived metrics (dew point, ...)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+#include "types.h"
+
+/* Define to 1 to add derived values (dew point, ...) to the sample lines
+ * and to the Modbus registers */
+#ifndef METRICS_OUTPUT
+#define METRICS_OUTPUT 0
+#endif
+/* Measure and print the number of cycles of each function at startup */
+#undef  METRICS_BENCH
+
+int  metrics_dewpoint(unsigned int rh, int temp);
+int  metrics_abs_humidity(unsigned int rh, int temp);
+int  metrics_heat_index(unsigned int rh, int temp);
+void metrics_bench(void);
+
+#endif
+/* EOF */
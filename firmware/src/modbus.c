@@ -0,0 +1,432 @@
+/**
+ * @file  modbus.c
+ * @brief Modbus RTU slave, served from a cache of the last measurement
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "crc.h"
+#include "hardware.h"
+#include "irq.h"
+#include "metrics.h"
+#include "modbus.h"
+#include "nvconf.h"
+#include "uart.h"
+
+#if MODBUS_SLAVE
+
+/* End of frame delay (t3.5) in us : 3.5 chars of 11 bits, fixed 1750us
+ * above 19200 bauds (Modbus over serial line, 2.5.1.1) */
+#if UART_BAUD > 19200
+#define MODBUS_T35 1750
+#else
+#define MODBUS_T35 ((35 * 11 * 1000000UL) / (10 * UART_BAUD))
+#endif
+#if MODBUS_T35 > 0xFFFF
+#error "t3.5 does not fit the 16 bits timer (baud rate too low)"
+#endif
+
+static void mb_rx(u8 c);
+static void mb_process(const u8 *req, uint len);
+static void mb_exception(u8 fct, u8 code);
+static void mb_send(u8 *buffer, uint len);
+
+static u8  mb_addr;
+static u8  mb_frame[MODBUS_FRAME];
+static volatile uint mb_len;
+static volatile int  mb_overflow;
+/* A frame is being answered (received bytes are dropped) */
+static volatile int  mb_busy;
+/* Configuration modified by a request, saved by modbus_poll() */
+static volatile int  mb_save;
+static int mb_silent;
+/* Cache of input registers, updated by background acquisition */
+static volatile u16  mb_input[MB_IN_COUNT];
+
+/**
+ * @brief Initialize the Modbus slave
+ *
+ * Received bytes are taken from the UART (interrupt) and the TC2 timer is
+ * restarted on each byte. When the line stays idle during t3.5 the frame is
+ * complete and is answered by the TC2 interrupt : responses are built from
+ * the register cache and never wait for a sensor access (nor for the end of
+ * an acquisition running into the main loop).
+ *
+ * @param addr Address of this slave (1 - 247)
+ */
+void modbus_init(u8 addr)
+{
+	int i;
+
+	mb_addr     = addr;
+	mb_len      = 0;
+	mb_overflow = 0;
+	mb_busy     = 0;
+	mb_save     = 0;
+	for (i = 0; i < MB_IN_COUNT; i++)
+		mb_input[i] = 0;
+
+	/* Enable TC2 clock (APBCMASK) */
+	reg_set(PM_ADDR + PM_APBCMASK, PM_APBCMASK_TC2);
+	/* Set GCLK for TC1/TC2 (generic clock generator 0) */
+	reg16_wr(GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	         FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_TC1_TC2));
+
+	/* Reset TC (set SWRST) */
+	reg16_wr(MODBUS_TC + TC_CTRLA, TC_CTRLA_SWRST);
+	while (reg16_rd(MODBUS_TC + TC_CTRLA) & TC_CTRLA_SWRST)
+		;
+	/* Configure TC: 16 bits, match frequency (top = CC0), DIV8 (1MHz) */
+	reg16_wr(MODBUS_TC + TC_CTRLA, FIELD(TC_CTRLA_PRESCALER, TC_PRESC_DIV8) |
+	         FIELD(TC_CTRLA_WAVEGEN, TC_WAVEGEN_MFRQ) |
+	         FIELD(TC_CTRLA_MODE, TC_MODE_COUNT16));
+	reg16_wr(MODBUS_TC + TC_CC0, MODBUS_T35);
+	/* One-shot mode : counter stops on overflow */
+	reg8_wr(MODBUS_TC + TC_CTRLBSET, TC_CTRLB_ONESHOT);
+	while (reg8_rd(MODBUS_TC + TC_STATUS) & TC_STATUS_SYNCBUSY)
+		;
+	/* Enable overflow interrupt */
+	reg8_wr(MODBUS_TC + TC_INTENSET, TC_INT_OVF);
+	reg_wr(NVIC_ISER, (1 << TC2_IRQn));
+	/* Enable TC (stopped until first retrigger) */
+	reg16_wr(MODBUS_TC + TC_CTRLA, FIELD(TC_CTRLA_PRESCALER, TC_PRESC_DIV8) |
+	         FIELD(TC_CTRLA_WAVEGEN, TC_WAVEGEN_MFRQ) |
+	         FIELD(TC_CTRLA_MODE, TC_MODE_COUNT16) | TC_CTRLA_ENABLE);
+	while (reg8_rd(MODBUS_TC + TC_STATUS) & TC_STATUS_SYNCBUSY)
+		;
+	reg8_wr(MODBUS_TC + TC_CTRLBSET, FIELD(TC_CTRLB_CMD, TC_CMD_STOP));
+
+	/* Take received bytes from UART */
+	uart_rx_hook(mb_rx);
+}
+
+/**
+ * @brief Set the serial number of the sensor into input registers
+ *
+ * @param id Pointer to the 8 bytes ID (null if not available)
+ */
+void modbus_set_id(const u8 *id)
+{
+	u32 primask;
+	int i;
+
+	primask = irq_save();
+	for (i = 0; i < 4; i++)
+		mb_input[MB_IN_SN + i] = id ? ((id[2 * i] << 8) | id[(2 * i) + 1]) : 0;
+	if (id == 0)
+		mb_input[MB_IN_STATUS] |= MB_STATUS_ERR_ID;
+	irq_restore(primask);
+}
+
+/**
+ * @brief Update the register cache with a new sample
+ *
+ * @param s Pointer to the last acquired sample
+ */
+void modbus_update(const struct sample *s)
+{
+	u16 status;
+	u16 dew = 0, ah = 0, hi = 0;
+	u32 primask;
+
+	status = MB_STATUS_VALID;
+	if (s->status & SAMPLE_ERR_RH)
+		status |= MB_STATUS_ERR_RH;
+	if (s->status & SAMPLE_ERR_TEMP)
+		status |= MB_STATUS_ERR_TMP;
+	status |= ((s->status & SAMPLE_ALARM_Msk) >> SAMPLE_ALARM_Pos) << MB_STATUS_ALARM_Pos;
+#if METRICS_OUTPUT
+	/* Derived values (registers are kept at 0 without METRICS_OUTPUT) */
+	if ((s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP)) == 0)
+	{
+		dew = metrics_dewpoint(s->rh, s->temp);
+		ah  = metrics_abs_humidity(s->rh, s->temp);
+		hi  = metrics_heat_index(s->rh, s->temp);
+	}
+#endif
+
+	primask = irq_save();
+	status |= (mb_input[MB_IN_STATUS] & MB_STATUS_ERR_ID);
+	mb_input[MB_IN_RH]     = s->rh;
+	mb_input[MB_IN_TEMP]   = (u16)s->temp;
+	mb_input[MB_IN_STATUS] = status;
+	mb_input[MB_IN_SEQ_H]  = (s->seq >> 16);
+	mb_input[MB_IN_SEQ_L]  = (s->seq & 0xFFFF);
+	mb_input[MB_IN_DEW]    = dew;
+	mb_input[MB_IN_AH]     = ah;
+	mb_input[MB_IN_HI]     = hi;
+	irq_restore(primask);
+}
+
+/**
+ * @brief Test if a modified configuration is waiting for modbus_poll()
+ *
+ * @return integer Non-zero if a save is pending
+ */
+int modbus_pending(void)
+{
+	return(mb_save);
+}
+
+/**
+ * @brief Background processing (save of the config)
+ *
+ * Requests are answered by the TC2 interrupt, only the save into NVM (row
+ * erase and write, some ms with the CPU stalled) is deferred to the main
+ * loop.
+ */
+void modbus_poll(void)
+{
+	if (mb_save)
+	{
+		mb_save = 0;
+		nvconf_save();
+	}
+}
+
+/**
+ * @brief Handler of the "MODE" command
+ *
+ * MODE                    Print current mode
+ * MODE ASCII              Use text lines (default)
+ * MODE MODBUS [address]   Use Modbus RTU slave (after SAVE and reset)
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void modbus_cmd(int argc, char **argv)
+{
+	int addr;
+
+	if (argc == 1)
+	{
+		if (nvconf.mode == MODE_MODBUS)
+		{
+			cmd_puts("MODE MODBUS");
+			cmd_putint(nvconf.modbus_addr);
+			cmd_puts("\r\n");
+		}
+		else
+			cmd_puts("MODE ASCII\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "ASCII"))
+		nvconf.mode = MODE_ASCII;
+	else if ((argc <= 3) && cmd_match(argv[1], "MODBUS"))
+	{
+		addr = nvconf.modbus_addr;
+		if ((argc == 3) && cmd_atoi(argv[2], &addr))
+			goto err;
+		if ((addr < 1) || (addr > 247))
+			goto err;
+		nvconf.mode = MODE_MODBUS;
+		nvconf.modbus_addr = addr;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Receive callback, called by UART interrupt for each byte
+ *
+ * @param c Received byte
+ */
+static void mb_rx(u8 c)
+{
+	/* Previous frame not answered yet, or too long : this one is lost */
+	if (mb_busy || (mb_len >= MODBUS_FRAME))
+		mb_overflow = 1;
+	else
+		mb_frame[mb_len++] = c;
+	/* Restart the t3.5 timer (RETRIGGER) */
+	reg8_wr(MODBUS_TC + TC_CTRLBSET, FIELD(TC_CTRLB_CMD, TC_CMD_RETRIGGER));
+}
+
+/**
+ * @brief Process a complete request (called by TC2 interrupt)
+ *
+ * @param req Pointer to the received frame (without CRC)
+ * @param len Length of the frame (without CRC)
+ */
+static void mb_process(const u8 *req, uint len)
+{
+	u8  resp[5 + (2 * MB_IN_COUNT) + 2];
+	uint start, count;
+	uint i;
+	u16 v;
+
+	if (len != 6)
+	{
+		mb_exception(req[1], 0x03);
+		return;
+	}
+	start = (req[2] << 8) | req[3];
+	count = (req[4] << 8) | req[5];
+
+	switch(req[1])
+	{
+		/* Read Holding Registers */
+		case 0x03:
+		/* Read Input Registers */
+		case 0x04:
+			if ((count < 1) || (count > MB_IN_COUNT))
+			{
+				mb_exception(req[1], 0x03);
+				return;
+			}
+			if ((req[1] == 0x04) && ((start + count) > MB_IN_COUNT))
+				goto err_addr;
+			if ((req[1] == 0x03) && ((start + count) > MB_HOLD_COUNT))
+				goto err_addr;
+			resp[0] = mb_addr;
+			resp[1] = req[1];
+			resp[2] = (count * 2);
+			for (i = 0; i < count; i++)
+			{
+				if (req[1] == 0x04)
+					v = mb_input[start + i];
+				else if ((start + i) == MB_HOLD_ADDR)
+					v = nvconf.modbus_addr;
+				else
+					v = nvconf.mode;
+				resp[3 + (2 * i)] = (v >> 8);
+				resp[4 + (2 * i)] = (v & 0xFF);
+			}
+			mb_send(resp, 3 + (2 * count));
+			break;
+
+		/* Write Single Register (count is the new value) */
+		case 0x06:
+			/* Saved only when changed (by modbus_poll) : a repeated
+			 * (or broadcast) write does not erase the user row again */
+			if (start == MB_HOLD_ADDR)
+			{
+				if ((count < 1) || (count > 247))
+					goto err_value;
+				if (nvconf.modbus_addr != count)
+					mb_save = 1;
+				nvconf.modbus_addr = count;
+			}
+			else if (start == MB_HOLD_MODE)
+			{
+				if (count > MODE_MODBUS)
+					goto err_value;
+				if (nvconf.mode != count)
+					mb_save = 1;
+				nvconf.mode = count;
+			}
+			else
+				goto err_addr;
+			/* Response is an echo of the request */
+			for (i = 0; i < 6; i++)
+				resp[i] = req[i];
+			mb_send(resp, 6);
+			break;
+
+		default:
+			mb_exception(req[1], 0x01);
+			break;
+	}
+	return;
+
+err_addr:
+	mb_exception(req[1], 0x02);
+	return;
+err_value:
+	mb_exception(req[1], 0x03);
+}
+
+/**
+ * @brief Send an exception response
+ *
+ * @param fct  Function code of the request
+ * @param code Exception code
+ */
+static void mb_exception(u8 fct, u8 code)
+{
+	u8 resp[5];
+
+	resp[0] = mb_addr;
+	resp[1] = fct | 0x80;
+	resp[2] = code;
+	mb_send(resp, 3);
+}
+
+/**
+ * @brief Append CRC to a response and send it
+ *
+ * In Modbus mode the UART is only written by this function : the response
+ * is queued into the transmit FIFO (large enough for the longest one).
+ *
+ * @param buffer Pointer to the response (2 free bytes at end for CRC)
+ * @param len    Length of the response (without CRC)
+ */
+static void mb_send(u8 *buffer, uint len)
+{
+	u16 crc;
+	uint i;
+
+	if (mb_silent)
+		return;
+
+	crc = crc16(CRC16_INIT, buffer, len);
+	buffer[len++] = (crc & 0xFF);
+	buffer[len++] = (crc >> 8);
+	for (i = 0; i < len; i++)
+		uart_putc(buffer[i]);
+}
+
+/**
+ * @brief Interrupt service routine for TC2 (end of frame)
+ *
+ */
+void TC2_Handler(void)
+{
+	u32 stamp = irq_stamp();
+	uint len;
+	u16 crc;
+
+	/* Clear OVF flag */
+	reg8_wr(MODBUS_TC + TC_INTFLAG, TC_INT_OVF);
+
+	len = mb_len;
+	/* Ignore frames too short or too long (or received while the previous
+	 * one was answered), and frames for another slave */
+	if (mb_overflow || (len < 4) ||
+	    ((mb_frame[0] != mb_addr) && (mb_frame[0] != 0)))
+		mb_overflow = 0;
+	else
+	{
+		/* Bytes received from now are dropped (UART has a higher
+		 * priority) with the rest of their frame : overflow is kept */
+		mb_busy = 1;
+		crc = crc16(CRC16_INIT, mb_frame, len - 2);
+		if ((mb_frame[len - 2] == (crc & 0xFF)) &&
+		    (mb_frame[len - 1] == (crc >> 8)))
+		{
+			/* Broadcast requests are processed but never answered */
+			mb_silent = (mb_frame[0] == 0);
+			mb_process(mb_frame, len - 2);
+		}
+	}
+	/* Buffer is free for the next frame */
+	mb_len  = 0;
+	mb_busy = 0;
+
+	/* One-shot timer is stopped : time of the event is not known */
+	irq_account(IRQ_ID_MODBUS, IRQ_LAT_NONE, stamp);
+}
+#endif
+/* EOF */
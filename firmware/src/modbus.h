@@ -0,0 +1,73 @@
+/**
+ * @file  modbus.h
+ * @brief Headers and definitions for the Modbus RTU slave
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef MODBUS_H
+#define MODBUS_H
+#include "hardware.h"
+#include "sampler.h"
+#include "types.h"
+
+/* Define to 1 to add the Modbus RTU slave (and the MODE command) */
+#ifndef MODBUS_SLAVE
+#define MODBUS_SLAVE   0
+#endif
+
+/* Timer used to detect end of frame (t3.5) */
+#define MODBUS_TC      TC2_ADDR
+/* Max size of a received frame (requests used here are 8 bytes) */
+#define MODBUS_FRAME   16
+/* Default slave address */
+#define MODBUS_ADDR    1
+
+/* Input registers (function 0x04) */
+#define MB_IN_RH       0   /* Relative humidity (1/100 %)            */
+#define MB_IN_TEMP     1   /* Temperature (1/100 deg C, signed)      */
+#define MB_IN_STATUS   2   /* Status flags (MB_STATUS_xx)            */
+#define MB_IN_SEQ_H    3   /* Sequence number of the sample (MSW)    */
+#define MB_IN_SEQ_L    4   /* Sequence number of the sample (LSW)    */
+#define MB_IN_SN       5   /* Serial number, 4 registers (SNA3 first)*/
+/* Derived values, 0 when the firmware is built without METRICS_OUTPUT */
+#define MB_IN_DEW      9   /* Dew point (1/100 deg C, signed)        */
+#define MB_IN_AH      10   /* Absolute humidity (1/100 g/m3)         */
+#define MB_IN_HI      11   /* Heat index (1/100 deg C, signed)       */
+#define MB_IN_COUNT   12
+/* Holding registers (functions 0x03 and 0x06) */
+#define MB_HOLD_ADDR   0   /* Slave address (saved, used after reset) */
+#define MB_HOLD_MODE   1   /* Output mode (0 = ASCII, 1 = Modbus)     */
+#define MB_HOLD_COUNT  2
+
+/* Flags of the status register */
+#define MB_STATUS_VALID   (1 << 0)
+#define MB_STATUS_ERR_RH  (1 << 1)
+#define MB_STATUS_ERR_TMP (1 << 2)
+#define MB_STATUS_ERR_ID  (1 << 3)
+/* Bits 4-7 : threshold alarm state (ALARM_xx flags) */
+#define MB_STATUS_ALARM_Pos 4
+
+/* Output modes */
+#define MODE_ASCII  0
+#define MODE_MODBUS 1
+
+#if MODBUS_SLAVE
+void modbus_init(u8 addr);
+void modbus_set_id(const u8 *id);
+void modbus_update(const struct sample *s);
+int  modbus_pending(void);
+void modbus_poll(void);
+void modbus_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
@@ -0,0 +1,165 @@
+/**
+ * @file  nvconf.c
+ * @brief Persistent configuration stored into non-volatile memory
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "crc.h"
+#include "modbus.h"
+#include "nvconf.h"
+#include "nvm.h"
+
+#define NVCONF_HEAD    8
+#define NVCONF_PAYLOAD (sizeof(struct nvconf) - NVCONF_HEAD)
+
+struct nvconf nvconf;
+
+static void nvconf_check(void);
+static void nvconf_default(void);
+
+/**
+ * @brief Load configuration from NVM (or use defaults)
+ *
+ */
+void nvconf_load(void)
+{
+	struct nvconf *rec = (struct nvconf *)(NVM_USER_ROW + NVM_USER_FUSES);
+	u16 crc;
+
+	nvconf_default();
+
+	/* Verify the stored record */
+	if (rec->magic != NVCONF_MAGIC)
+		return;
+	if ((rec->size == 0) || (rec->size > NVCONF_PAYLOAD))
+		return;
+	crc = crc16(CRC16_INIT, (const u8 *)rec + NVCONF_HEAD, rec->size);
+	if (crc != rec->crc)
+		return;
+
+	/* Load record (may be shorter than current one) */
+	nvm_user_read(&nvconf, NVCONF_HEAD + rec->size);
+	nvconf.size = NVCONF_PAYLOAD;
+	nvconf_check();
+}
+
+/**
+ * @brief Save current configuration into NVM
+ *
+ * @return integer Zero on success, other values are errors
+ */
+int nvconf_save(void)
+{
+	nvconf.magic = NVCONF_MAGIC;
+	nvconf.size  = NVCONF_PAYLOAD;
+	nvconf.crc   = crc16(CRC16_INIT, (const u8 *)&nvconf + NVCONF_HEAD,
+	                     NVCONF_PAYLOAD);
+
+	return(nvm_user_write(&nvconf, sizeof(struct nvconf)));
+}
+
+/**
+ * @brief Handler of the "SAVE" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void nvconf_cmd(int argc, char **argv)
+{
+	(void)argv;
+
+	if ((argc == 1) && (nvconf_save() == 0))
+		cmd_ok();
+	else
+		cmd_error();
+}
+
+/**
+ * @brief Verify the loaded configuration
+ *
+ * A valid CRC does not mean valid values (record of another firmware
+ * version) : each group with a value out of the range accepted by its
+ * command is set back to default values.
+ */
+static void nvconf_check(void)
+{
+	struct bus_conf *bus = &nvconf.bus;
+	struct report_conf *rpt = &nvconf.report;
+	const struct alarm_chan *c;
+	uint i;
+
+	if (nvconf.mode > MODE_MODBUS)
+		nvconf.mode = MODE_ASCII;
+	if ((nvconf.modbus_addr < 1) || (nvconf.modbus_addr > 247))
+		nvconf.modbus_addr = MODBUS_ADDR;
+	if (nvconf.format >= FORMAT_COUNT)
+		nvconf.format = FORMAT_DEFAULT;
+
+	/* Groups of the features removed from the build are set to defaults */
+	if ( ! BUS_RS485 || (bus->mode > BUS_TDMA) ||
+	    ((bus->mode == BUS_TDMA) &&
+	     ((bus->slots < 2) || (bus->slots > BUS_SLOTS_MAX) ||
+	      (bus->slot_ms < BUS_SLOT_MIN) ||
+	      ((nvconf.modbus_addr % bus->slots) == 0))))
+		bus_default(bus);
+
+	if ( ! REPORT_RBE || (rpt->enable > 1) ||
+	    (rpt->min_interval > REPORT_TIME_MAX) ||
+	    (rpt->heartbeat > REPORT_TIME_MAX))
+		report_default(rpt);
+
+	for (i = 0; i < 2; i++)
+	{
+		c = &nvconf.alarm.chan[i];
+		if ( ! ALARM_OUTPUT ||
+		    (c->enable && ((c->low > c->high) || (c->hyst > (c->high - c->low)))))
+		{
+			alarm_default(&nvconf.alarm);
+			break;
+		}
+	}
+
+	if ( ! STATS_WINDOW || (nvconf.stats.window > STATS_WINDOW_MAX))
+		stats_default(&nvconf.stats);
+
+	/* CPU mode, or the external trigger when it is built */
+	if ( ! SAMPLER_EXT || (nvconf.acq.mode != ACQ_EXT))
+		acq_default(&nvconf.acq);
+}
+
+/**
+ * @brief Set all fields of the configuration to default values
+ *
+ */
+static void nvconf_default(void)
+{
+	nvconf.magic = NVCONF_MAGIC;
+	nvconf.size  = NVCONF_PAYLOAD;
+	nvconf.crc   = 0;
+	calib_default(&nvconf.cal_rh);
+	calib_default(&nvconf.cal_temp);
+	nvconf.mode        = MODE_ASCII;
+	nvconf.modbus_addr = MODBUS_ADDR;
+	nvconf.reserved    = 0;
+	report_default(&nvconf.report);
+	bus_default(&nvconf.bus);
+	power_default(&nvconf.power);
+	nvconf.format      = FORMAT_DEFAULT;
+	nvconf.reserved2[0] = 0;
+	nvconf.reserved2[1] = 0;
+	nvconf.reserved2[2] = 0;
+	alarm_default(&nvconf.alarm);
+	stats_default(&nvconf.stats);
+	acq_default(&nvconf.acq);
+}
+/* EOF */
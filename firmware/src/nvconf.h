@@ -0,0 +1,63 @@
+/**
+ * @file  nvconf.h
+ * @brief Headers and definitions for the persistent configuration
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef NVCONF_H
+#define NVCONF_H
+#include "acq.h"
+#include "alarm.h"
+#include "bus.h"
+#include "calib.h"
+#include "format.h"
+#include "power.h"
+#include "report.h"
+#include "stats.h"
+#include "types.h"
+
+#define NVCONF_MAGIC 0x43485254  /* "TRHC" */
+
+/**
+ * Persistent configuration, stored into the NVM user row. New fields must be
+ * added at the end : a record saved by an older firmware is still loaded
+ * (with default values for missing fields).
+ */
+struct nvconf
+{
+	u32 magic;
+	u16 size;         /* Size of the payload (after crc) */
+	u16 crc;          /* CRC-16 of the payload           */
+	/* Payload */
+	struct calib_chan cal_rh;
+	struct calib_chan cal_temp;
+	u8  mode;         /* Output mode (MODE_ASCII, MODE_MODBUS) */
+	u8  modbus_addr;  /* Node address (Modbus and bus modes)   */
+	u16 reserved;
+	struct report_conf report;
+	struct bus_conf bus;
+	struct power_conf power;
+	u8  format;       /* Sample output format (FORMAT_xx)      */
+	u8  reserved2[3];
+	struct alarm_conf alarm;
+	struct stats_conf stats;
+	struct acq_conf acq;
+};
+
+extern struct nvconf nvconf;
+
+void nvconf_load(void);
+int  nvconf_save(void);
+void nvconf_cmd(int argc, char **argv);
+
+#endif
+/* EOF */
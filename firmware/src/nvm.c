@@ -0,0 +1,154 @@
+/**
+ * @file  nvm.c
+ * @brief Handle the non-volatile memory controller (NVMCTRL)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "hardware.h"
+#include "nvm.h"
+
+static int nvm_cmd(u32 cmd, u32 addr);
+static int nvm_user_cmp(const u32 *image);
+
+/**
+ * @brief Read data stored into the user row (after fuses)
+ *
+ * @param dst  Pointer to a buffer where readed data can be stored
+ * @param size Number of bytes to read
+ * @return integer Zero on success, -1 if size exceeds the user row
+ */
+int nvm_user_read(void *dst, uint size)
+{
+	const u8 *src = (const u8 *)(NVM_USER_ROW + NVM_USER_FUSES);
+	u8 *d = (u8 *)dst;
+
+	if (size > (NVM_ROW_SIZE - NVM_USER_FUSES))
+		return(-1);
+	while (size--)
+		*d++ = *src++;
+	return(0);
+}
+
+/**
+ * @brief Write data into the user row (after fuses)
+ *
+ * The new content of the row is built into RAM : fuses (first 64 bits) are
+ * read and kept, remaining bytes after the data are set to 0xFF. Nothing
+ * is done when the row already contains this image. Otherwise the whole
+ * row is erased then all pages are rewritten, and verified. Do not remove
+ * power during this function : an erased fuse row enables the watchdog
+ * and removes bootloader protection on next reset.
+ *
+ * @param src  Pointer to the data to write (32 bits aligned)
+ * @param size Number of bytes to write (multiple of 4)
+ * @return integer Zero on success, other values are errors
+ */
+int nvm_user_write(const void *src, uint size)
+{
+	const u32 *data = (const u32 *)src;
+	volatile u32 *row = (volatile u32 *)NVM_USER_ROW;
+	u32 image[NVM_ROW_SIZE / 4];
+	u32 ctrlb;
+	uint i;
+	int result = 0;
+
+	if (size > (NVM_ROW_SIZE - NVM_USER_FUSES))
+		return(-1);
+
+	for (i = 0; i < (NVM_ROW_SIZE / 4); i++)
+	{
+		if (i < (NVM_USER_FUSES / 4))
+			image[i] = row[i];
+		else if (((i * 4) - NVM_USER_FUSES) < size)
+			image[i] = data[i - (NVM_USER_FUSES / 4)];
+		else
+			image[i] = 0xFFFFFFFF;
+	}
+	/* Row already up to date : keep it (and the fuses) untouched */
+	if (nvm_user_cmp(image) == 0)
+		return(0);
+
+	/* Use manual page write (MANW) during update */
+	ctrlb = reg_rd(NVM_ADDR + NVMCTRL_CTRLB);
+	reg_wr(NVM_ADDR + NVMCTRL_CTRLB, ctrlb | NVMCTRL_CTRLB_MANW);
+	/* Clear previous errors (STATUS) */
+	reg16_wr(NVM_ADDR + NVMCTRL_STATUS,
+	         NVMCTRL_STATUS_LOAD | NVMCTRL_STATUS_ERRORS);
+
+	if (nvm_cmd(NVMCTRL_CMD_EAR, NVM_USER_ROW))
+		result = -2;
+
+	for (i = 0; (result == 0) && (i < (NVM_ROW_SIZE / 4)); i++)
+	{
+		/* Start of a page : clear the page buffer */
+		if ((i % (NVM_PAGE_SIZE / 4)) == 0)
+			nvm_cmd(NVMCTRL_CMD_PBC, 0);
+		row[i] = image[i];
+		/* Page buffer is full : write it */
+		if (((i + 1) % (NVM_PAGE_SIZE / 4)) == 0)
+		{
+			if (nvm_cmd(NVMCTRL_CMD_WAP, NVM_USER_ROW + ((i * 4) & ~(NVM_PAGE_SIZE - 1))))
+				result = -3;
+		}
+	}
+
+	/* Restore previous config */
+	reg_wr(NVM_ADDR + NVMCTRL_CTRLB, ctrlb);
+
+	if ((result == 0) && nvm_user_cmp(image))
+		result = -4;
+	return(result);
+}
+
+/**
+ * @brief Compare the user row with an image of its content
+ *
+ * @param image Pointer to the expected content (whole row)
+ * @return integer Zero if the row contains the image, -1 otherwise
+ */
+static int nvm_user_cmp(const u32 *image)
+{
+	const volatile u32 *row = (const volatile u32 *)NVM_USER_ROW;
+	uint i;
+
+	for (i = 0; i < (NVM_ROW_SIZE / 4); i++)
+	{
+		if (row[i] != image[i])
+			return(-1);
+	}
+	return(0);
+}
+
+/**
+ * @brief Execute a NVM controller command and wait until it completes
+ *
+ * @param cmd  Command to execute
+ * @param addr Byte address of the targeted row/page
+ * @return integer Zero on success, -1 on error (STATUS)
+ */
+static int nvm_cmd(u32 cmd, u32 addr)
+{
+	/* Wait for NVM controller ready (INTFLAG.READY) */
+	while ((reg8_rd(NVM_ADDR + NVMCTRL_INTFLAG) & NVMCTRL_INT_READY) == 0)
+		;
+	/* ADDR register use 16 bits words address */
+	reg_wr(NVM_ADDR + NVMCTRL_ADDR, (addr >> 1));
+	/* Write command with execution key (CMDEX) */
+	reg16_wr(NVM_ADDR + NVMCTRL_CTRLA, NVMCTRL_CTRLA_CMDEX | cmd);
+	while ((reg8_rd(NVM_ADDR + NVMCTRL_INTFLAG) & NVMCTRL_INT_READY) == 0)
+		;
+	/* Test PROGE, LOCKE and NVME */
+	if (reg16_rd(NVM_ADDR + NVMCTRL_STATUS) & NVMCTRL_STATUS_ERRORS)
+		return(-1);
+	return(0);
+}
+/* EOF */
@@ -0,0 +1,31 @@
+/**
+ * @file  nvm.h
+ * @brief Definitions and prototypes for NVM (flash) functions
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef NVM_H
+#define NVM_H
+#include "hardware.h"
+#include "types.h"
+
+/* Auxiliary space : user row (256 bytes, first 64 bits are fuses) */
+#define NVM_USER_ROW   ((u32)0x00804000)
+#define NVM_USER_FUSES 8
+#define NVM_PAGE_SIZE  64
+#define NVM_ROW_SIZE   256
+
+int nvm_user_read (void *dst, uint size);
+int nvm_user_write(const void *src, uint size);
+
+#endif
+/* EOF */
@@ -0,0 +1,219 @@
+/**
+ * @file  power.c
+ * @brief State residency and energy accounting (current model)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "nvconf.h"
+#include "power.h"
+#include "time.h"
+
+#if POWER_STATS
+static void power_reset(void);
+static u32  power_ratio(u32 a, u32 b);
+
+static const char * const power_names[POWER_STATES] = {
+	"ACTIVE", "I2C", "UART", "IDLE"
+};
+
+static uint pw_state;
+static u32  pw_stamp;
+/* Cycles into each state since the last sample */
+static u32  pw_win[POWER_STATES];
+/* Total time into each state (ms, and remaining cycles) */
+static u32  pw_ms[POWER_STATES];
+static u32  pw_frac[POWER_STATES];
+/* Charge per sample (nC) */
+static u32  pw_samples;
+static u32  pw_last;
+static u32  pw_total_uc;
+static u32  pw_total_nc;
+#endif
+
+/**
+ * @brief Set default current model
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void power_default(struct power_conf *conf)
+{
+	conf->ua[POWER_ACTIVE] = 1800;
+	conf->ua[POWER_I2C]    = 1900;
+	conf->ua[POWER_UART]   = 1800;
+	conf->ua[POWER_IDLE]   =  900;
+}
+
+#if POWER_STATS
+/**
+ * @brief Enter a new state, the time since last change is accounted to the
+ *        previous one
+ *
+ * Calls from interrupt handlers are ignored : time spent into a handler is
+ * accounted to the state it has interrupted.
+ *
+ * @param state New state (POWER_xx)
+ * @return uint Previous state, to be restored at the end of a wait
+ */
+uint power_enter(uint state)
+{
+	uint prev = pw_state;
+	u32 ipsr;
+	u32 now;
+
+	asm volatile("mrs %0, ipsr" : "=r" (ipsr));
+	if (ipsr)
+		return(prev);
+
+	now = time_cycles();
+	pw_win[prev] += (now - pw_stamp);
+	pw_stamp = now;
+	pw_state = state;
+	return(prev);
+}
+
+/**
+ * @brief Close the accounting window of a sample (called once per sample)
+ *
+ * The charge used since the previous sample is computed from the time spent
+ * into each state and the current model.
+ */
+void power_sample(void)
+{
+	const struct power_conf *conf = &nvconf.power;
+	u32 us, nc = 0;
+	uint i;
+
+	/* Account the current state up to now */
+	power_enter(pw_state);
+
+	for (i = 0; i < POWER_STATES; i++)
+	{
+		/* us * uA = pC, computed by ms to avoid overflow */
+		us  = pw_win[i] / (TIME_CYCLES_MS / 1000);
+		nc += (us / 1000) * conf->ua[i];
+		nc += ((us % 1000) * conf->ua[i]) / 1000;
+		/* Update total residency */
+		pw_frac[i] += pw_win[i];
+		pw_ms[i]   += pw_frac[i] / TIME_CYCLES_MS;
+		pw_frac[i]  = pw_frac[i] % TIME_CYCLES_MS;
+		pw_win[i]   = 0;
+	}
+	pw_last = nc;
+	pw_samples++;
+	pw_total_nc += nc;
+	pw_total_uc += pw_total_nc / 1000;
+	pw_total_nc  = pw_total_nc % 1000;
+}
+
+/**
+ * @brief Handler of the "POWER" command
+ *
+ * Without argument, print for each state the total time (ms), the
+ * residency (1/1000) and the current of the model (uA), then the average
+ * current and the number of samples with the charge of the last one and
+ * the mean charge per sample (nC).
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void power_cmd(int argc, char **argv)
+{
+	struct power_conf *conf = &nvconf.power;
+	u32 total, ratio, avg;
+	int v[POWER_STATES];
+	uint i;
+
+	if (argc == 1)
+	{
+		total = 0;
+		for (i = 0; i < POWER_STATES; i++)
+			total += pw_ms[i];
+		avg = 0;
+		for (i = 0; i < POWER_STATES; i++)
+		{
+			ratio = power_ratio(pw_ms[i], total);
+			avg  += ratio * conf->ua[i];
+			cmd_puts("POWER ");
+			cmd_puts(power_names[i]);
+			cmd_putint(pw_ms[i]);
+			cmd_putint(ratio);
+			cmd_putint(conf->ua[i]);
+			cmd_puts("\r\n");
+		}
+		cmd_puts("POWER AVG");
+		cmd_putint(avg / 1000);
+		cmd_puts("\r\nPOWER SAMPLE");
+		cmd_putint(pw_samples);
+		cmd_putint(pw_last);
+		cmd_putint(power_ratio(pw_total_uc, pw_samples));
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "RESET"))
+		power_reset();
+	else if ((argc == (2 + POWER_STATES)) && cmd_match(argv[1], "MODEL"))
+	{
+		for (i = 0; i < POWER_STATES; i++)
+		{
+			if (cmd_atoi(argv[2 + i], &v[i]) || (v[i] < 0) || (v[i] > 0xFFFF))
+				goto err;
+		}
+		for (i = 0; i < POWER_STATES; i++)
+			conf->ua[i] = v[i];
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Clear all counters (current window is kept)
+ *
+ */
+static void power_reset(void)
+{
+	uint i;
+
+	for (i = 0; i < POWER_STATES; i++)
+	{
+		pw_ms[i]   = 0;
+		pw_frac[i] = 0;
+	}
+	pw_samples  = 0;
+	pw_last     = 0;
+	pw_total_uc = 0;
+	pw_total_nc = 0;
+}
+
+/**
+ * @brief Compute (a * 1000) / b without overflow (reduced precision)
+ *
+ * @param a Numerator
+ * @param b Denominator
+ * @return u32 Ratio in 1/1000, zero if b is zero
+ */
+static u32 power_ratio(u32 a, u32 b)
+{
+	while (a > (0xFFFFFFFF / 1000))
+	{
+		a >>= 1;
+		b >>= 1;
+	}
+	if (b == 0)
+		return(0);
+	return((a * 1000) / b);
+}
+#endif
+/* EOF */
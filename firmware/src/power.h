@@ -0,0 +1,53 @@
+/**
+ * @file  power.h
+ * @brief Headers and definitions for state residency and energy accounting
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef POWER_H
+#define POWER_H
+#include "types.h"
+
+/* Define to 1 to add the state residency accounting (POWER command) */
+#ifndef POWER_STATS
+#define POWER_STATS  0
+#endif
+
+/* States of the firmware */
+#define POWER_ACTIVE 0  /* Running code (compute, formatting, ...)    */
+#define POWER_I2C    1  /* Waiting for the I2C bus (sensor conversion) */
+#define POWER_UART   2  /* Waiting for the UART (transmit FIFO full)   */
+#define POWER_IDLE   3  /* Sleeping (WFI), waiting for an interrupt    */
+#define POWER_STATES 4
+
+/**
+ * Current model : supply current of the board into each state (in uA).
+ * Defaults are estimates, they should be replaced by bench measurements
+ * (POWER MODEL command) to get absolute values.
+ */
+struct power_conf
+{
+	u16 ua[POWER_STATES];
+};
+
+void power_default(struct power_conf *conf);
+#if POWER_STATS
+uint power_enter(uint state);
+void power_sample(void);
+void power_cmd(int argc, char **argv);
+#else
+static inline uint power_enter(uint state) { return(state); }
+static inline void power_sample(void) { }
+#endif
+
+#endif
+/* EOF */
@@ -0,0 +1,374 @@
+/**
+ * @file  regs.h
+ * @brief Register map and bitfields of ATSAMD09 peripherals
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef REGS_H
+#define REGS_H
+
+/*
+ * Registers are described by their offset from the peripheral base address
+ * (see hardware.h). Each bitfield is described by a position (_Pos) and a
+ * mask (_Msk); single bits are given as a ready to use mask and multi-bits
+ * fields have a macro to insert a value : FIELD(GCLK_CLKCTRL_GEN, 0).
+ * Everything is resolved by the preprocessor and the compiler, so a driver
+ * that uses these names produces the same code as raw values.
+ */
+
+/* Insert a value into a bitfield (value is truncated to field size) */
+#define FIELD(f, v)  (((u32)(v) << f##_Pos) & f##_Msk)
+/* Extract the value of a bitfield from a register value */
+#define FIELD_GET(f, r) (((u32)(r) & f##_Msk) >> f##_Pos)
+
+/* -------------------------------------------------------------------------- */
+/* -- NVIC (Nested Vectored Interrupt Controller)                         -- */
+/* -------------------------------------------------------------------------- */
+#define NVIC_ISER  ((u32)0xE000E100)
+#define NVIC_ICER  ((u32)0xE000E180)
+/* Priority registers : 4 lines per register, 2 bits (7:6) per line */
+#define NVIC_IPR(n)      ((u32)0xE000E400 + (((n) >> 2) << 2))
+#define NVIC_IPR_SHIFT(n) ((((n) & 3) << 3) + 6)
+/* Interrupt lines */
+#define PM_IRQn       0
+#define SYSCTRL_IRQn  1
+#define WDT_IRQn      2
+#define RTC_IRQn      3
+#define EIC_IRQn      4
+#define NVMCTRL_IRQn  5
+#define SERCOM0_IRQn  9
+#define SERCOM1_IRQn 10
+#define TC1_IRQn     13
+#define TC2_IRQn     14
+#define ADC_IRQn     15
+
+/* -------------------------------------------------------------------------- */
+/* -- SCB (System Control Block) and SysTick                              -- */
+/* -------------------------------------------------------------------------- */
+#define SCB_ICSR   ((u32)0xE000ED04)
+#define SCB_ICSR_PENDSTSET     (1 << 26)
+#define SCB_VTOR   ((u32)0xE000ED08)
+#define SCB_AIRCR  ((u32)0xE000ED0C)
+#define SCB_AIRCR_VECTKEY      (0x05FAu << 16)
+#define SCB_AIRCR_SYSRESETREQ  (1 << 2)
+#define SCB_SHPR3  ((u32)0xE000ED20)
+#define SCB_SHPR3_SYSTICK_Pos  30
+#define SCB_SHPR3_SYSTICK_Msk  (0x03u << 30)
+#define SCB_SHPR3_PENDSV_Pos   22
+#define SCB_SHPR3_PENDSV_Msk   (0x03 << 22)
+#define SYST_CSR   ((u32)0xE000E010)
+#define SYST_RVR   ((u32)0xE000E014)
+#define SYST_CVR   ((u32)0xE000E018)
+#define SYST_CSR_ENABLE        (1 << 0)
+#define SYST_CSR_TICKINT       (1 << 1)
+#define SYST_CSR_CLKSOURCE     (1 << 2)
+#define SYST_CVR_MAX           0x00FFFFFF  /* 24 bits down counter */
+
+/* -------------------------------------------------------------------------- */
+/* -- MTB (Micro Trace Buffer)                                             -- */
+/* -------------------------------------------------------------------------- */
+#define MTB_POSITION 0x000
+#define MTB_MASTER   0x004
+#define MTB_FLOW     0x008
+#define MTB_BASE     0x00C
+#define MTB_POSITION_WRAP     (1 << 2)
+#define MTB_MASTER_MASK_Pos   0
+#define MTB_MASTER_MASK_Msk   (0x1F << 0)
+#define MTB_MASTER_TSTARTEN   (1 << 5)
+#define MTB_MASTER_TSTOPEN    (1 << 6)
+#define MTB_MASTER_EN         (1UL << 31)
+
+/* -------------------------------------------------------------------------- */
+/* -- NVMCTRL (Non-Volatile Memory Controller)                            -- */
+/* -------------------------------------------------------------------------- */
+#define NVMCTRL_CTRLA   0x00
+#define NVMCTRL_CTRLB   0x04
+#define NVMCTRL_INTFLAG 0x14
+#define NVMCTRL_STATUS  0x18
+#define NVMCTRL_ADDR    0x1C
+/* CTRLA : command, written with the execution key */
+#define NVMCTRL_CTRLA_CMD_Pos  0
+#define NVMCTRL_CTRLA_CMD_Msk  (0x7F << 0)
+#define NVMCTRL_CTRLA_CMDEX    (0xA5 << 8)
+#define NVMCTRL_CMD_ER         0x02  /* Erase Row                 */
+#define NVMCTRL_CMD_WP         0x04  /* Write Page                */
+#define NVMCTRL_CMD_EAR        0x05  /* Erase Auxiliary Row       */
+#define NVMCTRL_CMD_WAP        0x06  /* Write Auxiliary Page      */
+#define NVMCTRL_CMD_PBC        0x44  /* Page Buffer Clear         */
+/* CTRLB */
+#define NVMCTRL_CTRLB_RWS_Pos  1
+#define NVMCTRL_CTRLB_RWS_Msk  (0x0F << 1)
+#define NVMCTRL_CTRLB_MANW     (1 << 7)
+/* INTFLAG */
+#define NVMCTRL_INT_READY      (1 << 0)
+/* STATUS (cleared by writing 1) */
+#define NVMCTRL_STATUS_LOAD    (1 << 1)
+#define NVMCTRL_STATUS_PROGE   (1 << 2)
+#define NVMCTRL_STATUS_LOCKE   (1 << 3)
+#define NVMCTRL_STATUS_NVME    (1 << 4)
+#define NVMCTRL_STATUS_ERRORS  (NVMCTRL_STATUS_PROGE | NVMCTRL_STATUS_LOCKE | \
+                                NVMCTRL_STATUS_NVME)
+
+/* -------------------------------------------------------------------------- */
+/* -- PM (Power Manager)                                                   -- */
+/* -------------------------------------------------------------------------- */
+#define PM_CTRL      0x00
+#define PM_SLEEP     0x01
+#define PM_CPUSEL    0x08
+#define PM_APBASEL   0x09
+#define PM_APBBSEL   0x0A
+#define PM_APBCSEL   0x0B
+#define PM_AHBMASK   0x14
+#define PM_APBAMASK  0x18
+#define PM_APBBMASK  0x1C
+#define PM_APBCMASK  0x20
+#define PM_RCAUSE    0x38
+/* APBAMASK bits */
+#define PM_APBAMASK_WDT     (1 << 4)
+#define PM_APBAMASK_EIC     (1 << 6)
+/* APBCMASK bits */
+#define PM_APBCMASK_PAC2    (1 << 0)
+#define PM_APBCMASK_SERCOM0 (1 << 2)
+#define PM_APBCMASK_SERCOM1 (1 << 3)
+#define PM_APBCMASK_TC1     (1 << 5)
+#define PM_APBCMASK_TC2     (1 << 6)
+#define PM_APBCMASK_ADC     (1 << 7)
+/* RCAUSE bits */
+#define PM_RCAUSE_POR       (1 << 0)
+#define PM_RCAUSE_BOD12     (1 << 1)
+#define PM_RCAUSE_BOD33     (1 << 2)
+#define PM_RCAUSE_EXT       (1 << 4)
+#define PM_RCAUSE_WDT       (1 << 5)
+#define PM_RCAUSE_SYST      (1 << 6)
+
+/* -------------------------------------------------------------------------- */
+/* -- SYSCTRL (System Controller)                                          -- */
+/* -------------------------------------------------------------------------- */
+#define SYSCTRL_PCLKSR 0x0C
+#define SYSCTRL_OSC8M  0x20
+#define SYSCTRL_PCLKSR_OSC8MRDY    (1 << 3)
+#define SYSCTRL_OSC8M_ENABLE       (1 << 1)
+#define SYSCTRL_OSC8M_RUNSTDBY     (1 << 6)
+#define SYSCTRL_OSC8M_ONDEMAND     (1 << 7)
+#define SYSCTRL_OSC8M_PRESC_Pos    8
+#define SYSCTRL_OSC8M_PRESC_Msk    (0x03 << 8)
+
+/* -------------------------------------------------------------------------- */
+/* -- GCLK (Generic Clock Controller)                                      -- */
+/* -------------------------------------------------------------------------- */
+#define GCLK_CTRL    0x00
+#define GCLK_STATUS  0x01
+#define GCLK_CLKCTRL 0x02
+#define GCLK_GENCTRL 0x04
+#define GCLK_GENDIV  0x08
+/* STATUS */
+#define GCLK_STATUS_SYNCBUSY (1 << 7)
+/* CLKCTRL */
+#define GCLK_CLKCTRL_ID_Pos     0
+#define GCLK_CLKCTRL_ID_Msk     (0x3F << 0)
+#define GCLK_CLKCTRL_GEN_Pos    8
+#define GCLK_CLKCTRL_GEN_Msk    (0x0F << 8)
+#define GCLK_CLKCTRL_CLKEN      (1 << 14)
+#define GCLK_CLKCTRL_WRTLOCK    (1 << 15)
+/* GENCTRL */
+#define GCLK_GENCTRL_ID_Pos     0
+#define GCLK_GENCTRL_ID_Msk     (0x0F << 0)
+#define GCLK_GENCTRL_SRC_Pos    8
+#define GCLK_GENCTRL_SRC_Msk    (0x1F << 8)
+#define GCLK_GENCTRL_GENEN      (1 << 16)
+#define GCLK_GENCTRL_DIVSEL     (1 << 20)
+/* GENDIV */
+#define GCLK_GENDIV_ID_Pos      0
+#define GCLK_GENDIV_ID_Msk      (0x0F << 0)
+#define GCLK_GENDIV_DIV_Pos     8
+#define GCLK_GENDIV_DIV_Msk     (0xFFFF << 8)
+/* Clock sources */
+#define GCLK_SRC_OSCULP32K 0x03
+#define GCLK_SRC_OSC8M     0x06
+/* Generic clock IDs (CLKCTRL.ID) */
+#define GCLK_ID_WDT     3
+#define GCLK_ID_EIC     5
+#define GCLK_ID_SERCOM0 14
+#define GCLK_ID_SERCOM1 15
+#define GCLK_ID_TC1_TC2 17
+
+/* -------------------------------------------------------------------------- */
+/* -- PORT (accessed through IOBUS)                                         -- */
+/* -------------------------------------------------------------------------- */
+#define PORT_DIR      0x00
+#define PORT_DIRCLR   0x04
+#define PORT_DIRSET   0x08
+#define PORT_OUT      0x10
+#define PORT_OUTCLR   0x14
+#define PORT_OUTSET   0x18
+#define PORT_OUTTGL   0x1C
+#define PORT_IN       0x20
+#define PORT_PMUX(n)   (0x30 + ((n) >> 1))
+#define PORT_PINCFG(n) (0x40 + (n))
+/* PINCFG */
+#define PORT_PINCFG_PMUXEN (1 << 0)
+#define PORT_PINCFG_INEN   (1 << 1)
+#define PORT_PINCFG_PULLEN (1 << 2)
+#define PORT_PINCFG_DRVSTR (1 << 6)
+/* PMUX : even pin into low nibble, odd pin into high nibble */
+#define PORT_PMUX_PMUXE_Pos 0
+#define PORT_PMUX_PMUXE_Msk (0x0F << 0)
+#define PORT_PMUX_PMUXO_Pos 4
+#define PORT_PMUX_PMUXO_Msk (0x0F << 4)
+/* Peripheral functions */
+#define PORT_FUNC_A 0x00
+#define PORT_FUNC_B 0x01
+#define PORT_FUNC_C 0x02
+#define PORT_FUNC_D 0x03
+
+/* -------------------------------------------------------------------------- */
+/* -- WDT (Watchdog Timer)                                                 -- */
+/* -------------------------------------------------------------------------- */
+#define WDT_CTRL     0x00
+#define WDT_CONFIG   0x01
+#define WDT_EWCTRL   0x02
+#define WDT_INTENCLR 0x04
+#define WDT_INTENSET 0x05
+#define WDT_INTFLAG  0x06
+#define WDT_STATUS   0x07
+#define WDT_CLEAR    0x08
+/* CTRL and STATUS */
+#define WDT_CTRL_ENABLE      (1 << 1)
+#define WDT_STATUS_SYNCBUSY  (1 << 7)
+/* CONFIG and EWCTRL : period as 8 << n clock cycles */
+#define WDT_CONFIG_PER_Pos   0
+#define WDT_CONFIG_PER_Msk   (0x0F << 0)
+#define WDT_EWCTRL_EWOFFSET_Pos 0
+#define WDT_EWCTRL_EWOFFSET_Msk (0x0F << 0)
+/* INTFLAG */
+#define WDT_INT_EW           (1 << 0)
+/* CLEAR key */
+#define WDT_CLEAR_KEY        0xA5
+
+/* -------------------------------------------------------------------------- */
+/* -- EIC (External Interrupt Controller)                                  -- */
+/* -------------------------------------------------------------------------- */
+#define EIC_CTRL     0x00
+#define EIC_STATUS   0x01
+#define EIC_EVCTRL   0x04
+#define EIC_INTENCLR 0x08
+#define EIC_INTENSET 0x0C
+#define EIC_INTFLAG  0x10
+#define EIC_WAKEUP   0x14
+#define EIC_CONFIG0  0x18
+/* CTRL and STATUS */
+#define EIC_CTRL_SWRST       (1 << 0)
+#define EIC_CTRL_ENABLE      (1 << 1)
+#define EIC_STATUS_SYNCBUSY  (1 << 7)
+/* CONFIG0 : 4 bits per line (EXTINT0-7), sense and filter */
+#define EIC_CONFIG_SENSE_Pos(n) ((n) * 4)
+#define EIC_CONFIG_FILTEN(n)    (1 << (((n) * 4) + 3))
+#define EIC_SENSE_RISE  1
+#define EIC_SENSE_FALL  2
+#define EIC_SENSE_BOTH  3
+
+/* -------------------------------------------------------------------------- */
+/* -- SERCOM (common registers)                                            -- */
+/* -------------------------------------------------------------------------- */
+#define SERCOM_CTRLA    0x00
+#define SERCOM_CTRLB    0x04
+#define SERCOM_BAUD     0x0C
+#define SERCOM_INTENCLR 0x14
+#define SERCOM_INTENSET 0x16
+#define SERCOM_INTFLAG  0x18
+#define SERCOM_STATUS   0x1A
+#define SERCOM_SYNCBUSY 0x1C
+#define SERCOM_ADDR     0x24
+#define SERCOM_DATA     0x28
+/* CTRLA */
+#define SERCOM_CTRLA_SWRST      (1 << 0)
+#define SERCOM_CTRLA_ENABLE     (1 << 1)
+#define SERCOM_CTRLA_MODE_Pos   2
+#define SERCOM_CTRLA_MODE_Msk   (0x07 << 2)
+#define SERCOM_MODE_USART_INT   0x01
+#define SERCOM_MODE_I2C_MASTER  0x05
+
+/* -- SERCOM in USART mode -- */
+#define SERCOM_USART_CTRLA_TXPO_Pos  16
+#define SERCOM_USART_CTRLA_TXPO_Msk  (0x03 << 16)
+#define SERCOM_USART_CTRLA_RXPO_Pos  20
+#define SERCOM_USART_CTRLA_RXPO_Msk  (0x03 << 20)
+#define SERCOM_USART_CTRLA_FORM_Pos  24
+#define SERCOM_USART_CTRLA_FORM_Msk  (0x0F << 24)
+#define SERCOM_USART_CTRLA_DORD      (1 << 30)
+#define SERCOM_USART_CTRLB_CHSIZE_Pos 0
+#define SERCOM_USART_CTRLB_CHSIZE_Msk (0x07 << 0)
+#define SERCOM_USART_CTRLB_SBMODE    (1 << 6)
+#define SERCOM_USART_CTRLB_TXEN      (1 << 16)
+#define SERCOM_USART_CTRLB_RXEN      (1 << 17)
+#define SERCOM_USART_INT_DRE         (1 << 0)
+#define SERCOM_USART_INT_TXC         (1 << 1)
+#define SERCOM_USART_INT_RXC         (1 << 2)
+#define SERCOM_USART_INT_ERROR       (1 << 7)
+
+/* -- SERCOM in I2C master mode -- */
+#define SERCOM_I2CM_CTRLB_CMD_Pos    16
+#define SERCOM_I2CM_CTRLB_CMD_Msk    (0x03 << 16)
+#define SERCOM_I2CM_CTRLB_ACKACT     (1 << 18)
+#define SERCOM_I2CM_CMD_READ         0x02
+#define SERCOM_I2CM_CMD_STOP         0x03
+#define SERCOM_I2CM_INT_MB           (1 << 0)
+#define SERCOM_I2CM_INT_SB           (1 << 1)
+#define SERCOM_I2CM_INT_ERROR        (1 << 7)
+#define SERCOM_I2CM_STATUS_BUSERR    (1 << 0)
+#define SERCOM_I2CM_STATUS_ARBLOST   (1 << 1)
+#define SERCOM_I2CM_STATUS_RXNACK    (1 << 2)
+
+/* -------------------------------------------------------------------------- */
+/* -- TC (Timer/Counter) in 16 bits mode                                   -- */
+/* -------------------------------------------------------------------------- */
+#define TC_CTRLA     0x00
+#define TC_READREQ   0x02
+#define TC_CTRLBCLR  0x04
+#define TC_CTRLBSET  0x05
+#define TC_INTENCLR  0x0C
+#define TC_INTENSET  0x0D
+#define TC_INTFLAG   0x0E
+#define TC_STATUS    0x0F
+#define TC_COUNT     0x10
+#define TC_CC0       0x18
+/* CTRLA */
+#define TC_CTRLA_SWRST          (1 << 0)
+#define TC_CTRLA_ENABLE         (1 << 1)
+#define TC_CTRLA_MODE_Pos       2
+#define TC_CTRLA_MODE_Msk       (0x03 << 2)
+#define TC_CTRLA_WAVEGEN_Pos    5
+#define TC_CTRLA_WAVEGEN_Msk    (0x03 << 5)
+#define TC_CTRLA_PRESCALER_Pos  8
+#define TC_CTRLA_PRESCALER_Msk  (0x07 << 8)
+#define TC_MODE_COUNT16         0
+#define TC_WAVEGEN_NFRQ         0  /* Normal frequency (top is 0xFFFF) */
+#define TC_WAVEGEN_MFRQ         1  /* Match frequency (top is CC0)     */
+#define TC_PRESC_DIV8           3
+/* READREQ */
+#define TC_READREQ_ADDR_Pos     0
+#define TC_READREQ_ADDR_Msk     (0x1F << 0)
+#define TC_READREQ_RCONT        (1 << 14)
+/* CTRLBSET / CTRLBCLR */
+#define TC_CTRLB_ONESHOT        (1 << 2)
+#define TC_CTRLB_CMD_Pos        6
+#define TC_CTRLB_CMD_Msk        (0x03 << 6)
+#define TC_CMD_RETRIGGER        1
+#define TC_CMD_STOP             2
+/* INTENSET, INTENCLR and INTFLAG */
+#define TC_INT_OVF              (1 << 0)
+#define TC_INT_MC0              (1 << 4)
+/* STATUS */
+#define TC_STATUS_SYNCBUSY      (1 << 7)
+
+#endif
+/* EOF */
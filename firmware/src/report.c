@@ -0,0 +1,188 @@
+/**
+ * @file  report.c
+ * @brief Report-by-exception : deadbands, heartbeat and rate limit
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "nvconf.h"
+#include "report.h"
+
+#if REPORT_RBE
+static int report_moved(int v, int ref, u32 abs, u32 rel);
+
+static int rpt_valid;
+static int rpt_rh;
+static int rpt_temp;
+static u32 rpt_status;
+static u32 rpt_time;
+#endif
+
+/**
+ * @brief Set default report settings (disabled : all samples are sent)
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void report_default(struct report_conf *conf)
+{
+	conf->enable       = 0;
+	conf->min_interval = 0;
+	conf->heartbeat    = 600;
+	conf->rh_abs       = 50;
+	conf->rh_rel       = 0;
+	conf->temp_abs     = 10;
+	conf->temp_rel     = 0;
+	conf->reserved     = 0;
+}
+
+#if REPORT_RBE
+/**
+ * @brief Test if a sample must be sent (and remember it if so)
+ *
+ * @param s Pointer to the last acquired sample
+ * @return integer One if the sample must be sent, zero otherwise
+ */
+int report_check(const struct sample *s)
+{
+	const struct report_conf *conf = &nvconf.report;
+	u32 elapsed;
+	int send;
+
+	if (conf->enable == 0)
+		return(1);
+
+	/* Time since last report (in ms, sample time is in us) */
+	elapsed = (s->time - rpt_time) / 1000;
+
+	if (rpt_valid == 0)
+		send = 1;
+	else if (elapsed < (u32)conf->min_interval * 1000)
+		send = 0;
+	else if (s->status != rpt_status)
+		send = 1;
+	else if (conf->heartbeat && (elapsed >= (u32)conf->heartbeat * 1000))
+		send = 1;
+	else
+	{
+		send = 0;
+		if (((s->status & SAMPLE_ERR_RH) == 0) &&
+		    report_moved(s->rh, rpt_rh, conf->rh_abs, conf->rh_rel))
+			send = 1;
+		if (((s->status & SAMPLE_ERR_TEMP) == 0) &&
+		    report_moved(s->temp, rpt_temp, conf->temp_abs, conf->temp_rel))
+			send = 1;
+	}
+
+	if (send)
+	{
+		rpt_valid  = 1;
+		rpt_rh     = s->rh;
+		rpt_temp   = s->temp;
+		rpt_status = s->status;
+		rpt_time   = s->time;
+	}
+	return(send);
+}
+
+/**
+ * @brief Handler of the "REPORT" command
+ *
+ * REPORT                        Print current settings
+ * REPORT ON|OFF                 Enable report-by-exception (or send all)
+ * REPORT RH|TEMP <abs> <rel>    Set deadbands of a channel
+ * REPORT TIME <min> <heartbeat> Set min interval and max silence (s)
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void report_cmd(int argc, char **argv)
+{
+	struct report_conf *conf = &nvconf.report;
+	int a, b;
+
+	if (argc == 1)
+	{
+		cmd_puts(conf->enable ? "REPORT ON\r\n" : "REPORT OFF\r\n");
+		cmd_puts("REPORT RH");
+		cmd_putint(conf->rh_abs);
+		cmd_putint(conf->rh_rel);
+		cmd_puts("\r\nREPORT TEMP");
+		cmd_putint(conf->temp_abs);
+		cmd_putint(conf->temp_rel);
+		cmd_puts("\r\nREPORT TIME");
+		cmd_putint(conf->min_interval);
+		cmd_putint(conf->heartbeat);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "ON"))
+	{
+		conf->enable = 1;
+		rpt_valid = 0;
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "OFF"))
+		conf->enable = 0;
+	else if (argc == 4)
+	{
+		if (cmd_atoi(argv[2], &a) || cmd_atoi(argv[3], &b))
+			goto err;
+		if ((a < 0) || (b < 0) || (a > 0xFFFF) || (b > 0xFFFF))
+			goto err;
+		if (cmd_match(argv[1], "RH"))
+		{
+			conf->rh_abs = a;
+			conf->rh_rel = b;
+		}
+		else if (cmd_match(argv[1], "TEMP"))
+		{
+			conf->temp_abs = a;
+			conf->temp_rel = b;
+		}
+		else if (cmd_match(argv[1], "TIME"))
+		{
+			if ((a > REPORT_TIME_MAX) || (b > REPORT_TIME_MAX))
+				goto err;
+			conf->min_interval = a;
+			conf->heartbeat    = b;
+		}
+		else
+			goto err;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Test if a value moved out of the deadband around a reference
+ *
+ * @param v   Current value (1/100 unit)
+ * @param ref Reference (last sent) value
+ * @param abs Absolute deadband (1/100 unit, 0 if unused)
+ * @param rel Relative deadband (1/1000 of the reference, 0 if unused)
+ * @return integer One if the value is out of the deadband
+ */
+static int report_moved(int v, int ref, u32 abs, u32 rel)
+{
+	u32 delta, band;
+
+	delta = (v > ref) ? (u32)(v - ref) : (u32)(ref - v);
+	band  = (ref < 0) ? (u32)(-ref) : (u32)ref;
+	band  = (band * rel) / 1000;
+	if (abs > band)
+		band = abs;
+	return(delta > band);
+}
+#endif
+/* EOF */
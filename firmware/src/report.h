@@ -0,0 +1,58 @@
+/**
+ * @file  report.h
+ * @brief Headers and definitions for report-by-exception (deadbands)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef REPORT_H
+#define REPORT_H
+#include "sampler.h"
+#include "types.h"
+
+/* Define to 1 to add report-by-exception (REPORT command) */
+#ifndef REPORT_RBE
+#define REPORT_RBE 0
+#endif
+
+/* Max value of the time parameters (in seconds) */
+#define REPORT_TIME_MAX 3600
+
+/**
+ * Report-by-exception settings. A sample is sent when a value moved out of
+ * the deadband of its channel since the last sent sample, when nothing has
+ * been sent during "heartbeat" seconds, or when error status has changed.
+ * Two reports are never closer than "min_interval" seconds. Absolute
+ * deadbands are in 1/100 unit, relative deadbands in 1/10 % of the last
+ * sent value; when both are set the larger one is used.
+ */
+struct report_conf
+{
+	u16 enable;
+	u16 min_interval; /* Min delay between two reports (s)         */
+	u16 heartbeat;    /* Max delay without report (s, 0 = none)    */
+	u16 rh_abs;       /* Absolute deadband for RH (1/100 %)        */
+	u16 rh_rel;       /* Relative deadband for RH (1/1000)         */
+	u16 temp_abs;     /* Absolute deadband for temp (1/100 deg C)  */
+	u16 temp_rel;     /* Relative deadband for temp (1/1000)       */
+	u16 reserved;
+};
+
+void report_default(struct report_conf *conf);
+#if REPORT_RBE
+int  report_check(const struct sample *s);
+void report_cmd(int argc, char **argv);
+#else
+static inline int report_check(const struct sample *s) { (void)s; return(1); }
+#endif
+
+#endif
+/* EOF */
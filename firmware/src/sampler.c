@@ -0,0 +1,351 @@
+/**
+ * @file  sampler.c
+ * @brief Timer-triggered sampling scheduler (using TC1)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "hardware.h"
+#include "irq.h"
+#include "sampler.h"
+#include "time.h"
+#include "wdt.h"
+
+static u32 smp_period;
+static volatile u32 smp_deadline;
+static volatile u32 smp_ovf;
+/* Last trigger, waiting to be processed */
+static volatile u32 smp_pending;
+static volatile u32 smp_time;
+static u32 smp_phase_max;
+/* Sequence, lost samples and queue are kept over a warm restart */
+static volatile u32 smp_seq NOINIT;
+static volatile u32 smp_overrun NOINIT;
+/* Queue of acquired samples, waiting for output */
+static struct sample smp_queue[SAMPLER_QUEUE] NOINIT;
+static volatile u32 smp_head NOINIT;
+static volatile u32 smp_tail NOINIT;
+
+static inline u32 sampler_time_raw(void);
+
+/**
+ * @brief Initialize the sampler and start the trigger timer
+ *
+ * TC1 is used as a free running 16 bits counter clocked at 1MHz (GCLK0 / 8).
+ * The counter is extended to 32 bits by software (on overflow) and the
+ * compare channel 0 is used to fire the trigger at the exact scheduled time.
+ * The schedule is absolute (deadline += period) so the sampling rate does not
+ * depend on the time needed to process or print a sample. The first trigger
+ * is pending as soon as the sampler is started. With a period of zero, only
+ * the time base is started (triggers come from sampler_ext_init()). After a
+ * warm restart the sequence continues and queued samples are still sent.
+ *
+ * @param period Sampling period in microseconds
+ */
+void sampler_init(u32 period)
+{
+	if ( ! wdt_warm())
+	{
+		smp_seq     = 0;
+		smp_overrun = 0;
+		smp_head    = 0;
+		smp_tail    = 0;
+	}
+	smp_period   = period;
+	smp_deadline = period;
+	smp_ovf      = 0;
+	/* First sample is taken immediately (time 0) */
+	smp_pending  = (period != 0);
+	smp_seq     += smp_pending;
+	smp_time     = 0;
+	smp_phase_max = 0;
+
+	/* Enable TC1 clock (APBCMASK) */
+	reg_set(PM_ADDR + PM_APBCMASK, PM_APBCMASK_TC1);
+	/* Set GCLK for TC1/TC2 (generic clock generator 0) */
+	reg16_wr(GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	         FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_TC1_TC2));
+
+	/* Reset TC (set SWRST) */
+	reg16_wr(SAMPLER_TC + TC_CTRLA, TC_CTRLA_SWRST);
+	/* Wait end of software reset */
+	while (reg16_rd(SAMPLER_TC + TC_CTRLA) & TC_CTRLA_SWRST)
+		;
+	/* Configure TC: 16 bits counter, normal frequency, prescaler DIV8 */
+	reg16_wr(SAMPLER_TC + TC_CTRLA, FIELD(TC_CTRLA_PRESCALER, TC_PRESC_DIV8) |
+	         FIELD(TC_CTRLA_WAVEGEN, TC_WAVEGEN_NFRQ) |
+	         FIELD(TC_CTRLA_MODE, TC_MODE_COUNT16));
+	/* Continuous read synchronization of COUNT */
+	reg16_wr(SAMPLER_TC + TC_READREQ, TC_READREQ_RCONT |
+	         FIELD(TC_READREQ_ADDR, TC_COUNT));
+	/* Set the first deadline into compare channel 0 */
+	reg16_wr(SAMPLER_TC + TC_CC0, (smp_deadline & 0xFFFF));
+	while (reg8_rd(SAMPLER_TC + TC_STATUS) & TC_STATUS_SYNCBUSY)
+		;
+	/* Enable interrupts for MC0 (periodic trigger) and OVF */
+	reg8_wr(SAMPLER_TC + TC_INTENSET, (period ? TC_INT_MC0 : 0) | TC_INT_OVF);
+	/* Enable TC1 interrupt into NVIC */
+	reg_wr(NVIC_ISER, (1 << TC1_IRQn));
+
+	/* Set ENABLE into CTRLA */
+	reg16_wr(SAMPLER_TC + TC_CTRLA, FIELD(TC_CTRLA_PRESCALER, TC_PRESC_DIV8) |
+	         TC_CTRLA_ENABLE);
+	while (reg8_rd(SAMPLER_TC + TC_STATUS) & TC_STATUS_SYNCBUSY)
+		;
+}
+
+#if SAMPLER_EXT
+/**
+ * @brief Start the sampler with an external trigger (EIC)
+ *
+ * A falling edge on the IRQ line of the PMOD connector (pulled up, open
+ * drain master line) starts a sample. TC1 is only the time base : the
+ * handler records the trigger time, the phase of the sample is then the
+ * delay from the trigger to the start of the conversion. The line is
+ * filtered (3 samples of GCLK_EIC, less than 1us).
+ */
+void sampler_ext_init(void)
+{
+	sampler_init(0);
+
+	/* Enable EIC clock (APBAMASK) and set GCLK (generator 0) */
+	reg_set(PM_ADDR + PM_APBAMASK, PM_APBAMASK_EIC);
+	reg16_wr(GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	         FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_EIC));
+
+	/* PA02 : input with pull-up, function A (EXTINT2) */
+	reg_wr(PORT_IOBUS + PORT_DIRCLR, (1 << SAMPLER_EXT_PIN));
+	reg_wr(PORT_IOBUS + PORT_OUTSET, (1 << SAMPLER_EXT_PIN));
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(SAMPLER_EXT_PIN), PORT_PINCFG_PMUXEN |
+	        PORT_PINCFG_INEN | PORT_PINCFG_PULLEN);
+	reg8_wr(PORT_IOBUS + PORT_PMUX(SAMPLER_EXT_PIN),
+	        FIELD(PORT_PMUX_PMUXE, PORT_FUNC_A));
+
+	/* Falling edge with filter, interrupt on this line only */
+	reg_wr(EIC_ADDR + EIC_CONFIG0,
+	       (EIC_SENSE_FALL << EIC_CONFIG_SENSE_Pos(SAMPLER_EXT_LINE)) |
+	       EIC_CONFIG_FILTEN(SAMPLER_EXT_LINE));
+	reg_wr(EIC_ADDR + EIC_INTFLAG,  (1 << SAMPLER_EXT_LINE));
+	reg_wr(EIC_ADDR + EIC_INTENSET, (1 << SAMPLER_EXT_LINE));
+	reg8_wr(EIC_ADDR + EIC_CTRL, EIC_CTRL_ENABLE);
+	while (reg8_rd(EIC_ADDR + EIC_STATUS) & EIC_STATUS_SYNCBUSY)
+		;
+	/* Enable EIC interrupt into NVIC */
+	reg_wr(NVIC_ISER, (1 << EIC_IRQn));
+}
+#endif
+
+/**
+ * @brief Get the current sampler time
+ *
+ * @return u32 Time (in us) since the sampler has been started
+ */
+u32 sampler_time(void)
+{
+	u32 primask;
+	u32 t;
+
+	primask = irq_save();
+	t = sampler_time_raw();
+	irq_restore(primask);
+
+	return(t);
+}
+
+/**
+ * @brief Test if a trigger is waiting to be processed
+ *
+ * @return integer Non-zero if a trigger is pending
+ */
+int sampler_pending(void)
+{
+	return(smp_pending);
+}
+
+/**
+ * @brief Get the pending trigger (if any) and start a new sample
+ *
+ * When a trigger is pending, the sample is initialized with the sequence
+ * number, the scheduled time and the phase error (delay between the
+ * scheduled time and now, when the acquisition is really started).
+ *
+ * @param s Pointer to the sample to initialize
+ * @return integer One if a trigger was pending, zero otherwise
+ */
+int sampler_trigger(struct sample *s)
+{
+	u32 primask;
+
+	if (smp_pending == 0)
+		return(0);
+
+	primask = irq_save();
+	s->seq   = smp_seq;
+	s->time  = smp_time;
+	smp_pending = 0;
+	s->phase = sampler_time_raw() - s->time;
+	irq_restore(primask);
+	if (s->phase > smp_phase_max)
+		smp_phase_max = s->phase;
+
+	s->status = 0;
+	s->rh     = 0;
+	s->temp   = 0;
+	return(1);
+}
+
+/**
+ * @brief Insert an acquired sample into the output queue
+ *
+ * @param s Pointer to the sample to insert (copied)
+ * @return integer Zero on success, -1 if the queue is full (sample dropped)
+ */
+int sampler_push(const struct sample *s)
+{
+	u32 next;
+
+	next = (smp_head + 1) & (SAMPLER_QUEUE - 1);
+	if (next == smp_tail)
+	{
+		smp_overrun++;
+		return(-1);
+	}
+	smp_queue[smp_head] = *s;
+	smp_head = next;
+	return(0);
+}
+
+/**
+ * @brief Extract the oldest sample from the output queue
+ *
+ * @param s Pointer to a sample where the extracted one can be stored
+ * @return integer One if a sample has been extracted, zero if queue empty
+ */
+int sampler_pop(struct sample *s)
+{
+	if (smp_tail == smp_head)
+		return(0);
+	*s = smp_queue[smp_tail];
+	smp_tail = (smp_tail + 1) & (SAMPLER_QUEUE - 1);
+	return(1);
+}
+
+/**
+ * @brief Get the number of lost samples (triggers or queue overflow)
+ *
+ * @return u32 Number of samples lost since startup
+ */
+u32 sampler_overrun(void)
+{
+	return(smp_overrun);
+}
+
+/**
+ * @brief Get the sequence number of the last trigger
+ *
+ * @return u32 Number of triggers since the sampler has been started
+ */
+u32 sampler_seq(void)
+{
+	return(smp_seq);
+}
+
+/**
+ * @brief Get the max delay between a trigger and its acquisition
+ *
+ * @return u32 Max phase (in us) since the sampler has been started
+ */
+u32 sampler_phase_max(void)
+{
+	return(smp_phase_max);
+}
+
+/**
+ * @brief Read the 32 bits sampler time (interrupts must be disabled)
+ *
+ * @return u32 Time (in us) since the sampler has been started
+ */
+static inline u32 sampler_time_raw(void)
+{
+	u32 hi, lo;
+
+	hi = smp_ovf;
+	lo = reg16_rd(SAMPLER_TC + TC_COUNT);
+	/* If an overflow is pending (not yet counted) */
+	if ((reg8_rd(SAMPLER_TC + TC_INTFLAG) & TC_INT_OVF) && (lo < 0x8000))
+		hi++;
+
+	return((hi << 16) | lo);
+}
+
+/**
+ * @brief Interrupt service routine for TC1
+ *
+ */
+void TC1_Handler(void)
+{
+	u32 stamp = irq_stamp();
+	u32 count = reg16_rd(SAMPLER_TC + TC_COUNT);
+	u32 latency = IRQ_LAT_NONE;
+	u32 now;
+
+	/* Counter overflow : update high part of the time */
+	if (reg8_rd(SAMPLER_TC + TC_INTFLAG) & TC_INT_OVF)
+	{
+		reg8_wr(SAMPLER_TC + TC_INTFLAG, TC_INT_OVF);
+		smp_ovf++;
+	}
+	/* Compare match : test if the deadline has really been reached */
+	if (reg8_rd(SAMPLER_TC + TC_INTFLAG) & TC_INT_MC0)
+	{
+		reg8_wr(SAMPLER_TC + TC_INTFLAG, TC_INT_MC0);
+		now = sampler_time_raw();
+		if ((int)(now - smp_deadline) >= 0)
+		{
+			/* Delay from compare match to handler entry (1us = 8 cycles) */
+			latency = ((count - smp_deadline) & 0xFFFF) * (TIME_CYCLES_MS / 1000);
+			/* If previous trigger has not been processed, it is lost */
+			if (smp_pending)
+				smp_overrun++;
+			smp_seq++;
+			smp_time = smp_deadline;
+			smp_pending = 1;
+			/* Schedule next trigger */
+			smp_deadline += smp_period;
+			reg16_wr(SAMPLER_TC + TC_CC0, (smp_deadline & 0xFFFF));
+		}
+	}
+	irq_account(IRQ_ID_SAMPLER, latency, stamp);
+}
+
+#if SAMPLER_EXT
+/**
+ * @brief Interrupt service routine for EIC (external trigger)
+ *
+ * Same priority as TC1, so the extended time can not be updated while it
+ * is read here.
+ */
+void EIC_Handler(void)
+{
+	u32 stamp = irq_stamp();
+	u32 now   = sampler_time_raw();
+
+	reg_wr(EIC_ADDR + EIC_INTFLAG, (1 << SAMPLER_EXT_LINE));
+	/* If previous trigger has not been processed, it is lost */
+	if (smp_pending)
+		smp_overrun++;
+	smp_seq++;
+	smp_time = now;
+	smp_pending = 1;
+	irq_account(IRQ_ID_TRIGGER, IRQ_LAT_NONE, stamp);
+}
+#endif
+/* EOF */
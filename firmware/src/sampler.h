@@ -0,0 +1,67 @@
+/**
+ * @file  sampler.h
+ * @brief Headers and definitions for the timer-triggered sampler
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef SAMPLER_H
+#define SAMPLER_H
+#include "hardware.h"
+#include "types.h"
+
+/* Define to 1 to add the external trigger (ACQ EXT) */
+#ifndef SAMPLER_EXT
+#define SAMPLER_EXT    0
+#endif
+
+#define SAMPLER_TC     TC1_ADDR
+
+/* Default sampling period (in us) */
+#define SAMPLER_PERIOD 1000000
+/* External trigger : PA02 (EXTINT2), IRQ line of the PMOD connector */
+#define SAMPLER_EXT_PIN  2
+#define SAMPLER_EXT_LINE 2
+/* Number of samples that can wait for output (power of 2) */
+#define SAMPLER_QUEUE  16
+
+/* Flags for the status field of a sample */
+#define SAMPLE_ERR_RH   (1 << 0)
+#define SAMPLE_ERR_TEMP (1 << 1)
+/* Threshold alarm state when the sample was taken (ALARM_xx flags) */
+#define SAMPLE_ALARM_Pos 4
+#define SAMPLE_ALARM_Msk (0x0F << 4)
+
+struct sample
+{
+	u32 seq;          /* Sequence number of the trigger                  */
+	u32 time;         /* Scheduled (or external trigger) time (us)       */
+	u32 phase;        /* Delay between trigger and acquisition (us)      */
+	u32 status;       /* Error flags (SAMPLE_ERR_xx)                     */
+	unsigned int rh;  /* Relative humidity (1/100 %)                     */
+	int temp;         /* Temperature (1/100 deg C)                       */
+};
+
+void sampler_init(u32 period);
+#if SAMPLER_EXT
+void sampler_ext_init(void);
+#endif
+u32  sampler_time(void);
+int  sampler_pending(void);
+int  sampler_trigger(struct sample *s);
+int  sampler_push(const struct sample *s);
+int  sampler_pop (struct sample *s);
+u32  sampler_overrun(void);
+u32  sampler_seq(void);
+u32  sampler_phase_max(void);
+
+#endif
+/* EOF */
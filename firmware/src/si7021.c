@@ -13,30 +13,125 @@
  * for more details.
  * This program is distributed WITHOUT ANY WARRANTY.
  */
+#include "calib.h"
+#include "cmd.h"
 #include "i2c.h"
+#include "power.h"
 #include "si7021.h"
+#include "time.h"
 #include "uart.h"
 
-#ifdef SI7021_INFO
+/**
+ * Compatible parts identified by the SNB3 byte of the electronic ID. The
+ * conversion times are the max values of each datasheet (12 bits RH and
+ * 14 bits temperature, the power-on resolution).
+ */
+static const struct si7021_variant si7021_variants[] = {
+	{ 0x0D, SI7021_F_SI70XX, 23, 11, 16, "SI7013" },
+	{ 0x14, SI7021_F_SI70XX, 23, 11, 16, "SI7020" },
+	{ 0x15, SI7021_F_SI70XX, 23, 11, 16, "SI7021" },
+	/* Engineering samples (0x00, 0xFF) and unknown SNB3 values */
+	{ 0x00, SI7021_F_ID | SI7021_F_TEMP_LAST, 23, 11, 0, "SI70XX-ES" },
+};
+#define SI7021_VARIANTS (sizeof(si7021_variants) / sizeof(si7021_variants[0]))
+
+/* Part without electronic ID (HTU21D, SHT21) : heater bit only, slower */
+static const struct si7021_variant si7021_generic = {
+	0x00, 0, 29, 85, 1, "HTU21"
+};
+
+static const struct si7021_variant *si7021_var = &si7021_generic;
+#if SI7021_CMD
+static u8 si7021_fw;
+static u8 si7021_htr;
+#endif
+/* End of the last conversion, when the sensor acknowledged the read */
+static u32 si7021_end;
+
+#if SI7021_INFO
 static int si7021_errno;
 
 static const char err_null[]    = "";
 static const char err_start[]   = "Error during I2C START";
 static const char err_restart[] = "Error during I2C repeated START";
 static const char err_cmd[]     = "Error when sending command";
+static const char err_support[] = "Not supported by the sensor";
 #endif
 
+static int  si7021_id(unsigned char *id);
+static int  si7021_measure(unsigned char cmd, uint wait, unsigned int *code);
+static void si7021_sleep(uint ms);
+static int  si7021_xfer(const unsigned char *cmd, uint cmd_len,
+                        unsigned char *data, uint len);
+
 /**
- * @brief Initialize the si7021 driver
+ * @brief Initialize the si7021 driver and detect the sensor variant
  *
+ * The variant selects the conversion times and the supported commands. A
+ * sensor that does not answer the electronic ID is handled as a generic
+ * compatible part (only the basic measurement commands are used).
  */
 void si7021_init(void)
 {
-#ifdef SI7021_INFO
+	unsigned char id[8];
+#if SI7021_CMD
+	unsigned char cmd[2];
+#endif
+	uint i;
+
+#if SI7021_INFO
 	si7021_errno = 0;
+#endif
+	si7021_var = &si7021_generic;
+#if SI7021_CMD
+	si7021_fw  = 0;
+	si7021_htr = 0;
+#endif
+
+	if (si7021_id(id))
+		return;
+	/* Search the model (SNB3), the last entry is the default */
+	for (i = 0; i < (SI7021_VARIANTS - 1); i++)
+	{
+		if (si7021_variants[i].snb3 == id[4])
+			break;
+	}
+	si7021_var = &si7021_variants[i];
+
+#if SI7021_CMD
+	/* Firmware revision : 0xFF for 1.0, 0x20 for 2.0 */
+	if (si7021_var->features & SI7021_F_FWREV)
+	{
+		cmd[0] = 0x84;
+		cmd[1] = 0xB8;
+		si7021_xfer(cmd, 2, &si7021_fw, 1);
+	}
 #endif
 }
 
+/**
+ * @brief Get the detected sensor variant
+ *
+ * @return struct* Pointer to the variant (conversion times, features)
+ */
+const struct si7021_variant *si7021_variant(void)
+{
+	return(si7021_var);
+}
+
+/**
+ * @brief Get the time of the end of the last conversion
+ *
+ * The sensor does not acknowledge a read until the end of its conversion,
+ * this is the start of the first read that succeeded (polled each ms).
+ *
+ * @return u32 Time of the end of conversion (time_cycles)
+ */
+u32 si7021_done(void)
+{
+	return(si7021_end);
+}
+
 /**
  * @brief Get an error message (string) for last or specified error code
  *
@@ -45,7 +140,7 @@ void si7021_init(void)
  */
 const char *si7021_strerror(int error)
 {
-#ifdef SI7021_INFO
+#if SI7021_INFO
 	int ecode;
 
 	ecode = (error == 0) ? si7021_errno : error;
@@ -54,10 +149,12 @@ const char *si7021_strerror(int error)
 		case -2: return(err_start);
 		case -3: return(err_restart);
 		case -4: return(err_cmd);
+		case -5: return(err_support);
 		default: return(err_null);
 	}
 #else
-	return(0);
+	(void)error;
+	return("");
 #endif
 }
 
@@ -69,75 +166,17 @@ const char *si7021_strerror(int error)
  */
 int si7021_read_id(unsigned char *id)
 {
-	unsigned char tab[8];
-	int i;
-#ifdef SI7021_INFO
+#if SI7021_INFO
 	si7021_errno = 0;
 #else
 	int si7021_errno;
 #endif
 
-	if (i2c_start(0x40, I2C_WR))
-		goto err_start;
-	/* Send command : Read ID #1 */
-	if (i2c_write(0xFA))
-		goto err_cmd;
-	if (i2c_write(0x0F))
-		goto err_cmd;
-	/* Repeated start to start a read sequence */
-	if (i2c_start(0x40, I2C_RD))
-		goto err_restart;
-	for (i = 0; i < 7; i++)
-		i2c_read(&tab[i], 1);
-	i2c_read(&tab[7], 0);
-	/* End of transaction */
-	i2c_stop();
-
-	/* Copy SNAx values into result */
-	if (id)
-	{
-		*id++ = tab[0]; /* SNA3 */
-		*id++ = tab[2]; /* SNA2 */
-		*id++ = tab[4]; /* SNA1 */
-		*id++ = tab[6]; /* SNA0 */
-	}
-
-	if (i2c_start(0x40, I2C_WR))
-		goto err_start;
-	/* Send command : Read ID #2 */
-	if (i2c_write(0xFC))
-		goto err_cmd;
-	if (i2c_write(0xC9))
-		goto err_cmd;
-	/* Repeated start to start a read sequence */
-	if (i2c_start(0x40, I2C_RD))
-		goto err_restart;
-	for (i = 0; i < 5; i++)
-		i2c_read(&tab[i], 1);
-	i2c_read(&tab[5], 0);
-	/* End of transaction */
-	i2c_stop();
-
-	/* Copy SNBx values into result */
-	if (id)
-	{
-		*id++ = tab[0]; /* SMB3 (model) */
-		*id++ = tab[1]; /* SNB2 */
-		*id++ = tab[3]; /* SNB1 */
-		*id++ = tab[4]; /* SNB0 */
-	}
-	
-	return(0);
+	if ( ! (si7021_var->features & SI7021_F_ID))
+		si7021_errno = -5;
+	else
+		si7021_errno = si7021_id(id);
 
-err_start:
-	si7021_errno = -2;
-	goto err;
-err_restart:
-	si7021_errno = -3;
-	goto err;
-err_cmd:
-	si7021_errno = -4;
-err:
 	return(si7021_errno);
 }
 
@@ -148,7 +187,7 @@ err:
  */
 int si7021_reset(void)
 {
-#ifdef SI7021_INFO
+#if SI7021_INFO
 	si7021_errno = 0;
 #else
 	int si7021_errno;
@@ -176,56 +215,29 @@ err:
 /**
  * @brief Read the current relative humidity from si7021
  *
- * @param temp Pointer to a variable where readed humidity can be stored
+ * The temperature is converted too (Si70xx), it can be read after with
+ * si7021_temp_last().
+ *
+ * @param rh Pointer to a variable where readed humidity can be stored
  * @return integer Zero is returned on success, other values are errors
  */
 int si7021_rh(unsigned int *rh)
 {
-	unsigned char b;
 	unsigned int rh_code;
-	unsigned int result;
-
-#ifdef SI7021_INFO
+#if SI7021_INFO
 	si7021_errno = 0;
 #else
 	int si7021_errno;
 #endif
 
-	if (i2c_start(0x40, I2C_WR))
-		goto err_start;
-	/* Send command : read relative humidity */
-	if (i2c_write(0xE5))
-		goto err_cmd;
-	/* Repeated start to start a read sequence */
-	if (i2c_start(0x40, I2C_RD))
-		goto err_restart;
-	/* Read MS byte */
-	i2c_read(&b, 1);
-	rh_code = (b << 8);
-	/* Read LS byte */
-	i2c_read(&b, 0);
-	rh_code |= b;
-	/* End of transaction */
-	i2c_stop();
+	/* Measure relative humidity, no hold master mode */
+	si7021_errno = si7021_measure(0xF5, si7021_var->conv_rh, &rh_code);
+	if (si7021_errno)
+		return(si7021_errno);
 
-	/* Decode RH value */
-	result = (12500 * rh_code);
-	result = (result / 65536);
-	result = result - 6;
 	if (rh)
-		*rh = result;
+		*rh = si7021_rh_decode(rh_code);
 	return(0);
-
-err_start:
-	si7021_errno = -2;
-	goto err;
-err_restart:
-	si7021_errno = -3;
-	goto err;
-err_cmd:
-	si7021_errno = -4;
-err:
-	return(si7021_errno);
 }
 
 /**
@@ -236,109 +248,308 @@ err:
  */
 int si7021_temp(int *temp)
 {
-	unsigned char b;
 	unsigned int temp_code;
-	int result;
-
-#ifdef SI7021_INFO
+#if SI7021_INFO
 	si7021_errno = 0;
 #else
 	int si7021_errno;
 #endif
 
-	if (i2c_start(0x40, I2C_WR))
-		goto err_start;
-	/* Send command : read temperature */
-	if (i2c_write(0xE3))
-		goto err_cmd;
-	/* Repeated start to start a read sequence */
-	if (i2c_start(0x40, I2C_RD))
-		goto err_restart;
-	/* Read MS byte */
-	i2c_read(&b, 1);
-	temp_code = (b << 8);
-	/* Read LS byte */
-	i2c_read(&b, 0);
-	temp_code |= b;
-
-	i2c_stop();
+	/* Measure temperature, no hold master mode */
+	si7021_errno = si7021_measure(0xF3, si7021_var->conv_temp, &temp_code);
+	if (si7021_errno)
+		return(si7021_errno);
 
-	/* Compute temperature value */
-	result = (17572 * temp_code);
-	result = (result / 65536);
-	result = result - 4685;
-	/* If caller want the result, copy it */
+	/* If caller want the result, decode it (and apply calibration) */
 	if (temp)
-		*temp = result;
-
+		*temp = si7021_temp_decode(temp_code);
 	return(0);
-
-err_start:
-	si7021_errno = -2;
-	goto err;
-err_restart:
-	si7021_errno = -3;
-	goto err;
-err_cmd:
-	si7021_errno = -4;
-err:
-	return(si7021_errno);
 }
 
 /**
  * @brief Get the temperature captured during last humidity measurement
  *
+ * Parts without this command (generic) start a temperature conversion.
+ *
  * @param temp Pointer to a variable where readed temperature can be stored
  * @return integer Zero is returned on success, other values are errors
  */
 int si7021_temp_last(int *temp)
 {
-	unsigned char b;
-	unsigned int  temp_code;
-	int result;
-
-#ifdef SI7021_INFO
+	unsigned char cmd;
+	unsigned char b[2];
+#if SI7021_INFO
 	si7021_errno = 0;
 #else
 	int si7021_errno;
 #endif
 
-	if (i2c_start(0x40, I2C_WR))
-		goto err_start;
-	/* Send command : read temperature of previous RH measure */
-	if (i2c_write(0xE0))
-		goto err_cmd;
-	/* Repeated start to start a read sequence */
-	if (i2c_start(0x40, I2C_RD))
-		goto err_restart;
-	/* Read MS byte */
-	i2c_read(&b, 1);
-	temp_code = (b << 8);
-	/* Read LS byte */
-	i2c_read(&b, 0);
-	temp_code |= b;
+	if ( ! (si7021_var->features & SI7021_F_TEMP_LAST))
+		return(si7021_temp(temp));
 
-	i2c_stop();
+	/* Read temperature of previous RH measure (no conversion) */
+	cmd = 0xE0;
+	si7021_errno = si7021_xfer(&cmd, 1, b, 2);
+	if (si7021_errno)
+		return(si7021_errno);
 
-	/* Decode temperature value */
-	result = (17572 * temp_code);
-	result = (result / 65536);
-	result = result - 4685;
-	/* If caller want the result, copy it */
+	/* If caller want the result, decode it (and apply calibration) */
 	if (temp)
-		*temp = result;
+		*temp = si7021_temp_decode((b[0] << 8) | b[1]);
+	return(0);
+}
 
+#if SI7021_CMD
+/**
+ * @brief Set the internal heater (used to dry the sensor)
+ *
+ * Level 0 disables the heater. Si70xx parts have 16 currents (3mA to 94mA)
+ * selected by levels 1 to 16, generic parts only have one (level 1).
+ *
+ * @param level Heater level, from 0 to the max level of the variant
+ * @return integer Zero is returned on success, other values are errors
+ */
+int si7021_heater(uint level)
+{
+	unsigned char cmd[2];
+	unsigned char user;
+#if SI7021_INFO
+	si7021_errno = 0;
+#else
+	int si7021_errno;
+#endif
+
+	if (level > si7021_var->heater_max)
+	{
+		si7021_errno = -5;
+		return(si7021_errno);
+	}
+	/* Write heater current (HEATER register) */
+	if (level && (si7021_var->features & SI7021_F_HEATER))
+	{
+		cmd[0] = 0x51;
+		cmd[1] = (level - 1);
+		si7021_errno = si7021_xfer(cmd, 2, 0, 0);
+		if (si7021_errno)
+			return(si7021_errno);
+	}
+	/* Read-modify-write of user register 1 (HTRE bit) */
+	cmd[0] = 0xE7;
+	si7021_errno = si7021_xfer(cmd, 1, &user, 1);
+	if (si7021_errno)
+		return(si7021_errno);
+	cmd[0] = 0xE6;
+	cmd[1] = level ? (user | 0x04) : (user & ~0x04);
+	si7021_errno = si7021_xfer(cmd, 2, 0, 0);
+	if (si7021_errno)
+		return(si7021_errno);
+
+	si7021_htr = level;
 	return(0);
+}
 
-err_start:
-	si7021_errno = -2;
-	goto err;
-err_restart:
-	si7021_errno = -3;
-	goto err;
-err_cmd:
-	si7021_errno = -4;
+/**
+ * @brief Handler of the SENSOR command
+ *
+ * SENSOR              Detected variant, firmware revision and heater level
+ * SENSOR HEATER <n>   Set the heater level (0 to disable, not saved)
+ *
+ * @param argc Number of arguments
+ * @param argv Array of arguments
+ */
+void si7021_cmd(int argc, char **argv)
+{
+	int level;
+
+	if (argc == 1)
+	{
+		cmd_puts("SENSOR ");
+		cmd_puts(si7021_var->name);
+		cmd_putint(si7021_fw);
+		cmd_puts("\r\nSENSOR HEATER");
+		cmd_putint(si7021_htr);
+		cmd_putint(si7021_var->heater_max);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 3) && cmd_match(argv[1], "HEATER"))
+	{
+		if (cmd_atoi(argv[2], &level) || (level < 0))
+			goto err;
+		if (si7021_heater(level))
+			goto err;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
 err:
-	return(si7021_errno);
+	cmd_error();
+}
+#endif
+
+/**
+ * @brief Convert a raw humidity code into calibrated humidity
+ *
+ * @param code Value read from the sensor (16 bits, MSB first)
+ * @return integer Relative humidity (1/100 %)
+ */
+unsigned int si7021_rh_decode(unsigned int code)
+{
+	return(calib_rh(si7021_rh_raw(code)));
+}
+
+/**
+ * @brief Convert a raw temperature code into calibrated temperature
+ *
+ * @param code Value read from the sensor (16 bits, MSB first)
+ * @return integer Temperature (1/100 deg C)
+ */
+int si7021_temp_decode(unsigned int code)
+{
+	return(calib_temp(si7021_temp_raw(code)));
+}
+
+/**
+ * @brief Read the electronic ID, without testing the variant
+ *
+ * @param id Pointer to an array where readed ID can be stored (8 bytes)
+ * @return integer On success zero is returned, other values are errors
+ */
+static int si7021_id(unsigned char *id)
+{
+	unsigned char cmd[2];
+	unsigned char tab[8];
+	int err;
+
+	/* Send command : Read ID #1 */
+	cmd[0] = 0xFA;
+	cmd[1] = 0x0F;
+	err = si7021_xfer(cmd, 2, tab, 8);
+	if (err)
+		return(err);
+
+	/* Copy SNAx values into result */
+	if (id)
+	{
+		*id++ = tab[0]; /* SNA3 */
+		*id++ = tab[2]; /* SNA2 */
+		*id++ = tab[4]; /* SNA1 */
+		*id++ = tab[6]; /* SNA0 */
+	}
+
+	/* Send command : Read ID #2 */
+	cmd[0] = 0xFC;
+	cmd[1] = 0xC9;
+	err = si7021_xfer(cmd, 2, tab, 6);
+	if (err)
+		return(err);
+
+	/* Copy SNBx values into result */
+	if (id)
+	{
+		*id++ = tab[0]; /* SMB3 (model) */
+		*id++ = tab[1]; /* SNB2 */
+		*id++ = tab[3]; /* SNB1 */
+		*id++ = tab[4]; /* SNB0 */
+	}
+	return(0);
+}
+
+/**
+ * @brief Start a conversion (no hold master) and read the result
+ *
+ * The CPU sleeps during the conversion time of the detected variant, then
+ * the result is read. The sensor does not acknowledge its address until
+ * the end of conversion, the read is retried each millisecond.
+ *
+ * @param cmd  Measure command (no hold master mode)
+ * @param wait Conversion time (ms)
+ * @param code Pointer to a variable where the raw result can be stored
+ * @return integer Zero is returned on success, other values are errors
+ */
+static int si7021_measure(unsigned char cmd, uint wait, unsigned int *code)
+{
+	unsigned char b[2];
+	uint retry;
+	u32 t0;
+	int err;
+
+	err = si7021_xfer(&cmd, 1, 0, 0);
+	if (err)
+		return(err);
+
+	si7021_sleep(wait);
+	for (retry = 0; ; retry++)
+	{
+		t0 = time_cycles();
+		if (si7021_xfer(0, 0, b, 2) == 0)
+			break;
+		if (retry == SI7021_RETRY)
+			return(-3);
+		si7021_sleep(1);
+	}
+	si7021_end = t0;
+	*code = (b[0] << 8) | b[1];
+	return(0);
+}
+
+/**
+ * @brief Sleep (WFI) during a number of milliseconds
+ *
+ * The SysTick wakes the CPU each millisecond. The current tick is already
+ * started, so the wait is at least "ms" and up to "ms + 1".
+ *
+ * @param ms Number of milliseconds to wait
+ */
+static void si7021_sleep(uint ms)
+{
+	u32 ref;
+	uint state;
+
+	ref = time_now();
+	state = power_enter(POWER_IDLE);
+	while (time_since(ref) <= ms)
+		asm volatile("wfi");
+	power_enter(state);
+}
+
+/**
+ * @brief Send a command and read the answer (one I2C transaction)
+ *
+ * @param cmd     Pointer to the command bytes (may be NULL)
+ * @param cmd_len Number of command bytes, 0 for a read only transaction
+ * @param data    Pointer to a buffer where readed bytes can be stored
+ * @param len     Number of bytes to read, 0 for a write only transaction
+ * @return integer Zero is returned on success, other values are errors
+ */
+static int si7021_xfer(const unsigned char *cmd, uint cmd_len,
+                       unsigned char *data, uint len)
+{
+	uint i;
+
+	if (cmd_len)
+	{
+		if (i2c_start(0x40, I2C_WR))
+			return(-2);
+		for (i = 0; i < cmd_len; i++)
+		{
+			if (i2c_write(cmd[i]))
+				return(-4);
+		}
+		if (len == 0)
+		{
+			/* End of transaction */
+			i2c_stop();
+			return(0);
+		}
+	}
+	/* Repeated start (or start) of a read sequence */
+	if (i2c_start(0x40, I2C_RD))
+		return(cmd_len ? -3 : -2);
+	for (i = 0; i < len; i++)
+		i2c_read(&data[i], (i + 1) < len);
+	/* End of transaction */
+	i2c_stop();
+	return(0);
 }
 /* EOF */
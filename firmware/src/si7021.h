@@ -17,14 +17,74 @@
 #define SI7021_H
 #include "types.h"
 
-#define SI7021_INFO
+/* Define to 1 to add the error messages of the driver */
+#ifndef SI7021_INFO
+#define SI7021_INFO 0
+#endif
+/* Define to 1 to add the SENSOR command (variant and heater) */
+#ifndef SI7021_CMD
+#define SI7021_CMD 0
+#endif
+
+/* Features of a sensor variant (commands that can be used) */
+#define SI7021_F_ID        (1 << 0) /* Electronic ID (serial number)          */
+#define SI7021_F_TEMP_LAST (1 << 1) /* Temperature of the last RH conversion  */
+#define SI7021_F_HEATER    (1 << 2) /* Heater current register (16 levels)    */
+#define SI7021_F_FWREV     (1 << 3) /* Firmware revision                      */
+#define SI7021_F_SI70XX    (SI7021_F_ID | SI7021_F_TEMP_LAST | \
+                            SI7021_F_HEATER | SI7021_F_FWREV)
+
+/* Number of 1ms retries when a result is not ready after conversion time */
+#define SI7021_RETRY 4
+
+struct si7021_variant
+{
+	u8 snb3;        /* Model, from the electronic ID (SNB3)         */
+	u8 features;    /* Supported commands (SI7021_F_xx)             */
+	u8 conv_rh;     /* Max conversion time of RH (+ temp) in ms     */
+	u8 conv_temp;   /* Max conversion time of temperature in ms     */
+	u8 heater_max;  /* Highest heater level, 0 if no heater         */
+	const char *name;
+};
 
 const char *si7021_strerror(int error);
 void  si7021_init(void);
+const struct si7021_variant *si7021_variant(void);
+u32   si7021_done(void);
 int   si7021_read_id(unsigned char *id);
 int   si7021_reset(void);
 int   si7021_rh(unsigned int *temp);
 int   si7021_temp(int *temp);
 int   si7021_temp_last(int *temp);
+#if SI7021_CMD
+int   si7021_heater(uint level);
+void  si7021_cmd(int argc, char **argv);
+#endif
+unsigned int si7021_rh_decode(unsigned int code);
+int   si7021_temp_decode(unsigned int code);
+
+/**
+ * @brief Convert a raw humidity code, without calibration
+ *
+ * @param code Value read from the sensor (16 bits, MSB first)
+ * @return integer Relative humidity (1/100 %, -600 to 11899)
+ */
+static inline int si7021_rh_raw(unsigned int code)
+{
+	/* RH = 125 * code / 65536 - 6 */
+	return((int)((12500 * code) / 65536) - 600);
+}
+
+/**
+ * @brief Convert a raw temperature code, without calibration
+ *
+ * @param code Value read from the sensor (16 bits, MSB first)
+ * @return integer Temperature (1/100 deg C, -4685 to 12886)
+ */
+static inline int si7021_temp_raw(unsigned int code)
+{
+	/* T = 175.72 * code / 65536 - 46.85 */
+	return((int)((17572 * code) / 65536) - 4685);
+}
 
 #endif
@@ -0,0 +1,103 @@
+/**
+ * @file  stack.c
+ * @brief Stack high-water mark and RAM usage report
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "stack.h"
+
+#if STACK_CMD
+/* Symbols defined by linker script */
+extern u32 __data_start__;
+extern u32 __data_end__;
+extern u32 __ramfunc_start__;
+extern u32 __ramfunc_end__;
+extern u32 __noinit_start__;
+extern u32 __noinit_end__;
+extern u32 _sbss;
+extern u32 _ebss;
+extern u32 __StackLimit;
+extern u32 __StackTop;
+
+/**
+ * @brief Get the size of the stack
+ *
+ * All RAM not used by .data and .bss is available for the stack.
+ *
+ * @return u32 Size of the stack (in bytes)
+ */
+u32 stack_size(void)
+{
+	return((u32)&__StackTop - (u32)&__StackLimit);
+}
+
+/**
+ * @brief Get the max stack usage since reset (high-water mark)
+ *
+ * The stack is painted by Reset_Handler, the lowest word that does not
+ * contain the pattern anymore gives the deepest stack position reached.
+ *
+ * @return u32 Max number of bytes used into stack
+ */
+u32 stack_peak(void)
+{
+	u32 *p;
+
+	for (p = &__StackLimit; p < &__StackTop; p++)
+	{
+		if (*p != STACK_PAINT)
+			break;
+	}
+	return((u32)&__StackTop - (u32)p);
+}
+
+/**
+ * @brief Handler of the "MEM" command
+ *
+ * MEM   Print static RAM usage (code into RAM is part of data, state kept
+ *       over a warm restart) and stack (size, peak usage, free)
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void stack_cmd(int argc, char **argv)
+{
+	u32 size, peak;
+
+	(void)argv;
+
+	if (argc != 1)
+	{
+		cmd_error();
+		return;
+	}
+	size = stack_size();
+	peak = stack_peak();
+
+	cmd_puts("MEM DATA");
+	cmd_putint((u32)&__data_end__ - (u32)&__data_start__);
+	cmd_puts(" BSS");
+	cmd_putint((u32)&_ebss - (u32)&_sbss);
+	cmd_puts(" RAMFUNC");
+	cmd_putint((u32)&__ramfunc_end__ - (u32)&__ramfunc_start__);
+	cmd_puts(" NOINIT");
+	cmd_putint((u32)&__noinit_end__ - (u32)&__noinit_start__);
+	cmd_puts("\r\nMEM STACK");
+	cmd_putint(size);
+	cmd_putint(peak);
+	cmd_putint(size - peak);
+	cmd_puts("\r\n");
+	cmd_ok();
+}
+#endif
+/* EOF */
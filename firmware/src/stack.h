@@ -0,0 +1,35 @@
+/**
+ * @file  stack.h
+ * @brief Headers and definitions for stack and RAM usage
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef STACK_H
+#define STACK_H
+#include "types.h"
+
+/* Define to 1 to add the RAM usage report (MEM command) */
+#ifndef STACK_CMD
+#define STACK_CMD   0
+#endif
+
+/* Pattern written into unused stack at startup (must match startup.s) */
+#define STACK_PAINT 0xC5C5C5C5
+
+#if STACK_CMD
+u32  stack_size(void);
+u32  stack_peak(void);
+void stack_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
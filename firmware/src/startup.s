@@ -3,7 +3,7 @@
  * @brief Processor vector table and interrupts handlers (including reset)
  *
  * @author Saint-Genest Gwenael <gwen@cowlab.fr>
- * @copyright Cowlab (c) 2017
+ * @copyright Cowlab (c) 2017-2022
  *
  * @page License
  * This license is free software: you can redistribute it and/or modify it
@@ -17,17 +17,8 @@
     .syntax unified
     .arch armv6-m
 
-/* -- Stack and Head sections ---------------------------------------------- */
-    .section .stack
-    .align 3
-    .equ    Stack_Size, 0x100
-    .globl    __StackTop
-    .globl    __StackLimit
-__StackLimit:
-    .space    Stack_Size
-    .size __StackLimit, . - __StackLimit
-__StackTop:
-    .size __StackTop, . - __StackTop
+    /* Pattern used to fill unused stack (see stack.h) */
+    .equ    STACK_PAINT, 0xC5C5C5C5
 
 /* -- Vector Table --------------------------------------------------------- */
 
@@ -75,7 +66,15 @@ __isr_vector:
     .size    __isr_vector, . - __isr_vector
 
 /**
+ * @brief Reset handler, prepare the C runtime then call main
  *
+ * The CPU clock is switched to 8MHz (OSC8M prescaler) before anything else,
+ * then SysTick is started as a free running counter to measure the boot time
+ * (see time_init). Sections .data and .bss are word aligned by the linker
+ * script, they are initialized 16 bytes (4 words) per iteration. The code
+ * executed from RAM (.ramfunc) is at the beginning of .data, it is copied
+ * before any C function is called (division helpers are used early). The free
+ * stack space is filled with a pattern to measure the max stack usage.
  */
     .text
     .thumb
@@ -84,8 +83,149 @@ __isr_vector:
     .globl    Reset_Handler
     .type    Reset_Handler, %function
 Reset_Handler:
+    /* OSC8M: clear prescaler (8MHz) and OnDemand flag */
+    ldr   r0, =0x40000820
+    ldr   r1, [r0]
+    ldr   r2, =0xFFFFFC3F
+    ands  r1, r2
+    str   r1, [r0]
+    /* Start SysTick, full 24 bits range, no interrupt */
+    ldr   r0, =0xE000E010
+    ldr   r1, =0x00FFFFFF
+    str   r1, [r0, #4]
+    movs  r1, #0
+    str   r1, [r0, #8]
+    movs  r1, #5
+    str   r1, [r0, #0]
+
+    /* Copy .data (and .ramfunc) from flash to RAM */
+    ldr   r0, =__data_load__
+    ldr   r1, =__data_start__
+    ldr   r2, =__data_end__
+    subs  r3, r2, r1
+data_copy16:
+    subs  r3, #16
+    bmi   data_copy4
+    ldmia r0!, {r4-r7}
+    stmia r1!, {r4-r7}
+    b     data_copy16
+data_copy4:
+    adds  r3, #16
+data_copy4_loop:
+    subs  r3, #4
+    bmi   data_end
+    ldmia r0!, {r4}
+    stmia r1!, {r4}
+    b     data_copy4_loop
+data_end:
+
+    /* Clear .bss */
+    ldr   r1, =_sbss
+    ldr   r2, =_ebss
+    subs  r3, r2, r1
+    movs  r4, #0
+    movs  r5, #0
+    movs  r6, #0
+    movs  r7, #0
+bss_zero16:
+    subs  r3, #16
+    bmi   bss_zero4
+    stmia r1!, {r4-r7}
+    b     bss_zero16
+bss_zero4:
+    adds  r3, #16
+bss_zero4_loop:
+    subs  r3, #4
+    bmi   bss_end
+    stmia r1!, {r4}
+    b     bss_zero4_loop
+bss_end:
+
+    /* Paint the stack (from end of .bss to current SP) */
+    ldr   r1, =__StackLimit
+    mov   r2, sp
+    subs  r3, r2, r1
+    ldr   r4, =STACK_PAINT
+    movs  r5, r4
+    movs  r6, r4
+    movs  r7, r4
+stack_paint16:
+    subs  r3, #16
+    bmi   stack_paint4
+    stmia r1!, {r4-r7}
+    b     stack_paint16
+stack_paint4:
+    adds  r3, #16
+stack_paint4_loop:
+    subs  r3, #4
+    bmi   stack_end
+    stmia r1!, {r4}
+    b     stack_paint4_loop
+stack_end:
+
+    /* Call static constructors (preinit_array then init_array) */
+    ldr   r4, =__preinit_array_start
+    ldr   r5, =__preinit_array_end
+    bl    call_array
+    ldr   r4, =__init_array_start
+    ldr   r5, =__init_array_end
+    bl    call_array
+
     /* Call C code entry ("main" function) */
-    bl  main
+    bl    main
+    /* Main should never return */
+    b     .
+    .size    Reset_Handler, . - Reset_Handler
+
+/**
+ * @brief Call all functions of an array of pointers (from r4 to r5)
+ *
+ */
+    .thumb_func
+    .type    call_array, %function
+call_array:
+    push  {lr}
+call_array_loop:
+    cmp   r4, r5
+    bhs   call_array_end
+    ldr   r0, [r4]
+    adds  r4, #4
+    blx   r0
+    b     call_array_loop
+call_array_end:
+    pop   {pc}
+    .size    call_array, . - call_array
+    .ltorg
+
+/**
+ * @brief Watchdog early warning and hard fault : restart with the address
+ *        of the stalled (or faulty) code, see wdt_fault() into wdt.c
+ *
+ * The stacked PC of the exception frame (on MSP) is the second argument,
+ * the first one is the reason (WDT_RESET_WDT or WDT_RESET_FAULT).
+ */
+    .section .text.WDT_Handler,"ax",%progbits
+    .thumb
+    .thumb_func
+    .align 1
+    .globl    WDT_Handler
+    .type    WDT_Handler, %function
+WDT_Handler:
+    movs  r0, #3
+    b     fault_entry
+    .size    WDT_Handler, . - WDT_Handler
+
+    .thumb_func
+    .align 1
+    .globl    HardFault_Handler
+    .type    HardFault_Handler, %function
+HardFault_Handler:
+    movs  r0, #4
+fault_entry:
+    mrs   r1, msp
+    ldr   r1, [r1, #24]
+    bl    wdt_fault
+    .size    HardFault_Handler, . - HardFault_Handler
 
 /**
  * @brief Default handler is an infinite loop for all unsupported events
@@ -109,14 +249,12 @@ Infinite_Loop:
 
     /* Default handlers for Cortex M0 internal blocks */
     def_default_handler    NMI_Handler
-    def_default_handler    HardFault_Handler
     def_default_handler    SVC_Handler
     def_default_handler    PendSV_Handler
     def_default_handler    SysTick_Handler
     /* Default handlers for SAMD09 peripherals */
     def_default_handler    PM_Handler
     def_default_handler    SYSCTRL_Handler
-    def_default_handler    WDT_Handler
     def_default_handler    RTC_Handler
     def_default_handler    EIC_Handler
     def_default_handler    NVMCTRL_Handler
@@ -0,0 +1,312 @@
+/**
+ * @file  stats.c
+ * @brief Windowed statistics (min, max, mean, variance) of samples
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "fixmath.h"
+#include "format.h"
+#include "nvconf.h"
+#include "stats.h"
+
+#if STATS_WINDOW
+static void stats_update(struct stats_acc *c, int x);
+static void stats_result(const struct stats_acc *c, struct stats_result *r);
+static void stats_close(void);
+static u32  stats_div(u32 hi, u32 lo, u32 den);
+static int  stats_round(int num, u32 den);
+
+static struct stats_acc stats_rh;
+static struct stats_acc stats_temp;
+static struct stats_summary stats_sum;
+/* Window of the accumulated samples */
+static u32 stats_win;
+static u32 stats_count;
+static u32 stats_errors;
+static u32 stats_seq;
+static u32 stats_time;
+#endif
+
+/**
+ * @brief Set default statistics settings (disabled : all samples sent)
+ *
+ * @param conf Pointer to the settings to initialize
+ */
+void stats_default(struct stats_conf *conf)
+{
+	conf->window   = 0;
+	conf->reserved = 0;
+}
+
+#if STATS_WINDOW
+/**
+ * @brief Drop accumulated values (start a new window)
+ *
+ */
+void stats_reset(void)
+{
+	stats_rh.count   = 0;
+	stats_temp.count = 0;
+	stats_count  = 0;
+	stats_errors = 0;
+}
+
+/**
+ * @brief Insert a sample into the current window
+ *
+ * A window is closed by its last sample (sequence multiple of the window
+ * length), or by the first sample of a following window when the last
+ * one has been lost.
+ *
+ * @param s Pointer to the sample
+ * @return integer One if a window has been closed (see stats_summary)
+ */
+int stats_add(const struct sample *s)
+{
+	u32 window = nvconf.stats.window;
+	u32 win;
+	int closed = 0;
+
+	if (window == 0)
+		return(0);
+	win = (s->seq - 1) / window;
+
+	if (stats_count && (win != stats_win))
+	{
+		stats_close();
+		closed = 1;
+	}
+	stats_win = win;
+	stats_seq = s->seq;
+	stats_time = s->time;
+	stats_count++;
+	if (s->status & (SAMPLE_ERR_RH | SAMPLE_ERR_TEMP))
+		stats_errors++;
+	if ((s->status & SAMPLE_ERR_RH) == 0)
+		stats_update(&stats_rh, s->rh);
+	if ((s->status & SAMPLE_ERR_TEMP) == 0)
+		stats_update(&stats_temp, s->temp);
+
+	/* Last sample of the window (summary of previous one not yet sent) */
+	if ((closed == 0) && ((s->seq % window) == 0))
+	{
+		stats_close();
+		closed = 1;
+	}
+	return(closed);
+}
+
+/**
+ * @brief Get the summary of the last closed window
+ *
+ * @return struct stats_summary* Pointer to the summary
+ */
+const struct stats_summary *stats_summary(void)
+{
+	return(&stats_sum);
+}
+
+/**
+ * @brief Handler of the "STATS" command
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void stats_cmd(int argc, char **argv)
+{
+	int v;
+
+	if (argc == 1)
+	{
+		cmd_puts("STATS");
+		if (nvconf.stats.window == 0)
+			cmd_puts(" OFF");
+		else
+		{
+			cmd_putint(nvconf.stats.window);
+			/* Samples into the current window */
+			cmd_putint(stats_count);
+		}
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "OFF"))
+		nvconf.stats.window = 0;
+	else if (argc == 2)
+	{
+		if (cmd_atoi(argv[1], &v) || (v < 1) || (v > STATS_WINDOW_MAX))
+			goto err;
+		nvconf.stats.window = v;
+	}
+	else
+		goto err;
+	stats_reset();
+	cmd_ok();
+	/* CSV columns depend on the mode */
+	if (argc == 2)
+		format_init();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Insert a value into the running values of a channel
+ *
+ * Integer form of the Welford algorithm : the mean is updated with the
+ * difference divided by count (rounded), and the sum of squares with the
+ * product of the differences to the old and to the new mean (both have the
+ * same sign). The reported mean is computed from the exact sum : the
+ * rounding errors of the running mean would add up over a long window.
+ *
+ * @param c Pointer to the running values
+ * @param x New value (1/100 unit)
+ */
+static void stats_update(struct stats_acc *c, int x)
+{
+	int xq = x * (1 << STATS_Q);
+	u32 d1, d2, p;
+	int delta;
+
+	c->count++;
+	if (c->count == 1)
+	{
+		c->min   = x;
+		c->max   = x;
+		c->sum   = x;
+		c->mean  = xq;
+		c->m2_lo = 0;
+		c->m2_hi = 0;
+		return;
+	}
+	if (x < c->min)
+		c->min = x;
+	if (x > c->max)
+		c->max = x;
+	/* Up to 3600 values of 16 bits : no overflow */
+	c->sum += x;
+
+	delta = xq - c->mean;
+	c->mean += stats_round(delta, c->count);
+	d1 = (delta < 0) ? (u32)(-delta) : (u32)delta;
+	delta = xq - c->mean;
+	d2 = (delta < 0) ? (u32)(-delta) : (u32)delta;
+
+	/* Product in Q8, or with 4 bits less on each side for big steps */
+	if ((d1 | d2) < 0x10000)
+		p = d1 * d2;
+	else
+	{
+		p = (d1 >> 4) * (d2 >> 4);
+		c->m2_hi += (p >> 24);
+		p <<= 8;
+	}
+	c->m2_lo += p;
+	if (c->m2_lo < p)
+		c->m2_hi++;
+}
+
+/**
+ * @brief Compute the result of a channel from its running values
+ *
+ * @param c Pointer to the running values
+ * @param r Pointer to the result to fill
+ */
+static void stats_result(const struct stats_acc *c, struct stats_result *r)
+{
+	u32 q8;
+
+	r->count = c->count;
+	r->var   = 0;
+	r->sd    = 0;
+	if (c->count == 0)
+		return;
+	r->min  = c->min;
+	r->max  = c->max;
+	r->mean = stats_round(c->sum, c->count);
+	if (c->count < 2)
+		return;
+
+	/* Variance in Q8 (more precise SD), or in 1/100 unit if too large */
+	q8 = stats_div(c->m2_hi, c->m2_lo, c->count - 1);
+	if (q8 != 0xFFFFFFFF)
+	{
+		r->var = q8 >> 8;
+		r->sd  = (fx_isqrt(q8) + 8) >> 4;
+	}
+	else
+	{
+		r->var = stats_div(c->m2_hi >> 8, (c->m2_hi << 24) | (c->m2_lo >> 8),
+		                   c->count - 1);
+		r->sd  = fx_isqrt(r->var);
+	}
+}
+
+/**
+ * @brief Close the current window : compute its summary
+ *
+ */
+static void stats_close(void)
+{
+	stats_sum.seq     = stats_seq;
+	stats_sum.time    = stats_time;
+	stats_sum.samples = stats_count;
+	stats_sum.errors  = stats_errors;
+	stats_result(&stats_rh,   &stats_sum.rh);
+	stats_result(&stats_temp, &stats_sum.temp);
+	stats_reset();
+}
+
+/**
+ * @brief Signed division rounded to the nearest integer
+ *
+ * @param num Dividend
+ * @param den Divisor (not zero, lower than 2^31)
+ * @return integer Quotient, halves rounded away from zero
+ */
+static int stats_round(int num, u32 den)
+{
+	if (num < 0)
+		return(-(int)(((u32)(-num) + (den / 2)) / den));
+	return((int)(((u32)num + (den / 2)) / den));
+}
+
+/**
+ * @brief Divide a 64 bits value by a 32 bits one (without libgcc)
+ *
+ * @param hi  High word of the dividend
+ * @param lo  Low word of the dividend
+ * @param den Divisor (lower than 2^31)
+ * @return u32 Quotient, or 0xFFFFFFFF if it does not fit into 32 bits
+ */
+static u32 stats_div(u32 hi, u32 lo, u32 den)
+{
+	u32 q = 0;
+	int i;
+
+	if (hi >= den)
+		return(0xFFFFFFFF);
+	for (i = 31; i >= 0; i--)
+	{
+		/* Remainder is lower than den : no overflow on shift */
+		hi = (hi << 1) | ((lo >> i) & 1);
+		q <<= 1;
+		if (hi >= den)
+		{
+			hi -= den;
+			q  |= 1;
+		}
+	}
+	return(q);
+}
+#endif
+/* EOF */
@@ -0,0 +1,84 @@
+/**
+ * @file  stats.h
+ * @brief Headers and definitions for the windowed statistics
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef STATS_H
+#define STATS_H
+#include "sampler.h"
+#include "types.h"
+
+/* Define to 1 to add the window statistics (STATS command) */
+#ifndef STATS_WINDOW
+#define STATS_WINDOW 0
+#endif
+
+/* Max length of a window (in samples) */
+#define STATS_WINDOW_MAX 3600
+/* Fractional bits of the running mean */
+#define STATS_Q 4
+
+/**
+ * Statistics settings. When window is not zero, samples are accumulated
+ * and one summary is sent for each window of "window" samples (aligned on
+ * the sequence number) instead of each sample.
+ */
+struct stats_conf
+{
+	u16 window;
+	u16 reserved;
+};
+
+/* Running values of a channel (Welford) */
+struct stats_acc
+{
+	u32 count;
+	int min;
+	int max;
+	int sum;      /* Sum of the values (1/100 unit), for the mean   */
+	int mean;     /* Running mean (1/100 unit, Q4), for m2 only     */
+	u32 m2_lo;    /* Sum of squared differences (1/100 unit^2, Q8) */
+	u32 m2_hi;
+};
+
+/* Result of a channel for one window (1/100 unit) */
+struct stats_result
+{
+	u32 count;    /* Number of valid values                         */
+	int min;
+	int max;
+	int mean;
+	u32 var;      /* Sample variance (1/100 unit ^ 2)               */
+	u32 sd;       /* Standard deviation                             */
+};
+
+struct stats_summary
+{
+	u32 seq;      /* Sequence number of the last sample             */
+	u32 time;     /* Time of the last sample (us)                   */
+	u32 samples;  /* Number of samples into the window              */
+	u32 errors;   /* Samples with an error (RH or temperature)      */
+	struct stats_result rh;
+	struct stats_result temp;
+};
+
+void stats_default(struct stats_conf *conf);
+#if STATS_WINDOW
+void stats_reset(void);
+int  stats_add(const struct sample *s);
+const struct stats_summary *stats_summary(void);
+void stats_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
@@ -14,9 +14,13 @@
  * This program is distributed WITHOUT ANY WARRANTY.
  */
 #include "hardware.h"
+#include "irq.h"
 #include "time.h"
 
 static volatile u32 tm_tick;
+static u32 tm_boot;
+/* Optional function called on each tick (into interrupt) */
+static void (*tm_hook)(u32 now);
 
 /**
  * @brief Initialize time module
@@ -24,14 +28,25 @@ static volatile u32 tm_tick;
  * The time module use Systick to create a 1kHz (1ms) time reference. To have a
  * precise value, tick is incremented on interrupt. This module *must* be unload
  * before modifying VTOR.
+ * SysTick has been started by Reset_Handler (free running, 24 bits) so the
+ * number of cycles elapsed since reset is saved before reconfiguration.
  */
 void time_init(void)
 {
 	tm_tick = 0;
+	tm_hook = 0;
+
+	/* Save cycles elapsed since reset (if SysTick started by startup) */
+	if (reg_rd(SYST_CSR) & SYST_CSR_ENABLE)
+		tm_boot = SYST_CVR_MAX - reg_rd(SYST_CVR);
+	else
+		tm_boot = 0;
 
 	/* Configure and start SysTick */
-	reg_wr((u32)0xE000E014, 8000);
-	reg_wr((u32)0xE000E010, (1 << 2) | (1 << 1) | 1);
+	reg_wr(SYST_RVR, TIME_CYCLES_MS - 1);
+	reg_wr(SYST_CVR, 0);
+	reg_wr(SYST_CSR, SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT |
+	                 SYST_CSR_ENABLE);
 }
 
 /**
@@ -44,6 +59,62 @@ u32 time_now(void)
 	return tm_tick;
 }
 
+/**
+ * @brief Return a cycle counter based on SysTick and internal counter
+ *
+ * This counter wraps every 2^32 cycles (~536s at 8MHz) and is only valid
+ * when called with interrupts enabled.
+ *
+ * @return u32 Number of CPU cycles since module started
+ */
+u32 time_cycles(void)
+{
+	u32 tick, v;
+
+	/* Read SysTick value until no tick happens during read */
+	do
+	{
+		tick = tm_tick;
+		v = reg_rd(SYST_CVR);
+	} while (tick != tm_tick);
+
+	return((tick * TIME_CYCLES_MS) + (TIME_CYCLES_MS - 1 - v));
+}
+
+/**
+ * @brief Return the cycle counter from an interrupt handler
+ *
+ * Into a handler that SysTick can not preempt, the tick of a reload may
+ * not be counted yet : it is added when the SysTick interrupt is pending.
+ *
+ * @return u32 Number of CPU cycles since module started
+ */
+u32 time_cycles_irq(void)
+{
+	u32 pend, v;
+
+	do
+	{
+		pend = reg_rd(SCB_ICSR) & SCB_ICSR_PENDSTSET;
+		v = reg_rd(SYST_CVR);
+	} while (pend != (reg_rd(SCB_ICSR) & SCB_ICSR_PENDSTSET));
+
+	return(((tm_tick + (pend ? 1 : 0)) * TIME_CYCLES_MS) +
+	       (TIME_CYCLES_MS - 1 - v));
+}
+
+/**
+ * @brief Return the number of CPU cycles since reset
+ *
+ * Like time_cycles, this is only valid when called with interrupts enabled.
+ *
+ * @return u32 Number of CPU cycles since reset (at 8MHz)
+ */
+u32 time_boot(void)
+{
+	return(tm_boot + time_cycles());
+}
+
 /**
  * @brief Compute the time elapsed from a reference
  *
@@ -59,12 +130,29 @@ u32 time_since(u32 ref)
 	return(tm_diff);
 }
 
+/**
+ * @brief Set a function to call (into interrupt) on each tick
+ *
+ * @param fct Pointer to the callback function, with current time (null to
+ *            remove it)
+ */
+void time_hook(void (*fct)(u32 now))
+{
+	tm_hook = fct;
+}
+
 /**
  * @brief Interrupt service routine for Systick
  *
  */
 void SysTick_Handler(void)
 {
+	u32 stamp = irq_stamp();
+
 	tm_tick ++;
+	if (tm_hook)
+		tm_hook(tm_tick);
+	/* Counter has been reloaded when the tick occurred */
+	irq_account(IRQ_ID_TICK, (TIME_CYCLES_MS - 1) - stamp, stamp);
 }
 /* EOF */
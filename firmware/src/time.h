@@ -17,8 +17,15 @@
 #define TIME_H
 #include "types.h"
 
+/* Number of CPU cycles per SysTick period (1ms at 8MHz) */
+#define TIME_CYCLES_MS 8000
+
 void time_init (void);
 u32  time_now  (void);
+u32  time_cycles(void);
+u32  time_cycles_irq(void);
+u32  time_boot (void);
 u32  time_since(u32 ref);
+void time_hook (void (*fct)(u32 now));
 
 #endif
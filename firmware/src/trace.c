@@ -0,0 +1,155 @@
+/**
+ * @file  trace.c
+ * @brief Execution trace using the Micro Trace Buffer (MTB)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "trace.h"
+#include "uart.h"
+
+#if TRACE_SIZE > 0
+
+/* MTB writes packets into SRAM, buffer must be aligned on its size */
+static u32 trace_buffer[TRACE_SIZE / 4]
+	__attribute__((section(".mtb"), aligned(TRACE_SIZE)));
+static int trace_armed;
+
+static inline u32 trace_mask(void);
+
+/**
+ * @brief Start tracing at the beginning of a traced region (if armed)
+ *
+ * Regions of interest are enclosed by trace_begin() / trace_end(). Nothing
+ * is recorded until the trace is armed by the "TRACE ARM" command, then the
+ * next region is recorded once.
+ */
+void trace_begin(void)
+{
+	if (trace_armed)
+		trace_start();
+}
+
+/**
+ * @brief Stop tracing at the end of a traced region
+ *
+ */
+void trace_end(void)
+{
+	if (trace_armed)
+	{
+		trace_stop();
+		trace_armed = 0;
+	}
+}
+
+/**
+ * @brief Clear the trace buffer and start recording
+ *
+ */
+void trace_start(void)
+{
+	u32 base = reg_rd(MTB_ADDR + MTB_BASE);
+
+	/* Set write pointer to the beginning of the buffer */
+	reg_wr(MTB_ADDR + MTB_POSITION, (u32)trace_buffer - base);
+	reg_wr(MTB_ADDR + MTB_FLOW, 0);
+	reg_wr(MTB_ADDR + MTB_MASTER, MTB_MASTER_EN | FIELD(MTB_MASTER_MASK, trace_mask()));
+}
+
+/**
+ * @brief Stop recording (buffer content is kept)
+ *
+ */
+void trace_stop(void)
+{
+	reg_wr(MTB_ADDR + MTB_MASTER, FIELD(MTB_MASTER_MASK, trace_mask()));
+}
+
+/**
+ * @brief Handler of the "TRACE" command
+ *
+ * TRACE ON    Start recording (until TRACE OFF or TRACE DUMP)
+ * TRACE OFF   Stop recording
+ * TRACE ARM   Record the next traced region (one acquisition)
+ * TRACE DUMP  Stop recording and send packets, oldest first. Each line is
+ *             "T <source> <destination>" (hexadecimal addresses).
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void trace_cmd(int argc, char **argv)
+{
+	u32 pos, first, count;
+	u32 i, idx;
+
+	if (argc != 2)
+		goto err;
+
+	if (cmd_match(argv[1], "ON"))
+		trace_start();
+	else if (cmd_match(argv[1], "OFF"))
+		trace_stop();
+	else if (cmd_match(argv[1], "ARM"))
+		trace_armed = 1;
+	else if (cmd_match(argv[1], "DUMP"))
+	{
+		trace_stop();
+		trace_armed = 0;
+
+		pos = reg_rd(MTB_ADDR + MTB_POSITION);
+		/* Index of next packet to write */
+		idx = ((pos + reg_rd(MTB_ADDR + MTB_BASE) - (u32)trace_buffer) & (TRACE_SIZE - 1)) >> 3;
+		if (pos & MTB_POSITION_WRAP)
+		{
+			first = idx;
+			count = (TRACE_SIZE / 8);
+		}
+		else
+		{
+			first = 0;
+			count = idx;
+		}
+		cmd_puts("TRACE");
+		cmd_putint(count);
+		cmd_puts("\r\n");
+		for (i = 0; i < count; i++)
+		{
+			idx = (first + i) & ((TRACE_SIZE / 8) - 1);
+			cmd_puts("T ");
+			uart_puthex(trace_buffer[(idx * 2) + 0], 32);
+			cmd_puts(" ");
+			uart_puthex(trace_buffer[(idx * 2) + 1], 32);
+			cmd_puts("\r\n");
+		}
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+
+/**
+ * @brief Get the value of MASTER.MASK for the trace buffer size
+ *
+ * @return u32 Mask value (buffer size is 2^(mask + 4) bytes)
+ */
+static inline u32 trace_mask(void)
+{
+	return((TRACE_SIZE >= 1024) ? 6 : (TRACE_SIZE >= 512) ? 5 :
+	       (TRACE_SIZE >=  256) ? 4 : (TRACE_SIZE >=  128) ? 3 :
+	       (TRACE_SIZE >=   64) ? 2 : (TRACE_SIZE >=   32) ? 1 : 0);
+}
+#endif
+/* EOF */
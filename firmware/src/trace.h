@@ -0,0 +1,39 @@
+/**
+ * @file  trace.h
+ * @brief Headers and definitions for MTB execution trace
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+#include "hardware.h"
+#include "types.h"
+
+/* Size of the trace buffer in bytes (power of 2, 16 to 1024). Each packet
+ * (one branch) use 8 bytes. Define to 0 to remove the trace buffer (default) */
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 0
+#endif
+
+#if TRACE_SIZE > 0
+void trace_begin(void);
+void trace_end(void);
+void trace_start(void);
+void trace_stop(void);
+void trace_cmd(int argc, char **argv);
+#else
+static inline void trace_begin(void) { }
+static inline void trace_end(void)   { }
+#endif
+
+#endif
+/* EOF */
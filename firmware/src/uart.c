@@ -13,52 +13,224 @@
  * for more details.
  * This program is distributed WITHOUT ANY WARRANTY.
  */
+#include "bus.h"
 #include "hardware.h"
+#include "irq.h"
+#include "modbus.h"
+#include "power.h"
+#include "time.h"
 #include "uart.h"
+#include "wdt.h"
 
-#define UART_BAUD    9600
 #define UART_GCLK 8000000
 #define CONF_BAUD  (65536 - ((65536 * 16.0f * UART_BAUD) / UART_GCLK))
 
 static const u8 hex[16] = "0123456789ABCDEF";
 
+/* Transmit FIFO, drained by interrupt */
+static volatile u8  tx_buffer[UART_TX_SIZE];
+static volatile u32 tx_head;
+static volatile u32 tx_tail;
+static int tx_used;
+/* Transmit gate (TDMA slot) and RS-485 driver enable */
+static volatile int tx_open;
+#if BUS_RS485
+static int tx_de;
+#endif
+/* Receive FIFO, filled by interrupt */
+static volatile u8  rx_buffer[UART_RX_SIZE];
+static volatile u32 rx_head;
+static volatile u32 rx_tail;
+#if MODBUS_SLAVE
+/* Optional receive callback (replace FIFO) */
+static void (*rx_hook)(u8 c);
+#endif
+#if BUS_RS485
+/* Time (ms) of the last received SYN byte */
+static volatile u32 rx_syn;
+static volatile u32 rx_syn_time;
+#endif
+
 /**
  * @brief Initialize and configure UART port
  *
  */
 void uart_init(void)
 {
+	tx_head = 0;
+	tx_tail = 0;
+	tx_used = 0;
+	tx_open = 1;
+	rx_head = 0;
+	rx_tail = 0;
+#if BUS_RS485
+	tx_de   = 0;
+	rx_syn  = 0;
+#endif
+#if MODBUS_SLAVE
+	rx_hook = 0;
+#endif
+
 	/* 1) Enable peripheral and set clocks */
 
 	/* Enable SERCOM1 clock (APBCMASK) */
-	reg_set(PM_ADDR + 0x20, (1 << 3));
+	reg_set(PM_ADDR + PM_APBCMASK, PM_APBCMASK_SERCOM1);
 	/* Set GCLK for SERCOM1 (generic clock generator 0) */
-	reg16_wr (GCLK_ADDR + 0x02, (1 << 14) | (0 << 8) | 15);
+	reg16_wr (GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	          FIELD(GCLK_CLKCTRL_GEN, 0) | FIELD(GCLK_CLKCTRL_ID, GCLK_ID_SERCOM1));
 
 	/* 2) Initialize UART block   */
 
 	/* Reset UART (set SWRST)     */
-	reg_wr((UART_ADDR + 0x00), 0x01);
+	reg_wr((UART_ADDR + SERCOM_CTRLA), SERCOM_CTRLA_SWRST);
 	/* Wait end of software reset */
-	while( reg_rd(UART_ADDR + 0x00) & 0x01)
+	while( reg_rd(UART_ADDR + SERCOM_CTRLA) & SERCOM_CTRLA_SWRST)
 		;
-	/* Configure UART */
-	reg_wr(UART_ADDR + 0x00, 0x40310004);
-	reg_wr(UART_ADDR + 0x04, 0x00030000);
+	/* Configure UART : LSB first, RX on PAD3, TX on PAD2, internal clock */
+	reg_wr(UART_ADDR + SERCOM_CTRLA, SERCOM_USART_CTRLA_DORD |
+	       FIELD(SERCOM_USART_CTRLA_RXPO, 3) |
+	       FIELD(SERCOM_USART_CTRLA_TXPO, 1) |
+	       FIELD(SERCOM_CTRLA_MODE, SERCOM_MODE_USART_INT));
+	/* 8 bits, 1 stop bit, enable receiver and transmitter */
+	reg_wr(UART_ADDR + SERCOM_CTRLB, SERCOM_USART_CTRLB_RXEN | SERCOM_USART_CTRLB_TXEN);
 	/* Configure Baudrate */
-	reg16_wr(UART_ADDR + 0x0C, CONF_BAUD);
+	reg16_wr(UART_ADDR + SERCOM_BAUD, CONF_BAUD);
 	/* Set ENABLE into CTRLA */
-	reg_set( (UART_ADDR + 0x00), (1 << 1) );
+	reg_set( (UART_ADDR + SERCOM_CTRLA), SERCOM_CTRLA_ENABLE );
 
 	/* 3) Configure pins (IOs) */
 
 	/* PINCFG: Enable PMUX for RX/TX pins */
-	reg8_wr(0x60000000 + 0x58, 0x01); /* PA24 : TX */
-	reg8_wr(0x60000000 + 0x59, 0x01); /* PA25 : RX */
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(24), PORT_PINCFG_PMUXEN); /* PA24 : TX */
+	reg8_wr(PORT_IOBUS + PORT_PINCFG(25), PORT_PINCFG_PMUXEN); /* PA25 : RX */
 	/* Set peripheral function C (SERCOM) for PA24 and PA25 */
-	reg8_wr(0x60000000 + 0x3C, (0x02 << 4) | (0x02 << 0));
+	reg8_wr(PORT_IOBUS + PORT_PMUX(24), FIELD(PORT_PMUX_PMUXO, PORT_FUNC_C) |
+	                                    FIELD(PORT_PMUX_PMUXE, PORT_FUNC_C));
+
+	/* Enable RXC interrupt (Receive Complete) */
+	reg8_wr(UART_ADDR + SERCOM_INTENSET, SERCOM_USART_INT_RXC);
+	/* Enable SERCOM1 interrupt into NVIC */
+	reg_wr(NVIC_ISER, (1 << SERCOM1_IRQn));
 }
 
+/**
+ * @brief Wait until all pending bytes have been sent
+ *
+ */
+void uart_flush(void)
+{
+	uint state;
+	u32  tail;
+
+	state = power_enter(POWER_UART);
+	/* Wait end of FIFO. With TDMA this may take many cycles : the watchdog
+	 * is kicked as long as bytes are sent (a stuck UART still resets) */
+	tail = tx_tail;
+	while (tx_tail != tx_head)
+	{
+		if (tx_tail != tail)
+		{
+			tail = tx_tail;
+			wdt_kick();
+		}
+	}
+	/* Wait TXC (Transmit Complete) for the last byte, if any */
+	if (tx_used)
+		while ( (reg_rd(UART_ADDR + SERCOM_INTFLAG) & SERCOM_USART_INT_TXC) == 0)
+			;
+	power_enter(state);
+}
+
+/**
+ * @brief Get one received byte (if any)
+ *
+ * @return integer Value of the received byte, or -1 if none available
+ */
+int uart_getc(void)
+{
+	int c;
+
+	if (rx_tail == rx_head)
+		return(-1);
+	c = rx_buffer[rx_tail];
+	rx_tail = (rx_tail + 1) & (UART_RX_SIZE - 1);
+	return(c);
+}
+
+#if MODBUS_SLAVE
+/**
+ * @brief Set a function to call (into interrupt) for each received byte
+ *
+ * When a hook is defined, received bytes are not stored into the receive
+ * FIFO (uart_getc) but given immediately to the hook. This is used by
+ * protocols that need the exact arrival time of each byte (Modbus RTU).
+ *
+ * @param fct Pointer to the callback function (null to use the FIFO)
+ */
+void uart_rx_hook(void (*fct)(u8 c))
+{
+	rx_hook = fct;
+}
+#endif
+
+#if BUS_RS485
+/**
+ * @brief Get the time of the last SYN byte received (bus cycle start)
+ *
+ * SYN bytes are only detected when the receive FIFO is used (no hook), they
+ * are not stored into the FIFO. The time is taken into the interrupt so it
+ * does not depend on main loop latency.
+ *
+ * @param time Pointer to a variable where the time (in ms) can be stored
+ * @return integer One if a SYN has been received since last call, zero if not
+ */
+int uart_rx_syn(u32 *time)
+{
+	u32 primask;
+
+	if (rx_syn == 0)
+		return(0);
+	primask = irq_save();
+	*time  = rx_syn_time;
+	rx_syn = 0;
+	irq_restore(primask);
+	return(1);
+}
+
+/**
+ * @brief Use the RS-485 driver enable (DE) signal
+ *
+ * DE is set before the first byte of a transmission and cleared by the TXC
+ * interrupt when the last byte has been completely sent, so the line is
+ * released for other nodes as soon as possible.
+ */
+void uart_de_enable(void)
+{
+	/* Configure DE pin as output, driver disabled */
+	reg_wr(PORT_IOBUS + PORT_OUTCLR, (1 << UART_DE_PIN));
+	reg_wr(PORT_IOBUS + PORT_DIRSET, (1 << UART_DE_PIN));
+	tx_de = 1;
+}
+
+/**
+ * @brief Allow or suspend transmission (used for TDMA slots)
+ *
+ * When the gate is closed, bytes are kept into the transmit FIFO and sent
+ * when it opens again. A byte already started is always completed.
+ *
+ * @param open Non-zero to allow transmission
+ */
+void uart_tx_gate(int open)
+{
+	if (open == tx_open)
+		return;
+	tx_open = open;
+	/* Restart transmission if bytes are waiting */
+	if (open && (tx_tail != tx_head))
+		reg8_wr(UART_ADDR + SERCOM_INTENSET, SERCOM_USART_INT_DRE);
+}
+#endif
+
 /**
  * @brief Send a single byte over UART
  *
@@ -66,11 +238,25 @@ void uart_init(void)
  */
 void uart_putc(unsigned char c)
 {
-	/* Read INTFLAG and wait DRE (Data Register Empty) */
-	while ( (reg_rd(UART_ADDR + 0x18) & 0x01) == 0)
-		;
-	/* Write data */
-	reg_wr((UART_ADDR + 0x28), c);
+	u32 next;
+	uint state;
+
+	next = (tx_head + 1) & (UART_TX_SIZE - 1);
+	/* Wait for a free slot into FIFO */
+	if (next == tx_tail)
+	{
+		state = power_enter(POWER_UART);
+		while (next == tx_tail)
+			;
+		power_enter(state);
+	}
+	/* Insert data */
+	tx_buffer[tx_head] = c;
+	tx_head = next;
+	tx_used = 1;
+	/* Enable DRE interrupt (Data Register Empty) */
+	if (tx_open)
+		reg8_wr(UART_ADDR + SERCOM_INTENSET, SERCOM_USART_INT_DRE);
 }
 
 /**
@@ -135,21 +321,82 @@ void uart_puts(char *s)
  */
 void uart_puthex(const u32 c, const uint len)
 {
-	if (len > 28)
-		uart_putc( hex[(c >> 28) & 0xF] );
-	if (len > 24)
-		uart_putc( hex[(c >> 24) & 0xF] );
-	if (len > 20)
-		uart_putc( hex[(c >> 20) & 0xF] );
-	if (len > 16)
-		uart_putc( hex[(c >> 16) & 0xF] );
-	if (len > 12)
-		uart_putc( hex[(c >> 12) & 0xF] );
-	if (len >  8)
-		uart_putc( hex[(c >>  8) & 0xF] );
-	if (len >  4)
-		uart_putc( hex[(c >>  4) & 0xF] );
-	if (len >  0)
-		uart_putc( hex[(c >>  0) & 0xF] );
+	uint n;
+
+	/* One digit per nibble, most significant first */
+	for (n = (len + 3) & ~3u; n > 0; n -= 4)
+		uart_putc( hex[(c >> (n - 4)) & 0xF] );
+}
+
+/**
+ * @brief Interrupt service routine for SERCOM1 (UART)
+ *
+ */
+void SERCOM1_Handler(void)
+{
+	u32 stamp = irq_stamp();
+	u32 next;
+	u8  c;
+
+	/* Receive Complete : store byte into FIFO */
+	if (reg8_rd(UART_ADDR + SERCOM_INTFLAG) & SERCOM_USART_INT_RXC)
+	{
+		/* Read DATA (clear RXC) */
+		c = reg16_rd(UART_ADDR + SERCOM_DATA);
+#if MODBUS_SLAVE
+		if (rx_hook)
+			rx_hook(c);
+		else
+#endif
+#if BUS_RS485
+		if (c == UART_SYN)
+		{
+			rx_syn_time = time_now();
+			rx_syn = 1;
+		}
+		else
+#endif
+		{
+			next = (rx_head + 1) & (UART_RX_SIZE - 1);
+			/* If FIFO is full, received byte is lost */
+			if (next != rx_tail)
+			{
+				rx_buffer[rx_head] = c;
+				rx_head = next;
+			}
+		}
+	}
+	/* Data Register Empty : send next byte from FIFO */
+	if ((reg8_rd(UART_ADDR + SERCOM_INTFLAG) & SERCOM_USART_INT_DRE) &&
+	    (reg8_rd(UART_ADDR + SERCOM_INTENSET) & SERCOM_USART_INT_DRE))
+	{
+		if ((tx_tail != tx_head) && tx_open)
+		{
+#if BUS_RS485
+			/* Take the line before the first byte (RS-485) */
+			if (tx_de)
+			{
+				reg_wr(PORT_IOBUS + PORT_OUTSET, (1 << UART_DE_PIN));
+				reg8_wr(UART_ADDR + SERCOM_INTENSET, SERCOM_USART_INT_TXC);
+			}
+#endif
+			/* Write DATA (clear TXC) */
+			reg16_wr(UART_ADDR + SERCOM_DATA, tx_buffer[tx_tail]);
+			tx_tail = (tx_tail + 1) & (UART_TX_SIZE - 1);
+		}
+		else
+			/* FIFO is empty (or gate closed), disable DRE interrupt */
+			reg8_wr(UART_ADDR + SERCOM_INTENCLR, SERCOM_USART_INT_DRE);
+	}
+#if BUS_RS485
+	/* Transmit Complete : last byte sent, release the line (RS-485) */
+	if ((reg8_rd(UART_ADDR + SERCOM_INTFLAG) & SERCOM_USART_INT_TXC) &&
+	    (reg8_rd(UART_ADDR + SERCOM_INTENSET) & SERCOM_USART_INT_TXC))
+	{
+		reg8_wr(UART_ADDR + SERCOM_INTENCLR, SERCOM_USART_INT_TXC);
+		reg_wr(PORT_IOBUS + PORT_OUTCLR, (1 << UART_DE_PIN));
+	}
+#endif
+	irq_account(IRQ_ID_UART, IRQ_LAT_NONE, stamp);
 }
 /* EOF */
@@ -19,9 +19,27 @@
 #include "types.h"
 
 #define UART_ADDR      SERCOM1_ADDR
+/* Baud rate of the link (text lines and Modbus RTU) */
+#ifndef UART_BAUD
+#define UART_BAUD      9600
+#endif
+/* Size of the transmit FIFO (power of 2) */
+#define UART_TX_SIZE   256
+/* Size of the receive FIFO (power of 2) */
+#define UART_RX_SIZE   32
+/* RS-485 driver enable : PA02, "IRQ" line of the PMOD connector */
+#define UART_DE_PIN    2
+/* Control byte (ASCII SYN) sent by a bus master to mark the start of cycle */
+#define UART_SYN       0x16
 
 void uart_init(void);
+void uart_flush(void);
 /* Basic IOs */
+int  uart_getc(void);
+void uart_rx_hook(void (*fct)(u8 c));
+int  uart_rx_syn(u32 *time);
+void uart_de_enable(void);
+void uart_tx_gate(int open);
 void uart_putc(unsigned char c);
 /* Send structured content */
 void uart_puts(char *s);
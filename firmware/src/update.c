@@ -0,0 +1,57 @@
+/**
+ * @file  update.c
+ * @brief Request a firmware update : reset into the serial bootloader
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "boot.h"
+#include "cmd.h"
+#include "hardware.h"
+#include "uart.h"
+#include "update.h"
+
+#if BOOTLOADER
+/**
+ * @brief Handler of the UPDATE command
+ *
+ * The magic value is written into the mailbox (end of RAM, not used by the
+ * application nor cleared at startup) then the chip is reset. The bootloader
+ * finds the magic and waits for an image at BOOT_BAUD instead of starting
+ * the application.
+ *
+ * @param argc Number of arguments (including the command name)
+ * @param argv Array of pointers to arguments
+ */
+void update_cmd(int argc, char **argv)
+{
+	volatile u32 *mbox = (volatile u32 *)BOOT_MAILBOX;
+
+	(void)argv;
+
+	if (argc != 1)
+	{
+		cmd_error();
+		return;
+	}
+	cmd_ok();
+	uart_flush();
+
+	asm volatile("cpsid i");
+	mbox[0] = BOOT_MAGIC;
+	mbox[1] = ~(u32)BOOT_MAGIC;
+	/* Request a system reset (AIRCR.SYSRESETREQ) */
+	reg_wr(SCB_AIRCR, SCB_AIRCR_VECTKEY | SCB_AIRCR_SYSRESETREQ);
+	while(1)
+		;
+}
+#endif
+/* EOF */
@@ -0,0 +1,30 @@
+/**
+ * @file  update.h
+ * @brief Headers and definitions for firmware update (bootloader request)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef UPDATE_H
+#define UPDATE_H
+
+/* Set to 0 by the Makefile (BOOTLOADER=0) when the application is linked
+ * without the serial bootloader : the UPDATE command is removed */
+#ifndef BOOTLOADER
+#define BOOTLOADER 1
+#endif
+
+#if BOOTLOADER
+void update_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
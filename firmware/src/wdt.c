@@ -0,0 +1,222 @@
+/**
+ * @file  wdt.c
+ * @brief Watchdog supervision of the main loop and warm restart
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include "cmd.h"
+#include "crc.h"
+#include "hardware.h"
+#include "uart.h"
+#include "wdt.h"
+
+/* Symbols defined by linker script */
+extern u32 __noinit_start__;
+extern u32 __noinit_end__;
+
+#define WDT_NOINIT_SIZE ((u32)&__noinit_end__ - (u32)&__noinit_start__)
+
+static u32 wdt_crc(void);
+
+static struct wdt_keep wdt_keep NOINIT;
+static uint wdt_last;
+static int  wdt_resumed;
+
+static const char * const wdt_names[] = {
+	"POWER", "PIN", "SOFT", "WDT", "FAULT"
+};
+
+/**
+ * @brief Find the reason of the restart, then start the watchdog
+ *
+ * Must be called before any module that keeps variables into .noinit
+ * (see wdt_warm). The seal is removed, so a state is resumed only once.
+ * Without a seal the reason comes from the reset cause (RCAUSE), a
+ * watchdog reset without early warning (stall with interrupts disabled)
+ * is a cold start.
+ */
+void wdt_init(void)
+{
+	u32 rcause;
+
+	rcause = reg8_rd(PM_ADDR + PM_RCAUSE);
+	if ((wdt_keep.magic == WDT_MAGIC) &&
+	    (wdt_keep.size  == WDT_NOINIT_SIZE) &&
+	    (wdt_keep.reason <= WDT_RESET_FAULT) &&
+	    (wdt_keep.crc   == wdt_crc()))
+	{
+		wdt_last    = wdt_keep.reason;
+		wdt_resumed = 1;
+	}
+	else
+	{
+		if (rcause & PM_RCAUSE_WDT)
+			wdt_last = WDT_RESET_WDT;
+		else if (rcause & PM_RCAUSE_EXT)
+			wdt_last = WDT_RESET_PIN;
+		else if (rcause & PM_RCAUSE_SYST)
+			wdt_last = WDT_RESET_SOFT;
+		else
+			wdt_last = WDT_RESET_POWER;
+		wdt_resumed   = 0;
+		wdt_keep.count = 0;
+		wdt_keep.pc    = 0;
+	}
+	wdt_keep.magic = 0;
+
+	/* Set generator 2 : OSCULP32K divided by 2^(4+1) = 1024Hz */
+	reg_wr(GCLK_ADDR + GCLK_GENDIV, FIELD(GCLK_GENDIV_DIV, 4) |
+	       FIELD(GCLK_GENDIV_ID, WDT_GCLK_GEN));
+	reg_wr(GCLK_ADDR + GCLK_GENCTRL, GCLK_GENCTRL_GENEN | GCLK_GENCTRL_DIVSEL |
+	       FIELD(GCLK_GENCTRL_SRC, GCLK_SRC_OSCULP32K) |
+	       FIELD(GCLK_GENCTRL_ID, WDT_GCLK_GEN));
+	while (reg8_rd(GCLK_ADDR + GCLK_STATUS) & GCLK_STATUS_SYNCBUSY)
+		;
+	reg16_wr(GCLK_ADDR + GCLK_CLKCTRL, GCLK_CLKCTRL_CLKEN |
+	         FIELD(GCLK_CLKCTRL_GEN, WDT_GCLK_GEN) |
+	         FIELD(GCLK_CLKCTRL_ID, GCLK_ID_WDT));
+	reg_set(PM_ADDR + PM_APBAMASK, PM_APBAMASK_WDT);
+
+	/* Configure period and early warning (only while disabled) */
+	reg8_wr(WDT_ADDR + WDT_CONFIG, FIELD(WDT_CONFIG_PER, WDT_PER));
+	reg8_wr(WDT_ADDR + WDT_EWCTRL, FIELD(WDT_EWCTRL_EWOFFSET, WDT_EWOFFSET));
+	reg8_wr(WDT_ADDR + WDT_INTFLAG,  WDT_INT_EW);
+	reg8_wr(WDT_ADDR + WDT_INTENSET, WDT_INT_EW);
+	/* Set ENABLE into CTRL */
+	reg8_wr(WDT_ADDR + WDT_CTRL, WDT_CTRL_ENABLE);
+	while (reg8_rd(WDT_ADDR + WDT_STATUS) & WDT_STATUS_SYNCBUSY)
+		;
+	/* Enable WDT interrupt (early warning) into NVIC */
+	reg_wr(NVIC_ISER, (1 << WDT_IRQn));
+}
+
+/**
+ * @brief Restart the watchdog period (called by the main loop)
+ *
+ * A clear takes a few cycles of the 1024Hz clock to be synchronized, the
+ * main loop runs at least once per millisecond (SysTick) so the clear is
+ * only written when the previous one is done (no bus stall).
+ */
+void wdt_kick(void)
+{
+	if ( ! (reg8_rd(WDT_ADDR + WDT_STATUS) & WDT_STATUS_SYNCBUSY))
+		reg8_wr(WDT_ADDR + WDT_CLEAR, WDT_CLEAR_KEY);
+}
+
+/**
+ * @brief Test if the state of the previous run has been resumed
+ *
+ * @return integer Non-zero for a warm restart (.noinit content is valid)
+ */
+int wdt_warm(void)
+{
+	return(wdt_resumed);
+}
+
+/**
+ * @brief Get the reason of the last restart
+ *
+ * @return integer Reason (WDT_RESET_xx)
+ */
+uint wdt_reason(void)
+{
+	return(wdt_last);
+}
+
+/**
+ * @brief Get the name of the reason of the last restart
+ *
+ * @return char* Pointer to a constant string
+ */
+const char *wdt_reason_name(void)
+{
+	return(wdt_names[wdt_last]);
+}
+
+/**
+ * @brief Seal the state kept into .noinit, then reset the chip
+ *
+ * Called by the early warning and hard fault handlers (see startup.s).
+ *
+ * @param reason Reason of the restart (WDT_RESET_xx)
+ * @param pc     Address of the stalled or faulty code
+ */
+void wdt_fault(uint reason, u32 pc)
+{
+	asm volatile("cpsid i");
+	wdt_keep.reason = reason;
+	wdt_keep.pc     = pc;
+	wdt_keep.count++;
+	wdt_keep.size   = WDT_NOINIT_SIZE;
+	wdt_keep.magic  = WDT_MAGIC;
+	wdt_keep.crc    = wdt_crc();
+	/* Request a system reset (AIRCR.SYSRESETREQ) */
+	reg_wr(SCB_AIRCR, SCB_AIRCR_VECTKEY | SCB_AIRCR_SYSRESETREQ);
+	while(1)
+		;
+}
+
+#if WDT_CMD
+/**
+ * @brief Handler of the WDT command
+ *
+ * WDT        Print the reason of the last restart, the address of the
+ *            stalled or faulty code and the number of warm restarts
+ * WDT TEST   Stall the main loop (restart after the early warning)
+ *
+ * @param argc Number of arguments (including command name)
+ * @param argv Array of arguments
+ */
+void wdt_cmd(int argc, char **argv)
+{
+	if (argc == 1)
+	{
+		cmd_puts("WDT ");
+		cmd_puts(wdt_names[wdt_last]);
+		cmd_puts(" ");
+		uart_puthex(wdt_keep.pc, 32);
+		cmd_putint(wdt_keep.count);
+		cmd_puts("\r\n");
+	}
+	else if ((argc == 2) && cmd_match(argv[1], "TEST"))
+	{
+		cmd_ok();
+		uart_flush();
+		while(1)
+			;
+	}
+	else
+		goto err;
+	cmd_ok();
+	return;
+err:
+	cmd_error();
+}
+#endif
+
+/**
+ * @brief Compute the CRC of the .noinit section (with crc field = 0)
+ *
+ * @return u32 Value of the CRC-16
+ */
+static u32 wdt_crc(void)
+{
+	u32 save;
+	u32 crc;
+
+	save = wdt_keep.crc;
+	wdt_keep.crc = 0;
+	crc = crc16(CRC16_INIT, (const u8 *)&__noinit_start__, WDT_NOINIT_SIZE);
+	wdt_keep.crc = save;
+	return(crc);
+}
+/* EOF */
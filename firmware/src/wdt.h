@@ -0,0 +1,67 @@
+/**
+ * @file  wdt.h
+ * @brief Headers and definitions for the watchdog and warm restart
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This firmware is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef WDT_H
+#define WDT_H
+#include "types.h"
+
+/* Define to 1 to add the WDT command (restart report and test) */
+#ifndef WDT_CMD
+#define WDT_CMD       0
+#endif
+
+/* Watchdog clock : OSCULP32K / 32 (1024Hz) on generator 2 */
+#define WDT_GCLK_GEN  2
+/* Reset after 8 << WDT_PER cycles (4s), early warning after 2s */
+#define WDT_PER       9
+#define WDT_EWOFFSET  8
+
+#define WDT_MAGIC     0x4D524157 /* "WARM" */
+
+/* Reason of the last restart (WDT and FAULT are also used by startup.s) */
+#define WDT_RESET_POWER 0  /* Power-on or brown-out (cold start)       */
+#define WDT_RESET_PIN   1  /* External reset pin                      */
+#define WDT_RESET_SOFT  2  /* Software reset (update, debugger)       */
+#define WDT_RESET_WDT   3  /* Main loop stalled (watchdog)            */
+#define WDT_RESET_FAULT 4  /* Hard fault                              */
+
+/**
+ * Header of the state kept over a reset. When a stall or a fault is
+ * detected, the reason is stored and the whole .noinit section is sealed
+ * with a CRC before the reset. On next startup a valid seal means a warm
+ * restart : variables into .noinit (NOINIT) are resumed.
+ */
+struct wdt_keep
+{
+	u32 magic;     /* WDT_MAGIC when sealed                       */
+	u32 crc;       /* CRC-16 of .noinit (computed with crc = 0)   */
+	u32 size;      /* Size of .noinit (layout of this firmware)   */
+	u16 reason;    /* WDT_RESET_xx                                */
+	u16 count;     /* Number of warm restarts since cold start    */
+	u32 pc;        /* Address of the stalled or faulty code       */
+};
+
+void wdt_init(void);
+void wdt_kick(void);
+int  wdt_warm(void);
+uint wdt_reason(void);
+const char *wdt_reason_name(void);
+void wdt_fault(uint reason, u32 pc) __attribute__((noreturn));
+#if WDT_CMD
+void wdt_cmd(int argc, char **argv);
+#endif
+
+#endif
+/* EOF */
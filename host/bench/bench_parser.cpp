@@ -0,0 +1,171 @@
+/**
+ * @file  bench_parser.cpp
+ * @brief Throughput benchmark of the stream parser on a synthetic capture
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "trh_parser.hpp"
+
+namespace {
+
+/**
+ * @brief Append a value in 1/100 unit using the firmware format
+ */
+void put_fixed(std::string &s, int v)
+{
+	char buf[16];
+	unsigned int u = (v < 0) ? -v : v;
+	snprintf(buf, sizeof(buf), "%s%u,%02u", (v < 0) ? "-" : "", u / 100, u % 100);
+	s += buf;
+}
+
+/**
+ * @brief Build a synthetic capture of (at least) "size" bytes
+ */
+std::string make_capture(size_t size, bool metrics)
+{
+	std::string s;
+	unsigned int seed = 1;
+	uint32_t seq = 0;
+
+	s.reserve(size + 256);
+	s += "PMOD-TRH: Started\r\n";
+	s += " * Si7021 serial number 0123456789ABCDEF\r\n";
+	s += "TEMP: 2305\r\n";
+	while (s.size() < size)
+	{
+		seed = seed * 1103515245 + 12345;
+		int rh   = int((seed >> 8) % 10001);
+		int temp = int((seed >> 4) % 16500) - 4000;
+		s += "RH=";
+		if ((seed & 0xFFF) == 0)
+			s += "ERROR";
+		else
+			put_fixed(s, rh);
+		s += " TEMP=";
+		put_fixed(s, temp);
+		if (metrics)
+		{
+			s += " DEW=";
+			put_fixed(s, temp - 500);
+			s += " AH=";
+			put_fixed(s, rh / 5);
+			s += " HI=";
+			put_fixed(s, temp + 100);
+		}
+		s += " SEQ=" + std::to_string(++seq);
+		s += " PHASE=" + std::to_string((seed >> 16) % 40);
+		s += "\r\n";
+	}
+	return s;
+}
+
+double now_s()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Reference implementation : line split and sscanf
+ */
+size_t naive_parse(const std::string &cap, int64_t *sum)
+{
+	size_t n = 0;
+	size_t pos = 0;
+
+	while (pos < cap.size())
+	{
+		size_t nl = cap.find('\n', pos);
+		if (nl == std::string::npos)
+			break;
+		std::string line = cap.substr(pos, nl - pos);
+		int a, b, c, d;
+		if (sscanf(line.c_str(), "RH=%d,%d TEMP=%d,%d", &a, &b, &c, &d) == 4)
+		{
+			*sum += a * 100 + b;
+			n++;
+		}
+		pos = nl + 1;
+	}
+	return n;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	size_t mb    = (argc > 1) ? strtoul(argv[1], 0, 0) : 64;
+	size_t chunk = (argc > 2) ? strtoul(argv[2], 0, 0) : 4096;
+	int    loops = 5;
+
+	for (int metrics = 0; metrics < 2; metrics++)
+	{
+		std::string cap = make_capture(mb << 20, metrics);
+		std::vector<trh::Sample> out(1024);
+		double best = 1e9;
+		size_t nsamples = 0;
+		int64_t sum = 0;
+
+		for (int l = 0; l < loops; l++)
+		{
+			trh::StreamParser p;
+			double t0 = now_s();
+			size_t pos = 0;
+			nsamples = 0;
+			sum = 0;
+			while (pos < cap.size())
+			{
+				size_t len = std::min(chunk, cap.size() - pos);
+				size_t off = 0;
+				while (off < len)
+				{
+					size_t used;
+					size_t n = p.parse(cap.data() + pos + off, len - off,
+					                   out.data(), out.size(), &used);
+					for (size_t i = 0; i < n; i++)
+						sum += out[i].rh;
+					nsamples += n;
+					off += used;
+				}
+				pos += len;
+			}
+			double dt = now_s() - t0;
+			if (dt < best)
+				best = dt;
+			if (!p.has_serial())
+				fprintf(stderr, "serial number not found\n");
+		}
+
+		int64_t nsum = 0;
+		double t0 = now_s();
+		size_t nref = naive_parse(cap, &nsum);
+		double tref = now_s() - t0;
+
+		printf("%s capture: %zu MB, %zu samples, chunk %zu bytes\n",
+		       metrics ? "full" : "short", cap.size() >> 20, nsamples, chunk);
+		printf("  trh::StreamParser %8.1f MB/s %8.2f Mlines/s\n",
+		       cap.size() / best / 1e6, nsamples / best / 1e6);
+		printf("  getline + sscanf  %8.1f MB/s %8.2f Mlines/s\n",
+		       cap.size() / tref / 1e6, nref / tref / 1e6);
+		if (sum != nsum)
+			printf("  WARNING: results differ from reference\n");
+	}
+	return 0;
+}
+/* EOF */
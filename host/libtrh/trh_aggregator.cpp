@@ -0,0 +1,744 @@
+/**
+ * @file  trh_aggregator.cpp
+ * @brief Multi-port aggregator : one epoll loop for many serial streams
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "trh_aggregator.hpp"
+#include "trh_serial.hpp"
+
+namespace trh {
+
+namespace {
+
+constexpr size_t   kReadChunk = 64 * 1024;
+constexpr size_t   kSamples   = 512;
+constexpr size_t   kEvents    = 1024;
+/* Max length of one record, and room kept for the records of one read */
+constexpr size_t   kRecordMax = 160;
+constexpr size_t   kOutSlack  = 8 * kReadChunk;
+constexpr uint64_t kTagTimer  = ~uint64_t(0);
+constexpr uint64_t kTagOutput = ~uint64_t(0) - 1;
+
+uint64_t mono_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + uint64_t(ts.tv_nsec) / 1000;
+}
+
+uint64_t real_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+/**
+ * @brief Write an unsigned decimal value, return the end of the text
+ */
+inline char *put_uint(char *p, uint64_t v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do
+	{
+		tmp[n++] = char('0' + (v % 10));
+		v /= 10;
+	} while (v);
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/**
+ * @brief Write a value in 1/100 unit as a decimal number ("-12.05")
+ */
+inline char *put_fixed(char *p, int32_t v)
+{
+	uint32_t u = (v < 0) ? uint32_t(-int64_t(v)) : uint32_t(v);
+
+	if (v < 0)
+		*p++ = '-';
+	p = put_uint(p, u / 100);
+	*p++ = '.';
+	*p++ = char('0' + (u % 100) / 10);
+	*p++ = char('0' + (u % 10));
+	return p;
+}
+
+/**
+ * @brief Write a serial number (16 hex digits)
+ */
+inline char *put_serial(char *p, uint64_t sn)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	for (int i = 60; i >= 0; i -= 4)
+		*p++ = hex[(sn >> i) & 0xF];
+	return p;
+}
+
+} // namespace
+
+Aggregator::Aggregator(const AggConfig &conf)
+	: m_conf(conf), m_out_off(0), m_out_len(0), m_out_count(0),
+	  m_out_stamp(0), m_out_first(0), m_out_paused(false), m_out_wait(false),
+	  m_out_fd(STDOUT_FILENO), m_epoll(-1), m_timer(-1), m_metrics_ms(0)
+{
+	std::memset(&m_stats, 0, sizeof(m_stats));
+	if (m_conf.flush_ms == 0)
+		m_conf.flush_ms = 1;
+}
+
+Aggregator::~Aggregator()
+{
+	for (Port &p : m_ports)
+	{
+		if (p.fd >= 0)
+			close(p.fd);
+	}
+	if ((m_out_fd >= 0) && (m_out_fd != STDOUT_FILENO))
+		close(m_out_fd);
+	if (m_timer >= 0)
+		close(m_timer);
+	if (m_epoll >= 0)
+		close(m_epoll);
+}
+
+/**
+ * @brief Add a port (opened when the loop starts, reopened after errors)
+ *
+ * @param path Name of the device (/dev/ttyUSB0, a pty, ...)
+ */
+void Aggregator::add_port(const char *path)
+{
+	Port p;
+
+	p.path      = path;
+	p.fd        = -1;
+	p.paused    = false;
+	p.retry_ms  = 0;
+	p.period    = 0;
+	p.bytes     = 0;
+	p.throttled = 0;
+	m_ports.push_back(p);
+}
+
+/**
+ * @brief Write records to a file (appended) instead of stdout
+ *
+ * @return bool True on success
+ */
+bool Aggregator::output_file(const char *path, std::string *error)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		if (error)
+			*error = strerror(errno);
+		return false;
+	}
+	m_out_fd = fd;
+	return true;
+}
+
+/**
+ * @brief Write records to a local (unix stream) socket
+ *
+ * The connection is retried at each flush period when lost, records are
+ * kept into the output buffer meanwhile.
+ *
+ * @return bool True if the first connection succeeded
+ */
+bool Aggregator::output_socket(const char *path, std::string *error)
+{
+	m_out_sock = path;
+	m_out_fd   = -1;
+	if (m_out_sock.size() >= sizeof(((struct sockaddr_un *)0)->sun_path))
+	{
+		if (error)
+			*error = "socket name too long";
+		return false;
+	}
+	if (!output_connect())
+	{
+		if (error)
+			*error = strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Run the loop until *stop is set (by a signal handler)
+ *
+ * @return bool False if the loop can not be started
+ */
+bool Aggregator::run(volatile sig_atomic_t *stop, std::string *error)
+{
+	struct epoll_event ev[kEvents];
+	struct itimerspec  its;
+	uint64_t now_ms;
+
+	m_in.resize(kReadChunk);
+	m_smp.resize(kSamples);
+	m_out.resize(m_conf.max_pending + kOutSlack);
+
+	m_epoll = epoll_create1(EPOLL_CLOEXEC);
+	m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if ((m_epoll < 0) || (m_timer < 0))
+	{
+		if (error)
+			*error = strerror(errno);
+		return false;
+	}
+	its.it_interval.tv_sec  = m_conf.flush_ms / 1000;
+	its.it_interval.tv_nsec = long(m_conf.flush_ms % 1000) * 1000000;
+	its.it_value = its.it_interval;
+	timerfd_settime(m_timer, 0, &its, nullptr);
+	ev[0].events   = EPOLLIN;
+	ev[0].data.u64 = kTagTimer;
+	epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &ev[0]);
+	if (m_out_fd >= 0 && !m_out_sock.empty())
+	{
+		ev[0].events   = 0;
+		ev[0].data.u64 = kTagOutput;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_out_fd, &ev[0]);
+	}
+
+	now_ms = mono_us() / 1000;
+	m_metrics_ms = now_ms + m_conf.metrics_ms;
+	for (size_t i = 0; i < m_ports.size(); i++)
+		port_open(i, now_ms);
+
+	while (!*stop)
+	{
+		int n = epoll_wait(m_epoll, ev, int(kEvents), -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (error)
+				*error = strerror(errno);
+			return false;
+		}
+		m_stats.wakeups++;
+		for (int i = 0; i < n; i++)
+		{
+			uint64_t tag = ev[i].data.u64;
+			if (tag == kTagTimer)
+				tick();
+			else if (tag == kTagOutput)
+			{
+				if (ev[i].events & (EPOLLERR | EPOLLHUP))
+					output_close();
+				else
+					flush();
+			}
+			else if (ev[i].events & EPOLLIN)
+				port_read(size_t(tag), ev[i].events);
+			else
+				port_close(size_t(tag), mono_us() / 1000);
+		}
+		if (m_out_len - m_out_off >= m_conf.batch_size)
+			flush();
+	}
+
+	/* Last records : wait until they are written */
+	if (m_out_fd >= 0)
+		fcntl(m_out_fd, F_SETFL, fcntl(m_out_fd, F_GETFL) & ~O_NONBLOCK);
+	flush();
+	if (!m_conf.metrics.empty())
+		export_metrics(m_conf.metrics.c_str());
+	return true;
+}
+
+/**
+ * @brief Number of ports currently opened
+ */
+size_t Aggregator::ports_open() const noexcept
+{
+	size_t n = 0;
+
+	for (const Port &p : m_ports)
+		n += (p.fd >= 0) ? 1 : 0;
+	return n;
+}
+
+/**
+ * @brief Write all metrics (Prometheus text format)
+ *
+ * @param fp Opened file where metrics are written
+ */
+void Aggregator::write_metrics(FILE *fp) const
+{
+	static const struct { const char *name; size_t off; } counters[] = {
+		{ "wakeups",       offsetof(AggStats, wakeups)       },
+		{ "reads",         offsetof(AggStats, reads)         },
+		{ "bytes_in",      offsetof(AggStats, bytes_in)      },
+		{ "samples",       offsetof(AggStats, samples)       },
+		{ "dropped",       offsetof(AggStats, dropped)       },
+		{ "bytes_out",     offsetof(AggStats, bytes_out)     },
+		{ "writes",        offsetof(AggStats, writes)        },
+		{ "write_stalls",  offsetof(AggStats, write_stalls)  },
+		{ "output_pauses", offsetof(AggStats, output_pauses) },
+		{ "quota_pauses",  offsetof(AggStats, quota_pauses)  },
+		{ "port_errors",   offsetof(AggStats, port_errors)   },
+	};
+	const char *base = reinterpret_cast<const char *>(&m_stats);
+	size_t paused = 0;
+
+	for (const auto &c : counters)
+	{
+		uint64_t v;
+		std::memcpy(&v, base + c.off, sizeof(v));
+		fprintf(fp, "# TYPE trh_agg_%s_total counter\n", c.name);
+		fprintf(fp, "trh_agg_%s_total %llu\n", c.name, (unsigned long long)v);
+	}
+	for (const Port &p : m_ports)
+		paused += p.paused ? 1 : 0;
+	fprintf(fp, "# TYPE trh_agg_ports gauge\ntrh_agg_ports %zu\n", m_ports.size());
+	fprintf(fp, "# TYPE trh_agg_ports_open gauge\ntrh_agg_ports_open %zu\n", ports_open());
+	fprintf(fp, "# TYPE trh_agg_ports_paused gauge\ntrh_agg_ports_paused %zu\n", paused);
+	fprintf(fp, "# TYPE trh_agg_pending_bytes gauge\ntrh_agg_pending_bytes %zu\n",
+	        m_out_len - m_out_off);
+	fprintf(fp, "# TYPE trh_agg_latency_us summary\n");
+	fprintf(fp, "trh_agg_latency_us_sum %llu\ntrh_agg_latency_us_count %llu\n",
+	        (unsigned long long)m_stats.lat_sum_us,
+	        (unsigned long long)m_stats.lat_count);
+	fprintf(fp, "# TYPE trh_agg_latency_us_max gauge\ntrh_agg_latency_us_max %llu\n",
+	        (unsigned long long)m_stats.lat_max_us);
+	fprintf(fp, "# TYPE trh_agg_write_us_max gauge\ntrh_agg_write_us_max %llu\n",
+	        (unsigned long long)m_stats.write_max_us);
+
+	/* Per port counters */
+	fprintf(fp, "# TYPE trh_agg_port_up gauge\n");
+	for (const Port &p : m_ports)
+		fprintf(fp, "trh_agg_port_up{port=\"%s\"} %d\n", p.path.c_str(),
+		        (p.fd >= 0) ? 1 : 0);
+	fprintf(fp, "# TYPE trh_agg_port_bytes_total counter\n");
+	for (const Port &p : m_ports)
+		fprintf(fp, "trh_agg_port_bytes_total{port=\"%s\"} %llu\n",
+		        p.path.c_str(), (unsigned long long)p.bytes);
+	fprintf(fp, "# TYPE trh_agg_port_samples_total counter\n");
+	for (const Port &p : m_ports)
+		fprintf(fp, "trh_agg_port_samples_total{port=\"%s\"} %llu\n",
+		        p.path.c_str(), (unsigned long long)p.parser.stats().samples);
+	fprintf(fp, "# TYPE trh_agg_port_malformed_total counter\n");
+	for (const Port &p : m_ports)
+		fprintf(fp, "trh_agg_port_malformed_total{port=\"%s\"} %llu\n",
+		        p.path.c_str(), (unsigned long long)(p.parser.stats().malformed +
+		                                             p.parser.stats().overlong));
+	fprintf(fp, "# TYPE trh_agg_port_throttled_total counter\n");
+	for (const Port &p : m_ports)
+		fprintf(fp, "trh_agg_port_throttled_total{port=\"%s\"} %llu\n",
+		        p.path.c_str(), (unsigned long long)p.throttled);
+}
+
+/**
+ * @brief Write the metrics into a file (replaced atomically)
+ *
+ * @return bool True on success
+ */
+bool Aggregator::export_metrics(const char *path) const
+{
+	std::string tmp = std::string(path) + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "w");
+	if (!fp)
+		return false;
+	write_metrics(fp);
+	if (fclose(fp) != 0)
+		return false;
+	return rename(tmp.c_str(), path) == 0;
+}
+
+/**
+ * @brief Open a port and add it to the loop (retried later on error)
+ */
+void Aggregator::port_open(size_t idx, uint64_t now_ms)
+{
+	Port &p = m_ports[idx];
+	struct epoll_event ev;
+
+	p.fd = open(p.path.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	/* A tty is set in raw mode, other files (fifo) are read as is */
+	if ((p.fd >= 0) && isatty(p.fd) && !serial_set_baud(p.fd, m_conf.baud))
+	{
+		close(p.fd);
+		p.fd = -1;
+	}
+	if (p.fd < 0)
+	{
+		p.retry_ms = now_ms + m_conf.reopen_ms;
+		return;
+	}
+	p.paused = m_out_paused;
+	p.period = 0;
+	ev.events   = p.paused ? 0u : uint32_t(EPOLLIN);
+	ev.data.u64 = idx;
+	if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, p.fd, &ev) < 0)
+	{
+		close(p.fd);
+		p.fd = -1;
+		p.retry_ms = now_ms + m_conf.reopen_ms;
+	}
+}
+
+/**
+ * @brief Close a port after a hangup or an error, and schedule a reopen
+ */
+void Aggregator::port_close(size_t idx, uint64_t now_ms)
+{
+	Port &p = m_ports[idx];
+
+	if (p.fd < 0)
+		return;
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, p.fd, nullptr);
+	close(p.fd);
+	p.fd       = -1;
+	p.paused   = false;
+	p.retry_ms = now_ms + m_conf.reopen_ms;
+	m_stats.port_errors++;
+}
+
+/**
+ * @brief Remove a port from the loop, or add it again
+ *
+ * A paused port is kept registered without events : a hangup is still
+ * reported, received data wait into the kernel buffer.
+ */
+void Aggregator::port_pause(size_t idx, bool pause)
+{
+	Port &p = m_ports[idx];
+	struct epoll_event ev;
+
+	if ((p.fd < 0) || (p.paused == pause))
+		return;
+	ev.events   = pause ? 0u : uint32_t(EPOLLIN);
+	ev.data.u64 = idx;
+	epoll_ctl(m_epoll, EPOLL_CTL_MOD, p.fd, &ev);
+	p.paused = pause;
+}
+
+/**
+ * @brief Read available data of a port and decode them
+ *
+ * Only one read is done for each event (at most kReadChunk bytes), a busy
+ * port is read again on next epoll_wait() after the other ready ports.
+ *
+ * @param idx    Index of the port
+ * @param events Events reported by epoll
+ */
+void Aggregator::port_read(size_t idx, uint32_t events)
+{
+	Port &p = m_ports[idx];
+
+	/* Paused by a previous event of the same epoll_wait() */
+	if (p.paused)
+		return;
+	ssize_t n = read(p.fd, m_in.data(), m_in.size());
+	if (n <= 0)
+	{
+		/* A tty in raw mode returns 0 when empty (or after a hangup), a
+		 * pty returns EIO when the other side is closed */
+		if ((n < 0) ? ((errno != EAGAIN) && (errno != EINTR)) :
+		              (events & (EPOLLERR | EPOLLHUP)))
+			port_close(idx, mono_us() / 1000);
+		return;
+	}
+	uint64_t stamp = real_ns();
+	uint64_t mono  = mono_us();
+
+	m_stats.reads++;
+	m_stats.bytes_in += uint64_t(n);
+	p.bytes  += uint64_t(n);
+	p.period += size_t(n);
+
+	const char *data = m_in.data();
+	size_t len = size_t(n);
+	while (len)
+	{
+		size_t used;
+		size_t k = p.parser.parse(data, len, m_smp.data(), m_smp.size(), &used);
+		append(idx, m_smp.data(), k, stamp, mono);
+		if (used == 0)
+			break;
+		data += used;
+		len  -= used;
+	}
+
+	/* Back-pressure : port over its quota for this period */
+	if (m_conf.port_quota && (p.period >= m_conf.port_quota))
+	{
+		p.throttled++;
+		m_stats.quota_pauses++;
+		port_pause(idx, true);
+	}
+	/* Back-pressure : output is late, stop reading all ports */
+	if (!m_out_paused && (m_out_len - m_out_off >= m_conf.max_pending))
+	{
+		m_out_paused = true;
+		m_stats.output_pauses++;
+		for (size_t i = 0; i < m_ports.size(); i++)
+			port_pause(i, true);
+	}
+}
+
+/**
+ * @brief Append the records of decoded samples into the output buffer
+ *
+ * @param idx      Index of the port
+ * @param s        Decoded samples
+ * @param n        Number of samples
+ * @param stamp_ns Read time (unix time, ns)
+ * @param read_us  Read time (monotonic, for latency)
+ */
+void Aggregator::append(size_t idx, const Sample *s, size_t n,
+                        uint64_t stamp_ns, uint64_t read_us)
+{
+	const Port &port = m_ports[idx];
+
+	if (n == 0)
+		return;
+	/* Move pending bytes to the start of the buffer when needed */
+	if ((m_out_len + n * kRecordMax > m_out.size()) && m_out_off)
+	{
+		std::memmove(m_out.data(), m_out.data() + m_out_off, m_out_len - m_out_off);
+		m_out_len -= m_out_off;
+		m_out_off  = 0;
+	}
+	if (m_out_count == 0)
+		m_out_first = read_us;
+
+	for (size_t i = 0; i < n; i++, s++)
+	{
+		if (m_out_len + kRecordMax > m_out.size())
+		{
+			m_stats.dropped += n - i;
+			break;
+		}
+		char *p = m_out.data() + m_out_len;
+		p = put_uint(p, stamp_ns);
+		*p++ = ',';
+		p = put_uint(p, idx);
+		*p++ = ',';
+		if (port.parser.has_serial())
+			p = put_serial(p, port.parser.serial());
+		*p++ = ',';
+		if (s->flags & SAMPLE_SEQ)
+			p = put_uint(p, s->seq);
+		*p++ = ',';
+		if (s->flags & SAMPLE_RH)
+			p = put_fixed(p, s->rh);
+		*p++ = ',';
+		if (s->flags & SAMPLE_TEMP)
+			p = put_fixed(p, s->temp);
+		*p++ = ',';
+		if (s->flags & SAMPLE_DEW)
+			p = put_fixed(p, s->dew);
+		*p++ = ',';
+		if (s->flags & SAMPLE_AH)
+			p = put_fixed(p, s->ah);
+		*p++ = ',';
+		if (s->flags & SAMPLE_HI)
+			p = put_fixed(p, s->hi);
+		*p++ = ',';
+		if (s->flags & SAMPLE_PHASE)
+			p = put_uint(p, s->phase);
+		*p++ = ',';
+		p = put_uint(p, s->flags);
+		*p++ = '\n';
+		m_out_len = size_t(p - m_out.data());
+		m_out_count++;
+		m_out_stamp += read_us;
+		m_stats.samples++;
+	}
+}
+
+/**
+ * @brief Periodic job : flush, new quota period, reopen ports, metrics
+ */
+void Aggregator::tick()
+{
+	uint64_t exp;
+	uint64_t now_ms;
+
+	if (read(m_timer, &exp, sizeof(exp)) < 0)
+		return;
+	flush();
+
+	now_ms = mono_us() / 1000;
+	for (size_t i = 0; i < m_ports.size(); i++)
+	{
+		Port &p = m_ports[i];
+		p.period = 0;
+		if (p.fd < 0)
+		{
+			if (now_ms >= p.retry_ms)
+				port_open(i, now_ms);
+		}
+		else if (p.paused && !m_out_paused)
+			port_pause(i, false);
+	}
+	if ((m_out_fd < 0) && !m_out_sock.empty())
+		output_connect();
+
+	if (!m_conf.metrics.empty() && (now_ms >= m_metrics_ms))
+	{
+		export_metrics(m_conf.metrics.c_str());
+		m_metrics_ms = now_ms + m_conf.metrics_ms;
+	}
+}
+
+/**
+ * @brief Write pending records (large writes, stops when output is busy)
+ *
+ * @return bool True when all records have been written
+ */
+bool Aggregator::flush()
+{
+	struct epoll_event ev;
+
+	while (m_out_off < m_out_len)
+	{
+		if (m_out_fd < 0)
+		{
+			m_stats.write_stalls++;
+			return false;
+		}
+		uint64_t t0 = mono_us();
+		const char *p = m_out.data() + m_out_off;
+		size_t len = m_out_len - m_out_off;
+		ssize_t n = m_out_sock.empty() ? write(m_out_fd, p, len) :
+		                                 send(m_out_fd, p, len, MSG_NOSIGNAL);
+		uint64_t dt = mono_us() - t0;
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			m_stats.write_stalls++;
+			if (errno == EAGAIN)
+			{
+				/* Socket is full, continue when writable */
+				if (!m_out_wait)
+				{
+					ev.events   = EPOLLOUT;
+					ev.data.u64 = kTagOutput;
+					epoll_ctl(m_epoll, EPOLL_CTL_MOD, m_out_fd, &ev);
+					m_out_wait = true;
+				}
+			}
+			else if (!m_out_sock.empty())
+				output_close();
+			return false;
+		}
+		m_stats.writes++;
+		m_stats.bytes_out += uint64_t(n);
+		if (dt > m_stats.write_max_us)
+			m_stats.write_max_us = dt;
+		m_out_off += size_t(n);
+	}
+
+	/* Everything written : update latency of the records */
+	if (m_out_count)
+	{
+		uint64_t now = mono_us();
+		m_stats.lat_count  += m_out_count;
+		m_stats.lat_sum_us += m_out_count * now - m_out_stamp;
+		if (now - m_out_first > m_stats.lat_max_us)
+			m_stats.lat_max_us = now - m_out_first;
+	}
+	m_out_off   = 0;
+	m_out_len   = 0;
+	m_out_count = 0;
+	m_out_stamp = 0;
+
+	if (m_out_wait)
+	{
+		ev.events   = 0;
+		ev.data.u64 = kTagOutput;
+		epoll_ctl(m_epoll, EPOLL_CTL_MOD, m_out_fd, &ev);
+		m_out_wait = false;
+	}
+	/* Output is ready again, resume ports (except those over quota) */
+	if (m_out_paused)
+	{
+		m_out_paused = false;
+		for (size_t i = 0; i < m_ports.size(); i++)
+		{
+			if (!m_conf.port_quota || (m_ports[i].period < m_conf.port_quota))
+				port_pause(i, false);
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Connect the output socket (non-blocking)
+ *
+ * @return bool True on success
+ */
+bool Aggregator::output_connect()
+{
+	struct sockaddr_un addr;
+	struct epoll_event ev;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	std::memcpy(addr.sun_path, m_out_sock.c_str(), m_out_sock.size());
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		return false;
+	}
+	m_out_fd = fd;
+	if (m_epoll >= 0)
+	{
+		ev.events   = 0;
+		ev.data.u64 = kTagOutput;
+		epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+	}
+	return true;
+}
+
+/**
+ * @brief Close the output socket after an error (reconnected by tick)
+ */
+void Aggregator::output_close()
+{
+	if ((m_out_fd < 0) || m_out_sock.empty())
+		return;
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, m_out_fd, nullptr);
+	close(m_out_fd);
+	m_out_fd   = -1;
+	m_out_wait = false;
+}
+
+} // namespace trh
+/* EOF */
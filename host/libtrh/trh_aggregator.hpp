@@ -0,0 +1,138 @@
+/**
+ * @file  trh_aggregator.hpp
+ * @brief Multi-port aggregator : one epoll loop for many serial streams
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_AGGREGATOR_HPP
+#define TRH_AGGREGATOR_HPP
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "trh_parser.hpp"
+
+namespace trh {
+
+struct AggConfig
+{
+	unsigned baud        = 9600;
+	size_t   batch_size  = 256 * 1024;      /* Write when this is pending      */
+	unsigned flush_ms    = 100;             /* Max delay before a write        */
+	size_t   max_pending = 8 * 1024 * 1024; /* Ports are paused above          */
+	size_t   port_quota  = 0;               /* Bytes per port per flush period */
+	unsigned reopen_ms   = 1000;            /* Delay before reopening a port   */
+	std::string metrics;                    /* Metrics file (Prometheus text)  */
+	unsigned metrics_ms  = 10000;           /* Export period of the metrics    */
+};
+
+struct AggStats
+{
+	uint64_t wakeups;        /* Number of epoll_wait() returns              */
+	uint64_t reads;          /* Number of read() on ports                   */
+	uint64_t bytes_in;       /* Bytes received from all ports               */
+	uint64_t samples;        /* Decoded samples (records)                   */
+	uint64_t dropped;        /* Records lost (output buffer full)           */
+	uint64_t bytes_out;      /* Bytes written to the output                 */
+	uint64_t writes;         /* Number of write() on the output             */
+	uint64_t write_stalls;   /* Output not ready (EAGAIN, reconnection)     */
+	uint64_t output_pauses;  /* Ports paused because output is late         */
+	uint64_t quota_pauses;   /* Ports paused because over their quota       */
+	uint64_t port_errors;    /* Port closed (hangup, read error)            */
+	uint64_t lat_count;      /* Latency : from read() to output write       */
+	uint64_t lat_sum_us;
+	uint64_t lat_max_us;
+	uint64_t write_max_us;   /* Longest write() of a batch                  */
+};
+
+/**
+ * Reads many ports (tty or pty) with one epoll loop, decodes the sample
+ * lines with a StreamParser per port and appends one CSV record per sample
+ * ("time_ns,port,sn,seq,rh,temp,dew,ah,hi,phase,flags") into a single output
+ * buffer. The buffer is written with large writes, when batch_size bytes are
+ * pending or after flush_ms. Memory is allocated once, when ports are added
+ * and when the loop starts.
+ *
+ * Back-pressure : a port that has read more than port_quota bytes during a
+ * flush period is removed from the loop until the next period (its data wait
+ * into the kernel tty buffer), and all ports are paused while the output
+ * has more than max_pending bytes late.
+ */
+class Aggregator
+{
+public:
+	explicit Aggregator(const AggConfig &conf);
+	~Aggregator();
+	Aggregator(const Aggregator &) = delete;
+	Aggregator &operator=(const Aggregator &) = delete;
+
+	void   add_port(const char *path);
+	bool   output_file(const char *path, std::string *error);
+	bool   output_socket(const char *path, std::string *error);
+	bool   run(volatile sig_atomic_t *stop, std::string *error);
+
+	void   write_metrics(FILE *fp) const;
+	bool   export_metrics(const char *path) const;
+	size_t ports() const noexcept { return m_ports.size(); }
+	size_t ports_open() const noexcept;
+	const AggStats &stats() const noexcept { return m_stats; }
+
+private:
+	struct Port
+	{
+		std::string  path;
+		int          fd;
+		bool         paused;      /* Removed from epoll (back-pressure)   */
+		uint64_t     retry_ms;    /* Next open attempt (when fd < 0)      */
+		size_t       period;      /* Bytes read during this flush period  */
+		uint64_t     bytes;
+		uint64_t     throttled;
+		StreamParser parser;
+	};
+
+	void port_open(size_t idx, uint64_t now_ms);
+	void port_close(size_t idx, uint64_t now_ms);
+	void port_read(size_t idx, uint32_t events);
+	void port_pause(size_t idx, bool pause);
+	void append(size_t idx, const Sample *s, size_t n, uint64_t stamp_ns,
+	            uint64_t read_us);
+	void tick();
+	bool flush();
+	bool output_connect();
+	void output_close();
+
+	AggConfig           m_conf;
+	std::vector<Port>   m_ports;
+	std::vector<char>   m_in;
+	std::vector<Sample> m_smp;
+	std::vector<char>   m_out;
+	size_t              m_out_off;    /* First byte not yet written          */
+	size_t              m_out_len;    /* End of records                      */
+	uint64_t            m_out_count;  /* Records into the buffer             */
+	uint64_t            m_out_stamp;  /* Sum of their read time (us)         */
+	uint64_t            m_out_first;  /* Read time of the oldest one (us)    */
+	bool                m_out_paused;
+	bool                m_out_wait;   /* Waiting for EPOLLOUT                */
+	int                 m_out_fd;
+	std::string         m_out_sock;
+	int                 m_epoll;
+	int                 m_timer;
+	uint64_t            m_metrics_ms; /* Next export of the metrics          */
+	AggStats            m_stats;
+};
+
+} // namespace trh
+
+#endif
+/* EOF */
@@ -0,0 +1,177 @@
+/**
+ * @file  trh_boot.cpp
+ * @brief Client of the serial bootloader protocol (see firmware/src/boot.h)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cstring>
+#include "trh_boot.hpp"
+#include "trh_serial.hpp"
+
+namespace trh {
+
+/**
+ * @brief Compute CRC-16/Modbus (poly 0xA001 reflected, init 0xFFFF)
+ *
+ * @param p   Pointer to data
+ * @param len Number of bytes
+ * @param crc Initial value, or result of the previous block
+ */
+uint16_t crc16_modbus(const uint8_t *p, size_t len, uint16_t crc) noexcept
+{
+	while (len--)
+	{
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc & 1) ? uint16_t((crc >> 1) ^ 0xA001) : uint16_t(crc >> 1);
+	}
+	return crc;
+}
+
+BootClient::BootClient(int fd, int timeout_ms, int retries) noexcept
+	: m_fd(fd), m_timeout(timeout_ms), m_retries(retries), m_resent(0)
+{
+}
+
+/**
+ * @brief Get the version of the bootloader and the flash layout
+ */
+int BootClient::info(BootInfo *out)
+{
+	uint8_t rsp[boot::kMaxData];
+	size_t len = sizeof(rsp);
+	int st = request(boot::kCmdInfo, 0, nullptr, 0, rsp, &len, m_timeout);
+	if (st != boot::kOk)
+		return st;
+	if (len < 6)
+		return boot::kErrParam;
+	out->version  = rsp[0];
+	out->block    = rsp[1];
+	out->app_addr = uint32_t(rsp[2] | (rsp[3] << 8));
+	out->app_size = uint32_t(rsp[4] | (rsp[5] << 8));
+	return st;
+}
+
+/**
+ * @brief Erase the whole application area (the application becomes invalid)
+ */
+int BootClient::erase()
+{
+	size_t len = 0;
+	/* Erasing all rows takes some time */
+	return request(boot::kCmdErase, 0, nullptr, 0, nullptr, &len, m_timeout * 10);
+}
+
+/**
+ * @brief Write one block (a flash page) at an offset into application area
+ */
+int BootClient::write(uint16_t offset, const uint8_t *data, size_t len)
+{
+	size_t rlen = 0;
+	if (len > boot::kMaxData)
+		return boot::kErrParam;
+	return request(boot::kCmdWrite, offset, data, len, nullptr, &rlen, m_timeout);
+}
+
+/**
+ * @brief Check the CRC of the image, the application is valid on success
+ */
+int BootClient::verify(uint16_t size, uint16_t crc)
+{
+	const uint8_t arg[4] = { uint8_t(size), uint8_t(size >> 8),
+	                         uint8_t(crc),  uint8_t(crc >> 8) };
+	size_t rlen = 0;
+	return request(boot::kCmdVerify, 0, arg, sizeof(arg), nullptr, &rlen, m_timeout);
+}
+
+/**
+ * @brief Leave the bootloader and start the application
+ */
+int BootClient::run()
+{
+	size_t rlen = 0;
+	return request(boot::kCmdRun, 0, nullptr, 0, nullptr, &rlen, m_timeout);
+}
+
+/**
+ * @brief Send a request, and send it again if the response is not valid
+ */
+int BootClient::request(uint8_t cmd, uint16_t addr, const uint8_t *data,
+                        size_t len, uint8_t *rsp, size_t *rsp_len, int timeout_ms)
+{
+	uint8_t frame[6 + boot::kMaxData + 2];
+
+	frame[0] = boot::kSofReq;
+	frame[1] = cmd;
+	frame[2] = uint8_t(len);
+	frame[3] = uint8_t(addr);
+	frame[4] = uint8_t(addr >> 8);
+	if (len)
+		memcpy(&frame[5], data, len);
+	uint16_t crc = crc16_modbus(&frame[1], 4 + len);
+	frame[5 + len] = uint8_t(crc);
+	frame[6 + len] = uint8_t(crc >> 8);
+
+	int st = kBootTimeout;
+	for (int i = 0; i <= m_retries; i++)
+	{
+		if (i)
+			m_resent++;
+		size_t rlen = *rsp_len;
+		st = exchange(frame, 7 + len, rsp, &rlen, timeout_ms);
+		if ((st != kBootTimeout) && (st != boot::kErrCrc))
+		{
+			*rsp_len = rlen;
+			break;
+		}
+	}
+	return st;
+}
+
+/**
+ * @brief Send one frame and wait for the response
+ */
+int BootClient::exchange(const uint8_t *frame, size_t len, uint8_t *rsp,
+                         size_t *rsp_len, int timeout_ms)
+{
+	uint8_t hdr[2], data[boot::kMaxData + 2];
+	uint8_t c;
+
+	if (!serial_write(m_fd, frame, len))
+		return kBootTimeout;
+	/* Skip anything received before start of response */
+	do {
+		if (serial_read(m_fd, &c, 1, timeout_ms) != 1)
+			return kBootTimeout;
+	} while (c != boot::kSofRsp);
+
+	if (serial_read(m_fd, hdr, 2, timeout_ms) != 2)
+		return kBootTimeout;
+	size_t dlen = hdr[1];
+	if ((dlen > boot::kMaxData) ||
+	    (serial_read(m_fd, data, dlen + 2, timeout_ms) != int(dlen + 2)))
+		return kBootTimeout;
+	uint16_t crc = crc16_modbus(hdr, 2);
+	crc = crc16_modbus(data, dlen, crc);
+	if ((data[dlen] != uint8_t(crc)) || (data[dlen + 1] != uint8_t(crc >> 8)))
+		return kBootTimeout;
+
+	if (dlen > *rsp_len)
+		dlen = *rsp_len;
+	if (dlen)
+		memcpy(rsp, data, dlen);
+	*rsp_len = dlen;
+	return hdr[0];
+}
+
+} // namespace trh
+/* EOF */
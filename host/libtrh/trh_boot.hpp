@@ -0,0 +1,88 @@
+/**
+ * @file  trh_boot.hpp
+ * @brief Client of the serial bootloader protocol (see firmware/src/boot.h)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_BOOT_HPP
+#define TRH_BOOT_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace trh {
+
+/* Protocol constants, must match firmware/src/boot.h */
+namespace boot {
+constexpr uint8_t kSofReq    = 0xA5;
+constexpr uint8_t kSofRsp    = 0x5A;
+constexpr uint8_t kCmdInfo   = 0x01;
+constexpr uint8_t kCmdErase  = 0x02;
+constexpr uint8_t kCmdWrite  = 0x03;
+constexpr uint8_t kCmdVerify = 0x04;
+constexpr uint8_t kCmdRun    = 0x05;
+constexpr uint8_t kOk        = 0x00;
+constexpr uint8_t kErrCrc    = 0x01;
+constexpr uint8_t kErrParam  = 0x02;
+constexpr uint8_t kErrVerify = 0x03;
+constexpr uint8_t kErrFlash  = 0x04;
+constexpr size_t  kMaxData   = 64;
+constexpr unsigned kBaud     = 230400;
+} // namespace boot
+
+/* Returned by BootClient requests when no valid response is received */
+constexpr int kBootTimeout = -1;
+
+struct BootInfo
+{
+	unsigned version;
+	unsigned block;     /* Number of bytes per WRITE request (flash page) */
+	uint32_t app_addr;  /* Flash address of the application             */
+	uint32_t app_size;  /* Max size of the application                  */
+};
+
+uint16_t crc16_modbus(const uint8_t *p, size_t len, uint16_t crc = 0xFFFF) noexcept;
+
+/**
+ * Request/response exchanges with the bootloader over an opened port. Each
+ * request is sent again (up to `retries` times) when the response is lost
+ * or corrupted, or when the bootloader reports a CRC error. Requests return
+ * the status of the response (boot::kOk, boot::kErrXX) or kBootTimeout.
+ */
+class BootClient
+{
+public:
+	explicit BootClient(int fd, int timeout_ms = 200, int retries = 3) noexcept;
+
+	int info(BootInfo *out);
+	int erase();
+	int write(uint16_t offset, const uint8_t *data, size_t len);
+	int verify(uint16_t size, uint16_t crc);
+	int run();
+
+	unsigned resent() const noexcept { return m_resent; }
+
+private:
+	int request(uint8_t cmd, uint16_t addr, const uint8_t *data, size_t len,
+	            uint8_t *rsp, size_t *rsp_len, int timeout_ms);
+	int exchange(const uint8_t *frame, size_t len, uint8_t *rsp,
+	             size_t *rsp_len, int timeout_ms);
+
+	int      m_fd;
+	int      m_timeout;
+	int      m_retries;
+	unsigned m_resent;
+};
+
+} // namespace trh
+
+#endif
+/* EOF */
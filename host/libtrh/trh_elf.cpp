@@ -0,0 +1,158 @@
+/**
+ * @file  trh_elf.cpp
+ * @brief Symbol table of a firmware ELF file (32 bits, little endian)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "trh_elf.hpp"
+
+namespace trh {
+
+namespace {
+
+constexpr uint32_t kShtSymtab = 2;
+constexpr uint8_t  kSttObject = 1;
+constexpr uint8_t  kSttFunc   = 2;
+
+inline uint16_t rd16(const uint8_t *p) { return uint16_t(p[0] | (p[1] << 8)); }
+inline uint32_t rd32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+	       (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+bool fail(std::string *error, const char *msg)
+{
+	if (error)
+		*error = msg;
+	return false;
+}
+
+} // namespace
+
+/**
+ * @brief Load functions and objects from the symbol table of an ELF file
+ *
+ * @param path  Name of the ELF file
+ * @param error Optional string where an error message is stored
+ * @return bool True on success
+ */
+bool SymbolTable::load(const char *path, std::string *error)
+{
+	std::vector<uint8_t> f;
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return fail(error, "cannot open file");
+	uint8_t buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		f.insert(f.end(), buf, buf + n);
+	fclose(fp);
+
+	/* ELF32, little endian */
+	if ((f.size() < 52) || memcmp(f.data(), "\x7f" "ELF", 4) ||
+	    (f[4] != 1) || (f[5] != 1))
+		return fail(error, "not an ELF32 little endian file");
+
+	uint32_t shoff     = rd32(&f[32]);
+	uint16_t shentsize = rd16(&f[46]);
+	uint16_t shnum     = rd16(&f[48]);
+	if ((shentsize < 40) || (uint64_t(shoff) + uint64_t(shnum) * shentsize > f.size()))
+		return fail(error, "invalid section table");
+
+	m_syms.clear();
+	for (uint16_t i = 0; i < shnum; i++)
+	{
+		const uint8_t *sh = &f[shoff + size_t(i) * shentsize];
+		if (rd32(sh + 4) != kShtSymtab)
+			continue;
+		uint32_t off   = rd32(sh + 16);
+		uint32_t size  = rd32(sh + 20);
+		uint32_t link  = rd32(sh + 24);
+		uint32_t esize = rd32(sh + 36);
+		if ((link >= shnum) || (esize < 16) || (uint64_t(off) + size > f.size()))
+			return fail(error, "invalid symbol table");
+		const uint8_t *strh = &f[shoff + size_t(link) * shentsize];
+		uint32_t stroff  = rd32(strh + 16);
+		uint32_t strsize = rd32(strh + 20);
+		if (uint64_t(stroff) + strsize > f.size())
+			return fail(error, "invalid string table");
+
+		for (uint32_t s = 0; s + esize <= size; s += esize)
+		{
+			const uint8_t *sym = &f[off + s];
+			uint8_t type = sym[12] & 0x0F;
+			uint32_t name = rd32(sym);
+			if (((type != kSttFunc) && (type != kSttObject)) || (name >= strsize))
+				continue;
+			const char *str = reinterpret_cast<const char *>(&f[stroff + name]);
+			/* Thumb functions have bit 0 set */
+			uint32_t addr = rd32(sym + 4);
+			if (type == kSttFunc)
+				addr &= ~1u;
+			m_syms.push_back({ addr, rd32(sym + 8),
+			                   std::string(str, strnlen(str, strsize - name)) });
+		}
+	}
+	if (m_syms.empty())
+		return fail(error, "no symbol found (stripped file ?)");
+
+	std::sort(m_syms.begin(), m_syms.end(),
+	          [](const Symbol &a, const Symbol &b) { return a.addr < b.addr; });
+	return true;
+}
+
+/**
+ * @brief Find the symbol that contains an address
+ *
+ * When the size of the symbol is unknown (assembly labels), the closest
+ * symbol before the address is used.
+ *
+ * @param addr Address to search
+ * @return Symbol* Pointer to the symbol, or null if none found
+ */
+const Symbol *SymbolTable::find(uint32_t addr) const noexcept
+{
+	auto it = std::upper_bound(m_syms.begin(), m_syms.end(), addr,
+	          [](uint32_t a, const Symbol &s) { return a < s.addr; });
+	if (it == m_syms.begin())
+		return nullptr;
+	--it;
+	if ((it->size != 0) && (addr - it->addr >= it->size))
+		return nullptr;
+	return &*it;
+}
+
+/**
+ * @brief Convert an address into a "symbol+offset" string
+ *
+ * @param addr Address to convert
+ * @return string Name of the symbol with offset, or the hex address
+ */
+std::string SymbolTable::describe(uint32_t addr) const
+{
+	char buf[32];
+	const Symbol *s = find(addr);
+	if (!s)
+	{
+		snprintf(buf, sizeof(buf), "0x%08x", addr);
+		return buf;
+	}
+	snprintf(buf, sizeof(buf), "+0x%x", addr - s->addr);
+	return s->name + buf;
+}
+
+} // namespace trh
+/* EOF */
@@ -0,0 +1,51 @@
+/**
+ * @file  trh_elf.hpp
+ * @brief Symbol table of a firmware ELF file (32 bits, little endian)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_ELF_HPP
+#define TRH_ELF_HPP
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace trh {
+
+struct Symbol
+{
+	uint32_t    addr;
+	uint32_t    size;
+	std::string name;
+};
+
+/**
+ * Functions and objects of an ELF file (trh7021.elf), sorted by address, to
+ * convert raw addresses (from a trace or a fault) into "symbol+offset".
+ */
+class SymbolTable
+{
+public:
+	bool load(const char *path, std::string *error = nullptr);
+
+	const Symbol *find(uint32_t addr) const noexcept;
+	std::string   describe(uint32_t addr) const;
+	size_t        size() const noexcept { return m_syms.size(); }
+
+private:
+	std::vector<Symbol> m_syms;
+};
+
+} // namespace trh
+
+#endif
+/* EOF */
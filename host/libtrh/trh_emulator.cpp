@@ -0,0 +1,240 @@
+/**
+ * @file  trh_emulator.cpp
+ * @brief Emulation of the serial output of a pmod-trh board
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cmath>
+#include <cstring>
+#include "trh_emulator.hpp"
+
+namespace trh {
+
+namespace {
+
+const char kBanner[] = "PMOD-TRH: Started\r\n";
+
+inline char *put_str(char *p, const char *s)
+{
+	size_t n = std::strlen(s);
+	std::memcpy(p, s, n);
+	return p + n;
+}
+
+/**
+ * @brief Write an unsigned decimal value (as uart_putdec)
+ */
+inline char *put_dec(char *p, uint32_t v)
+{
+	char tmp[10];
+	int n = 0;
+
+	do
+	{
+		tmp[n++] = char('0' + (v % 10));
+		v /= 10;
+	} while (v);
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/**
+ * @brief Write a value in 1/100 unit "-12,05" (as print_hundredths)
+ */
+inline char *put_fixed(char *p, int32_t v)
+{
+	uint32_t u = (v < 0) ? uint32_t(-v) : uint32_t(v);
+
+	if (v < 0)
+		*p++ = '-';
+	p = put_dec(p, u / 100);
+	*p++ = ',';
+	*p++ = char('0' + (u % 100) / 10);
+	*p++ = char('0' + (u % 10));
+	return p;
+}
+
+inline int32_t hundredths(double v)
+{
+	return int32_t(std::lround(v * 100.0));
+}
+
+} // namespace
+
+/**
+ * @brief Create a device
+ *
+ * @param serial  Serial number of the sensor (sent after the first sample)
+ * @param seed    Seed of the random generator (values, faults)
+ * @param metrics True to send derived values (METRICS_OUTPUT firmware)
+ */
+DeviceEmulator::DeviceEmulator(uint64_t serial, uint32_t seed, bool metrics) noexcept
+	: m_serial(serial), m_seed(seed ? seed : 1), m_metrics(metrics),
+	  m_first(true), m_seq(0), m_rh(0), m_temp(0)
+{
+	m_rh   = int32_t(3000 + rand() % 4000);
+	m_temp = int32_t(1500 + rand() % 1500);
+}
+
+/**
+ * @brief Output of the board after reset (banner)
+ *
+ * @param buf Buffer where bytes are written (at least kMaxOutput)
+ * @return Number of bytes
+ */
+size_t DeviceEmulator::start(char *buf) noexcept
+{
+	m_first = true;
+	m_seq   = 0;
+	return banner(buf);
+}
+
+/**
+ * @brief Output of the board for the next sample period
+ *
+ * Usually one sample line. After a reset the first line is followed by the
+ * sensor informations (as the deferred boot_info job).
+ *
+ * @param buf    Buffer where bytes are written (at least kMaxOutput)
+ * @param faults Probability of each fault
+ * @return Number of bytes
+ */
+size_t DeviceEmulator::sample(char *buf, const EmuFaults &faults) noexcept
+{
+	bool err_rh = false, err_temp = false;
+	size_t len;
+
+	/* Slow random walk of values */
+	m_rh   += int32_t(rand() % 41) - 20;
+	m_temp += int32_t(rand() % 21) - 10;
+	if (m_rh < 500)
+		m_rh = 500;
+	if (m_rh > 9900)
+		m_rh = 9900;
+	if (m_temp < -3000)
+		m_temp = -3000;
+	if (m_temp > 6000)
+		m_temp = 6000;
+
+	if ((faults.error > 0) && (uniform() < faults.error))
+	{
+		uint32_t r = rand() % 3;
+		err_rh   = (r != 1);
+		err_temp = (r != 0);
+	}
+	m_seq++;
+	len = line(buf, err_rh, err_temp);
+
+	/* UART noise : one bit flipped into the line (CRLF excluded) */
+	if ((faults.noise > 0) && (uniform() < faults.noise))
+		buf[rand() % (len - 2)] ^= char(1u << (rand() % 8));
+
+	/* Reset : the line is cut, the board starts again */
+	if ((faults.reset > 0) && (uniform() < faults.reset))
+	{
+		len  = rand() % (len - 1);
+		len += start(buf + len);
+		m_seq++;
+		len += line(buf + len, false, false);
+	}
+
+	if (m_first)
+	{
+		len += info(buf + len);
+		m_first = false;
+	}
+	return len;
+}
+
+uint32_t DeviceEmulator::rand() noexcept
+{
+	/* xorshift32 */
+	m_seed ^= m_seed << 13;
+	m_seed ^= m_seed >> 17;
+	m_seed ^= m_seed << 5;
+	return m_seed;
+}
+
+double DeviceEmulator::uniform() noexcept
+{
+	return (rand() >> 8) / double(1u << 24);
+}
+
+size_t DeviceEmulator::banner(char *buf) noexcept
+{
+	std::memcpy(buf, kBanner, sizeof(kBanner) - 1);
+	return sizeof(kBanner) - 1;
+}
+
+/**
+ * @brief Write one sample line (as print_sample)
+ */
+size_t DeviceEmulator::line(char *buf, bool err_rh, bool err_temp) noexcept
+{
+	char *p = buf;
+
+	p = put_str(p, "RH=");
+	p = err_rh ? put_str(p, "ERROR") : put_fixed(p, m_rh);
+	p = put_str(p, " TEMP=");
+	p = err_temp ? put_str(p, "ERROR") : put_fixed(p, m_temp);
+	if (m_metrics && !err_rh && !err_temp)
+	{
+		/* Magnus formula, and NWS heat index (Rothfusz above 26.7 C) */
+		double t  = m_temp / 100.0;
+		double rh = m_rh / 100.0;
+		double g  = std::log(rh / 100.0) + (17.62 * t) / (243.12 + t);
+		double es = 6.112 * std::exp((17.62 * t) / (243.12 + t));
+		double f  = t * 1.8 + 32.0;
+		double hi = 0.5 * (f + 61.0 + (f - 68.0) * 1.2 + rh * 0.094);
+		if (hi >= 80.0)
+			hi = -42.379 + 2.04901523 * f + 10.14333127 * rh -
+			     0.22475541 * f * rh - 0.00683783 * f * f -
+			     0.05481717 * rh * rh + 0.00122874 * f * f * rh +
+			     0.00085282 * f * rh * rh - 0.00000199 * f * f * rh * rh;
+		p = put_str(p, " DEW=");
+		p = put_fixed(p, hundredths(243.12 * g / (17.62 - g)));
+		p = put_str(p, " AH=");
+		p = put_fixed(p, hundredths(216.74 * es * rh / 100.0 / (273.15 + t)));
+		p = put_str(p, " HI=");
+		p = put_fixed(p, hundredths((hi - 32.0) / 1.8));
+	}
+	p = put_str(p, " SEQ=");
+	p = put_dec(p, m_seq);
+	p = put_str(p, " PHASE=");
+	p = put_dec(p, 20 + rand() % 20);
+	p = put_str(p, "\r\n");
+	return size_t(p - buf);
+}
+
+/**
+ * @brief Write the sensor informations (as boot_info)
+ */
+size_t DeviceEmulator::info(char *buf) noexcept
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char *p = buf;
+
+	p = put_str(p, " * Si7021 serial number ");
+	for (int i = 60; i >= 0; i -= 4)
+		*p++ = hex[(m_serial >> i) & 0xF];
+	p = put_str(p, "\r\nTEMP: ");
+	/* Sent with uart_putdec() : a negative value is shown as unsigned */
+	p = put_dec(p, uint32_t(m_temp));
+	p = put_str(p, "\r\n * Boot to first sample ");
+	p = put_dec(p, 30000 + rand() % 2000);
+	p = put_str(p, " us\r\n");
+	return size_t(p - buf);
+}
+
+} // namespace trh
+/* EOF */
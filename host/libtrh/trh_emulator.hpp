@@ -0,0 +1,71 @@
+/**
+ * @file  trh_emulator.hpp
+ * @brief Emulation of the serial output of a pmod-trh board
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_EMULATOR_HPP
+#define TRH_EMULATOR_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace trh {
+
+/* Probability (per sample line) of each injected fault */
+struct EmuFaults
+{
+	double error = 0;  /* Sensor error : "RH=ERROR" and/or "TEMP=ERROR"     */
+	double noise = 0;  /* One bit flipped into the line (UART noise)        */
+	double reset = 0;  /* Line cut by a reset, then banner and SEQ=1 again  */
+};
+
+/**
+ * Produces the text output of one board, byte for byte as main.c sends it
+ * (ASCII mode, TEXT format) : banner, first sample, sensor informations,
+ * then one line per sample. Values follow a slow random walk, derived
+ * values (DEW, AH, HI) are computed in floating point and may differ from
+ * the firmware by 0.01.
+ */
+class DeviceEmulator
+{
+public:
+	/* Max number of bytes produced by one call */
+	static constexpr size_t kMaxOutput = 512;
+
+	DeviceEmulator(uint64_t serial, uint32_t seed, bool metrics = true) noexcept;
+
+	size_t start(char *buf) noexcept;
+	size_t sample(char *buf, const EmuFaults &faults) noexcept;
+
+	uint32_t seq()    const noexcept { return m_seq; }
+	uint64_t serial() const noexcept { return m_serial; }
+
+private:
+	uint32_t rand() noexcept;
+	double   uniform() noexcept;
+	size_t   banner(char *buf) noexcept;
+	size_t   line(char *buf, bool err_rh, bool err_temp) noexcept;
+	size_t   info(char *buf) noexcept;
+
+	uint64_t m_serial;
+	uint32_t m_seed;
+	bool     m_metrics;
+	bool     m_first;   /* Next sample is the first one after reset */
+	uint32_t m_seq;
+	int32_t  m_rh;      /* Current values (1/100 unit) */
+	int32_t  m_temp;
+};
+
+} // namespace trh
+
+#endif
+/* EOF */
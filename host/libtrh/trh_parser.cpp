@@ -0,0 +1,585 @@
+/**
+ * @file  trh_parser.cpp
+ * @brief Incremental, allocation-free parser for the pmod-trh output stream
+ *
+ * Input is processed by windows of up to 1024 bytes. For each window, bit
+ * masks of the interesting characters (LF, space and '=') are computed with
+ * SIMD compares (SSE2/AVX2 on x86, NEON on ARM, scalar otherwise). Lines and
+ * fields are then found by scanning bits of these masks, only the values are
+ * decoded byte per byte.
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "trh_parser.hpp"
+
+namespace trh {
+
+namespace {
+
+constexpr size_t kBlock  = 64;
+constexpr size_t kBlocks = 16;
+constexpr size_t kWindow = kBlock * kBlocks;
+
+const char kSerialPrefix[] = " * Si7021 serial number ";
+
+struct Masks
+{
+	uint64_t nl[kBlocks];
+	uint64_t sp[kBlocks];
+	uint64_t eq[kBlocks];
+};
+
+#if defined(__ARM_NEON)
+/**
+ * @brief Convert a NEON compare result (0x00/0xFF bytes) into a 16 bits mask
+ */
+inline uint64_t neon_movemask(uint8x16_t v)
+{
+	static const uint8_t w[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+	                               1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t m = vandq_u8(v, vld1q_u8(w));
+	uint64_t lo = vaddv_u8(vget_low_u8(m));
+	uint64_t hi = vaddv_u8(vget_high_u8(m));
+	return lo | (hi << 8);
+}
+#endif
+
+/**
+ * @brief Compute the character masks of one full 64 bytes block
+ */
+inline void block_masks(const char *p, uint64_t *nl, uint64_t *sp, uint64_t *eq)
+{
+#if defined(__AVX2__)
+	const __m256i vnl = _mm256_set1_epi8('\n');
+	const __m256i vsp = _mm256_set1_epi8(' ');
+	const __m256i veq = _mm256_set1_epi8('=');
+	__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+	__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+	*nl = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, vnl))) |
+	      (uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, vnl)))) << 32);
+	*sp = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, vsp))) |
+	      (uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, vsp)))) << 32);
+	*eq = uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, veq))) |
+	      (uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, veq)))) << 32);
+#elif defined(__SSE2__)
+	const __m128i vnl = _mm_set1_epi8('\n');
+	const __m128i vsp = _mm_set1_epi8(' ');
+	const __m128i veq = _mm_set1_epi8('=');
+	uint64_t n = 0, s = 0, e = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+		n |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vnl)))) << (16 * i);
+		s |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vsp)))) << (16 * i);
+		e |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, veq)))) << (16 * i);
+	}
+	*nl = n;
+	*sp = s;
+	*eq = e;
+#elif defined(__ARM_NEON)
+	uint64_t n = 0, s = 0, e = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + 16 * i));
+		n |= neon_movemask(vceqq_u8(v, vdupq_n_u8('\n'))) << (16 * i);
+		s |= neon_movemask(vceqq_u8(v, vdupq_n_u8(' ')))  << (16 * i);
+		e |= neon_movemask(vceqq_u8(v, vdupq_n_u8('=')))  << (16 * i);
+	}
+	*nl = n;
+	*sp = s;
+	*eq = e;
+#else
+	uint64_t n = 0, s = 0, e = 0;
+	for (size_t i = 0; i < kBlock; i++)
+	{
+		n |= uint64_t(p[i] == '\n') << i;
+		s |= uint64_t(p[i] == ' ')  << i;
+		e |= uint64_t(p[i] == '=')  << i;
+	}
+	*nl = n;
+	*sp = s;
+	*eq = e;
+#endif
+}
+
+/**
+ * @brief Compute the character masks of a partial block (scalar)
+ */
+inline void tail_masks(const char *p, size_t len, uint64_t *nl, uint64_t *sp,
+                       uint64_t *eq)
+{
+	uint64_t n = 0, s = 0, e = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		n |= uint64_t(p[i] == '\n') << i;
+		s |= uint64_t(p[i] == ' ')  << i;
+		e |= uint64_t(p[i] == '=')  << i;
+	}
+	*nl = n;
+	*sp = s;
+	*eq = e;
+}
+
+/**
+ * @brief Compute the masks for a window of up to kWindow bytes
+ */
+inline void window_masks(const char *p, size_t len, Masks *m)
+{
+	size_t nblk = (len + kBlock - 1) / kBlock;
+	size_t i;
+
+	for (i = 0; (i + 1) * kBlock <= len; i++)
+		block_masks(p + i * kBlock, &m->nl[i], &m->sp[i], &m->eq[i]);
+	if (i < nblk)
+		tail_masks(p + i * kBlock, len - i * kBlock, &m->nl[i], &m->sp[i], &m->eq[i]);
+}
+
+/**
+ * @brief Find the first set bit in [from, to[ of a mask array
+ *
+ * @return Position of the bit, or "to" if none
+ */
+inline size_t next_bit(const uint64_t *m, size_t from, size_t to)
+{
+	while (from < to)
+	{
+		size_t   w    = from / 64;
+		uint64_t bits = m[w] & (~uint64_t(0) << (from % 64));
+		if (bits)
+		{
+			size_t pos = w * 64 + size_t(__builtin_ctzll(bits));
+			return (pos < to) ? pos : to;
+		}
+		from = (w + 1) * 64;
+	}
+	return to;
+}
+
+/**
+ * @brief Decode a fixed point value "[-]int[,frac]" into 1/100 unit
+ *
+ * The firmware sends two fractional digits, one is accepted as tenths and
+ * more than two are rejected (not a value of the firmware).
+ */
+inline bool parse_fixed(const char *s, const char *e, int32_t *v)
+{
+	bool neg = false;
+	int32_t ip = 0, fp = 0;
+	const char *f;
+
+	if ((s < e) && (*s == '-'))
+	{
+		neg = true;
+		s++;
+	}
+	if (s == e)
+		return false;
+	for (; (s < e) && (*s >= '0') && (*s <= '9'); s++)
+		ip = ip * 10 + (*s - '0');
+	if ((s < e) && ((*s == ',') || (*s == '.')))
+	{
+		s++;
+		f = s;
+		for (; (s < e) && (*s >= '0') && (*s <= '9'); s++)
+			fp = fp * 10 + (*s - '0');
+		if ((s == f) || (s - f > 2))
+			return false;
+		if (s - f == 1)
+			fp *= 10;
+	}
+	if (s != e)
+		return false;
+	*v = neg ? -(ip * 100 + fp) : (ip * 100 + fp);
+	return true;
+}
+
+/**
+ * @brief Decode an unsigned decimal integer
+ */
+inline bool parse_uint(const char *s, const char *e, uint32_t *v)
+{
+	uint32_t n = 0;
+
+	if (s == e)
+		return false;
+	for (; s < e; s++)
+	{
+		if ((*s < '0') || (*s > '9'))
+			return false;
+		n = n * 10 + uint32_t(*s - '0');
+	}
+	*v = n;
+	return true;
+}
+
+inline bool is_error(const char *s, const char *e)
+{
+	return ((e - s) == 5) && (std::memcmp(s, "ERROR", 5) == 0);
+}
+
+/**
+ * @brief Decode one field (key=value) into a sample
+ */
+inline bool parse_field(const char *k, size_t klen, const char *v,
+                        const char *ve, Sample *out)
+{
+	switch (klen)
+	{
+	case 2:
+		if ((k[0] == 'R') && (k[1] == 'H'))
+		{
+			if (is_error(v, ve))
+			{
+				out->flags |= SAMPLE_ERR_RH;
+				return true;
+			}
+			out->flags |= SAMPLE_RH;
+			return parse_fixed(v, ve, &out->rh);
+		}
+		if ((k[0] == 'A') && (k[1] == 'H'))
+		{
+			out->flags |= SAMPLE_AH;
+			return parse_fixed(v, ve, &out->ah);
+		}
+		if ((k[0] == 'H') && (k[1] == 'I'))
+		{
+			out->flags |= SAMPLE_HI;
+			return parse_fixed(v, ve, &out->hi);
+		}
+		break;
+	case 3:
+		if (std::memcmp(k, "SEQ", 3) == 0)
+		{
+			out->flags |= SAMPLE_SEQ;
+			return parse_uint(v, ve, &out->seq);
+		}
+		if (std::memcmp(k, "DEW", 3) == 0)
+		{
+			out->flags |= SAMPLE_DEW;
+			return parse_fixed(v, ve, &out->dew);
+		}
+		break;
+	case 4:
+		if (std::memcmp(k, "TEMP", 4) == 0)
+		{
+			if (is_error(v, ve))
+			{
+				out->flags |= SAMPLE_ERR_TEMP;
+				return true;
+			}
+			out->flags |= SAMPLE_TEMP;
+			return parse_fixed(v, ve, &out->temp);
+		}
+		break;
+	case 5:
+		if (std::memcmp(k, "PHASE", 5) == 0)
+		{
+			out->flags |= SAMPLE_PHASE;
+			return parse_uint(v, ve, &out->phase);
+		}
+		break;
+	}
+	/* Unknown fields are ignored (forward compatibility) */
+	return true;
+}
+
+inline int hexval(char c)
+{
+	if ((c >= '0') && (c <= '9')) return c - '0';
+	if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+	if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+	return -1;
+}
+
+/**
+ * @brief Decode the fields of one sample line
+ *
+ * @param buf   Start of the window
+ * @param start Offset of the first byte of the line
+ * @param end   Offset of the LF (or end of line)
+ * @param sp    Mask of spaces for the window
+ * @param eq    Mask of '=' for the window
+ * @param out   Decoded sample
+ * @return true on success, false if a field is malformed
+ */
+bool decode_line(const char *buf, size_t start, size_t end,
+                 const uint64_t *sp, const uint64_t *eq, Sample *out)
+{
+	size_t k = start;
+
+	/* Ignore the CR of CRLF */
+	if ((end > start) && (buf[end - 1] == '\r'))
+		end--;
+
+	std::memset(out, 0, sizeof(*out));
+	while (k < end)
+	{
+		size_t e = next_bit(eq, k, end);
+		if (e == end)
+			return false;
+		size_t s = next_bit(sp, e, end);
+		if (!parse_field(buf + k, e - k, buf + e + 1, buf + s, out))
+			return false;
+		k = s + 1;
+	}
+	return true;
+}
+
+} // namespace
+
+/**
+ * @brief Search the next LF character
+ *
+ * @param p   Start of the buffer
+ * @param end End of the buffer
+ * @return Pointer to the LF, or end if not found
+ */
+const char *find_newline(const char *p, const char *end) noexcept
+{
+	uint64_t nl, sp, eq;
+
+	while (p + kBlock <= end)
+	{
+		block_masks(p, &nl, &sp, &eq);
+		if (nl)
+			return p + __builtin_ctzll(nl);
+		p += kBlock;
+	}
+	const void *r = std::memchr(p, '\n', size_t(end - p));
+	return r ? static_cast<const char *>(r) : end;
+}
+
+/**
+ * @brief Decode a single sample line (without LF)
+ *
+ * @param line Pointer to the line
+ * @param len  Length of the line (CR is allowed at end)
+ * @param out  Decoded sample
+ * @return true if the line is a valid sample
+ */
+bool parse_sample_line(const char *line, size_t len, Sample *out) noexcept
+{
+	Masks m;
+
+	if (len > kWindow)
+		return false;
+	window_masks(line, len, &m);
+	return decode_line(line, 0, len, m.sp, m.eq, out) &&
+	       (out->flags & (SAMPLE_RH | SAMPLE_ERR_RH));
+}
+
+StreamParser::StreamParser() noexcept
+{
+	reset();
+}
+
+/**
+ * @brief Reset parser state (partial line, serial number and statistics)
+ */
+void StreamParser::reset() noexcept
+{
+	m_carry_len  = 0;
+	m_discard    = false;
+	m_has_serial = false;
+	m_serial     = 0;
+	std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+/**
+ * @brief Parse a block of received bytes
+ *
+ * Parsing stops when max_out samples have been decoded, in that case
+ * "consumed" is lower than len and the caller must call again with the
+ * remaining bytes.
+ *
+ * @param data     Pointer to received bytes
+ * @param len      Number of bytes
+ * @param out      Array where decoded samples are stored
+ * @param max_out  Size of the out array
+ * @param consumed Number of bytes processed (may be null)
+ * @return Number of samples stored into out
+ */
+size_t StreamParser::parse(const char *data, size_t len, Sample *out,
+                           size_t max_out, size_t *consumed) noexcept
+{
+	size_t pos = 0;
+	size_t count = 0;
+
+	if (max_out == 0)
+		goto end;
+
+	/* First, complete the pending partial line (if any) */
+	if ((m_carry_len || m_discard) && len)
+	{
+		const char *nl = find_newline(data, data + len);
+		size_t n = size_t(nl - data) + ((nl < data + len) ? 1 : 0);
+
+		if (!m_discard && (m_carry_len + n > kMaxLine))
+		{
+			m_discard = true;
+			m_carry_len = 0;
+		}
+		if (!m_discard)
+		{
+			std::memcpy(m_carry + m_carry_len, data, n);
+			m_carry_len += n;
+		}
+		pos = n;
+		m_stats.bytes += n;
+
+		if (nl == data + len)
+			goto end;
+		/* Line is now complete */
+		if (m_discard)
+		{
+			m_stats.lines++;
+			m_stats.overlong++;
+			m_discard = false;
+		}
+		else
+		{
+			size_t used;
+			count = scan(m_carry, m_carry_len, out, max_out, &used);
+		}
+		m_carry_len = 0;
+	}
+
+	/* Then parse complete lines in place */
+	while ((pos < len) && (count < max_out))
+	{
+		size_t wlen = len - pos;
+		size_t used;
+
+		if (wlen > kWindow)
+			wlen = kWindow;
+		count += scan(data + pos, wlen, out + count, max_out - count, &used);
+		m_stats.bytes += used;
+		pos += used;
+		if (used == 0)
+		{
+			/* No complete line in window */
+			size_t rem = len - pos;
+			if (rem >= kWindow)
+			{
+				/* Line too long : drop it up to the next LF, then go on
+				 * with the following lines */
+				const char *nl = find_newline(data + pos, data + len);
+				if (nl < data + len)
+				{
+					size_t n = size_t(nl - (data + pos)) + 1;
+					m_stats.lines++;
+					m_stats.overlong++;
+					m_stats.bytes += n;
+					pos += n;
+					continue;
+				}
+				/* End of the line into a next buffer */
+				m_discard = true;
+				m_stats.bytes += rem;
+				pos = len;
+			}
+			else if (rem)
+			{
+				if (rem > kMaxLine)
+					m_discard = true;
+				else
+				{
+					std::memcpy(m_carry, data + pos, rem);
+					m_carry_len = rem;
+				}
+				m_stats.bytes += rem;
+				pos = len;
+			}
+			break;
+		}
+	}
+end:
+	if (consumed)
+		*consumed = pos;
+	return count;
+}
+
+/**
+ * @brief Decode the complete lines of a window
+ *
+ * @param buf  Start of the window (start of a line)
+ * @param len  Length of the window (up to kWindow)
+ * @param out  Array where decoded samples are stored
+ * @param max_out Size of the out array
+ * @param used Number of bytes processed (complete lines)
+ * @return Number of samples stored into out
+ */
+size_t StreamParser::scan(const char *buf, size_t len, Sample *out,
+                          size_t max_out, size_t *used) noexcept
+{
+	Masks  m;
+	size_t start = 0;
+	size_t count = 0;
+
+	window_masks(buf, len, &m);
+
+	while (count < max_out)
+	{
+		size_t nl = next_bit(m.nl, start, len);
+		if (nl == len)
+			break;
+		m_stats.lines++;
+
+		if ((nl - start >= 3) && (buf[start] == 'R') && (buf[start + 1] == 'H') &&
+		    (buf[start + 2] == '='))
+		{
+			if (decode_line(buf, start, nl, m.sp, m.eq, &out[count]))
+			{
+				m_stats.samples++;
+				count++;
+			}
+			else
+				m_stats.malformed++;
+		}
+		else
+		{
+			size_t plen = sizeof(kSerialPrefix) - 1;
+			m_stats.other++;
+			/* Serial number line : prefix followed by 16 hex digits */
+			if ((nl - start >= plen + 16) &&
+			    (std::memcmp(buf + start, kSerialPrefix, plen) == 0))
+			{
+				uint64_t sn = 0;
+				int i;
+				for (i = 0; i < 16; i++)
+				{
+					int h = hexval(buf[start + plen + i]);
+					if (h < 0)
+						break;
+					sn = (sn << 4) | uint64_t(h);
+				}
+				if (i == 16)
+				{
+					m_serial = sn;
+					m_has_serial = true;
+				}
+			}
+		}
+		start = nl + 1;
+	}
+	*used = start;
+	return count;
+}
+
+} // namespace trh
+/* EOF */
@@ -0,0 +1,100 @@
+/**
+ * @file  trh_parser.hpp
+ * @brief Incremental, allocation-free parser for the pmod-trh output stream
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_PARSER_HPP
+#define TRH_PARSER_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace trh {
+
+/* Flags of a sample : which fields are present / in error */
+enum : uint32_t {
+	SAMPLE_RH       = (1u << 0),
+	SAMPLE_TEMP     = (1u << 1),
+	SAMPLE_DEW      = (1u << 2),
+	SAMPLE_AH       = (1u << 3),
+	SAMPLE_HI       = (1u << 4),
+	SAMPLE_SEQ      = (1u << 5),
+	SAMPLE_PHASE    = (1u << 6),
+	SAMPLE_ERR_RH   = (1u << 8),
+	SAMPLE_ERR_TEMP = (1u << 9),
+};
+
+/**
+ * One decoded "RH=.. TEMP=.." line. Decimal values are in 1/100 unit, as
+ * sent by the firmware ("45,12" is 4512).
+ */
+struct Sample
+{
+	int32_t  rh;
+	int32_t  temp;
+	int32_t  dew;
+	int32_t  ah;
+	int32_t  hi;
+	uint32_t seq;
+	uint32_t phase;
+	uint32_t flags;
+};
+
+struct ParserStats
+{
+	uint64_t bytes;      /* Number of bytes received                    */
+	uint64_t lines;      /* Number of complete lines                    */
+	uint64_t samples;    /* Number of sample lines decoded              */
+	uint64_t other;      /* Lines that are not samples (banner, ...)    */
+	uint64_t malformed;  /* Sample lines with an invalid field          */
+	uint64_t overlong;   /* Lines longer than kMaxLine (dropped)        */
+};
+
+/**
+ * Stream parser. Data are parsed in place from the caller buffers, only the
+ * incomplete line at the end of a buffer is copied into an internal fixed
+ * size buffer until the next call. No memory is allocated.
+ */
+class StreamParser
+{
+public:
+	static constexpr size_t kMaxLine = 128;
+
+	StreamParser() noexcept;
+	void reset() noexcept;
+
+	size_t parse(const char *data, size_t len, Sample *out, size_t max_out,
+	             size_t *consumed) noexcept;
+
+	const ParserStats &stats() const noexcept { return m_stats; }
+	bool     has_serial() const noexcept { return m_has_serial; }
+	uint64_t serial()     const noexcept { return m_serial; }
+
+private:
+	size_t scan(const char *buf, size_t len, Sample *out, size_t max_out,
+	            size_t *used) noexcept;
+
+	char        m_carry[kMaxLine];
+	size_t      m_carry_len;
+	bool        m_discard;
+	bool        m_has_serial;
+	uint64_t    m_serial;
+	ParserStats m_stats;
+};
+
+const char *find_newline(const char *p, const char *end) noexcept;
+bool parse_sample_line(const char *line, size_t len, Sample *out) noexcept;
+
+} // namespace trh
+
+#endif
+/* EOF */
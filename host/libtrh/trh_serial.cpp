@@ -0,0 +1,162 @@
+/**
+ * @file  trh_serial.cpp
+ * @brief Serial port access (termios) for pmod-trh boards
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "trh_serial.hpp"
+
+namespace trh {
+
+namespace {
+
+speed_t baud_code(unsigned baud)
+{
+	switch (baud)
+	{
+		case   9600: return B9600;
+		case  19200: return B19200;
+		case  38400: return B38400;
+		case  57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+	}
+	return B0;
+}
+
+} // namespace
+
+/**
+ * @brief Open a serial port in raw mode (8N1, no flow control)
+ *
+ * @param path  Name of the device (/dev/ttyUSB0, or a pty for tests)
+ * @param baud  Baudrate
+ * @param error Optional string where an error message is stored
+ * @return int File descriptor, or -1 on error
+ */
+int serial_open(const char *path, unsigned baud, std::string *error)
+{
+	int fd = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		if (error)
+			*error = strerror(errno);
+		return -1;
+	}
+	if (!serial_set_baud(fd, baud))
+	{
+		if (error)
+			*error = "unsupported baudrate or not a tty";
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @brief Set raw mode and baudrate of an opened port, pending data are dropped
+ *
+ * @param fd   File descriptor of the port
+ * @param baud New baudrate
+ * @return bool True on success
+ */
+bool serial_set_baud(int fd, unsigned baud)
+{
+	struct termios tio;
+	speed_t speed = baud_code(baud);
+
+	if ((speed == B0) || (tcgetattr(fd, &tio) < 0))
+		return false;
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	tio.c_cc[VMIN]  = 0;
+	tio.c_cc[VTIME] = 0;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if (tcsetattr(fd, TCSANOW, &tio) < 0)
+		return false;
+	tcflush(fd, TCIOFLUSH);
+	return true;
+}
+
+/**
+ * @brief Write a buffer to a port (wait until all bytes are accepted)
+ *
+ * @return bool True on success
+ */
+bool serial_write(int fd, const void *data, size_t len)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+
+	while (len)
+	{
+		ssize_t n = write(fd, p, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p   += n;
+		len -= size_t(n);
+	}
+	return true;
+}
+
+/**
+ * @brief Read exactly len bytes from a port, or until the timeout expires
+ *
+ * @param timeout_ms Max delay (in ms) between two received bytes
+ * @return int Number of bytes read (lower than len on timeout), -1 on error
+ */
+int serial_read(int fd, void *data, size_t len, int timeout_ms)
+{
+	uint8_t *p = static_cast<uint8_t *>(data);
+	size_t done = 0;
+
+	while (done < len)
+	{
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		int r = poll(&pfd, 1, timeout_ms);
+		if (r < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (r == 0)
+			break;
+		ssize_t n = read(fd, p + done, len - done);
+		if (n < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		done += size_t(n);
+	}
+	return int(done);
+}
+
+} // namespace trh
+/* EOF */
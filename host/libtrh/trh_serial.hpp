@@ -0,0 +1,32 @@
+/**
+ * @file  trh_serial.hpp
+ * @brief Serial port access (termios) for pmod-trh boards
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#ifndef TRH_SERIAL_HPP
+#define TRH_SERIAL_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace trh {
+
+int  serial_open(const char *path, unsigned baud, std::string *error = nullptr);
+bool serial_set_baud(int fd, unsigned baud);
+bool serial_write(int fd, const void *data, size_t len);
+int  serial_read(int fd, void *data, size_t len, int timeout_ms);
+
+} // namespace trh
+
+#endif
+/* EOF */
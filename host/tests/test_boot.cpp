@@ -0,0 +1,147 @@
+/**
+ * @file  test_boot.cpp
+ * @brief Upload multi-page images into the simulated bootloader (trh_bootsim)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#include "trh_boot.hpp"
+#include "trh_serial.hpp"
+
+namespace {
+
+int g_checks = 0;
+int g_failed = 0;
+
+void check(bool ok, const char *what, int step)
+{
+	g_checks++;
+	if (ok)
+		return;
+	g_failed++;
+	fprintf(stderr, "FAIL: %s (step %d)\n", what, step);
+}
+
+/* Image of `pages` blocks, each one with its own content. The first page
+ * is a valid vector table (stack pointer and reset of the application). */
+std::vector<uint8_t> make_image(size_t pages, size_t block)
+{
+	std::vector<uint8_t> img(pages * block);
+	for (size_t i = 0; i < img.size(); i++)
+		img[i] = uint8_t((i * 7) ^ (i / block) * 0x35);
+	const uint32_t vec[2] = { 0x20000FF8, 0x00000401 };
+	for (int i = 0; i < 8; i++)
+		img[i] = uint8_t(vec[i / 4] >> ((i % 4) * 8));
+	return img;
+}
+
+/**
+ * Start the simulator, write the pages in the given order then VERIFY and
+ * RUN. The flash saved by the simulator is compared with the image.
+ */
+void upload(const char *sim, const std::vector<uint8_t> &img,
+            const std::vector<size_t> &order, unsigned drop, int step)
+{
+	char out[] = "/tmp/test_bootXXXXXX";
+	int tmp = mkstemp(out);
+	if (tmp < 0)
+	{
+		check(false, "temporary file", step);
+		return;
+	}
+	close(tmp);
+
+	std::string cmdline = std::string(sim) + " -d " + std::to_string(drop) + " " + out;
+	FILE *p = popen(cmdline.c_str(), "r");
+	char name[64] = "";
+	if (!p || !fgets(name, sizeof(name), p))
+	{
+		check(false, "start simulator", step);
+		if (p)
+			pclose(p);
+		unlink(out);
+		return;
+	}
+	name[strcspn(name, "\r\n")] = 0;
+
+	int fd = trh::serial_open(name, trh::boot::kBaud);
+	check(fd >= 0, "open pty", step);
+	if (fd >= 0)
+	{
+		trh::BootClient boot(fd);
+		trh::BootInfo info;
+		check(boot.info(&info) == trh::boot::kOk, "INFO", step);
+		check(boot.erase() == trh::boot::kOk, "ERASE", step);
+		for (size_t n : order)
+			check(boot.write(uint16_t(n * info.block), &img[n * info.block],
+			                 info.block) == trh::boot::kOk, "WRITE", step);
+		uint16_t crc = trh::crc16_modbus(img.data(), img.size());
+		check(boot.verify(uint16_t(img.size()), crc) == trh::boot::kOk, "VERIFY", step);
+		/* A second VERIFY (lost response) gives the same result */
+		check(boot.verify(uint16_t(img.size()), crc) == trh::boot::kOk, "VERIFY again", step);
+		/* A wrong CRC is rejected */
+		check(boot.verify(uint16_t(img.size()), uint16_t(crc ^ 1)) == trh::boot::kErrVerify,
+		      "VERIFY bad CRC", step);
+		check(boot.run() == trh::boot::kOk, "RUN", step);
+		close(fd);
+	}
+	/* Simulator exits with 0 when the application is valid */
+	while (fgets(name, sizeof(name), p))
+		;
+	int st = pclose(p);
+	check(WIFEXITED(st) && (WEXITSTATUS(st) == 0), "application valid", step);
+
+	std::vector<uint8_t> flash(img.size());
+	FILE *fp = fopen(out, "rb");
+	check(fp && (fread(flash.data(), 1, flash.size(), fp) == flash.size()),
+	      "read flash", step);
+	if (fp)
+		fclose(fp);
+	check(flash == img, "flash content", step);
+	unlink(out);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <trh_bootsim>\n", argv[0]);
+		return 1;
+	}
+	const size_t block = trh::boot::kMaxData;
+	const std::vector<uint8_t> img = make_image(16, block);
+	std::vector<size_t> order;
+
+	/* Vector table first, like trh_flash */
+	for (size_t n = 0; n < 16; n++)
+		order.push_back(n);
+	upload(argv[1], img, order, 0, 1);
+
+	/* Vector table in the middle of the upload */
+	order = { 1, 2, 3, 4, 5, 6, 7, 0, 8, 9, 10, 11, 12, 13, 14, 15 };
+	upload(argv[1], img, order, 0, 2);
+
+	/* Lost responses : requests are sent again */
+	upload(argv[1], img, order, 5, 3);
+
+	printf("test_boot: %d checks, %d failed\n", g_checks, g_failed);
+	return g_failed ? 1 : 0;
+}
+/* EOF */
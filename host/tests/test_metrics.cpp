@@ -0,0 +1,176 @@
+/**
+ * @file  test_metrics.cpp
+ * @brief Sweep of the firmware derived metrics against a floating point model
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+
+/* Firmware sources, built with the 32 bits types of the target */
+#define TYPES_H
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+#include "fixmath.c"
+#include "metrics.c"
+
+namespace {
+
+int g_checks = 0;
+int g_failed = 0;
+
+/* Check the error of one value, keep the worst case for the summary. The
+ * limit is absolute, or relative to the value when it is larger. */
+struct Error
+{
+	const char *name;
+	double limit;
+	double rel;
+	double max;
+	int    rh, temp;
+};
+
+void check(Error &e, int v, double ref, int rh, int temp)
+{
+	double err = std::fabs(v / 100.0 - ref);
+
+	g_checks++;
+	if (err > e.max)
+	{
+		e.max  = err;
+		e.rh   = rh;
+		e.temp = temp;
+	}
+	if (err <= std::fmax(e.limit, e.rel * std::fabs(ref)))
+		return;
+	g_failed++;
+	if (g_failed < 10)
+		fprintf(stderr, "FAIL: %s RH=%d T=%d : %.2f, expected %.2f\n",
+		        e.name, rh, temp, v / 100.0, ref);
+}
+
+/* Floating point models, same formulas as the firmware */
+const double kB = 17.62;
+const double kC = 243.12;
+
+double ref_dewpoint(double rh, double t)
+{
+	if (rh < 0.01)
+		rh = 0.01;
+	if (rh > 100)
+		rh = 100;
+	double g = std::log(rh / 100) + kB * t / (kC + t);
+	return kC * g / (kB - g);
+}
+
+double ref_abs_humidity(double rh, double t)
+{
+	if (rh > 100)
+		rh = 100;
+	double pw = 6.112 * std::exp(kB * t / (kC + t)) * rh / 100;
+	return 216.74 * pw / (273.15 + t);
+}
+
+double ref_regression(double tf, double r)
+{
+	double hi = -42.379 + 2.04901523 * tf + 10.14333127 * r
+	          - 0.22475541 * tf * r - 0.00683783 * tf * tf
+	          - 0.05481717 * r * r + 0.00122874 * tf * tf * r
+	          + 0.00085282 * tf * r * r - 0.00000199 * tf * tf * r * r;
+	if ((r < 13) && (tf >= 80) && (tf <= 112))
+		hi -= ((13 - r) / 4) * std::sqrt((17 - std::fabs(tf - 95)) / 17);
+	else if ((r > 85) && (tf > 78) && (tf <= 87))
+		hi += ((r - 85) / 10) * ((87 - tf) / 5) * std::fmin(1, (tf - 78) / 2);
+	return hi;
+}
+
+double ref_heat_index(double rh, double t)
+{
+	if (rh > 100)
+		rh = 100;
+	double tf = t * 9 / 5 + 32;
+	double hi = 0.5 * (tf + 61 + (tf - 68) * 1.2 + rh * 0.094);
+	double avg = (hi + tf) / 2;
+
+	if (avg >= 81)
+		hi = ref_regression(tf, rh);
+	else if (avg > 79)
+		hi += (ref_regression(tf, rh) - hi) * (avg - 79) / 2;
+	return (hi - 32) * 5 / 9;
+}
+
+/* Whole range of the sensor : -40 to 125 deg C, 0 to 100 %RH (by 0.01 %
+ * below 1 %RH, where the logarithm of the dew point is the steepest) */
+void test_sweep()
+{
+	Error dp = { "dewpoint",     0.05, 0,    0, 0, 0 };
+	Error ah = { "abs_humidity", 0.03, 3e-5, 0, 0, 0 };
+	Error hi = { "heat_index",   0.05, 0,    0, 0, 0 };
+
+	for (int rh = 0; rh <= 10000; rh += (rh < 100) ? 1 : 25)
+	{
+		for (int t = -4000; t <= 12500; t += 25)
+		{
+			check(dp, metrics_dewpoint(rh, t), ref_dewpoint(rh / 100.0, t / 100.0), rh, t);
+			check(ah, metrics_abs_humidity(rh, t), ref_abs_humidity(rh / 100.0, t / 100.0), rh, t);
+			/* Heat index is only defined for warm air */
+			if (t >= 2000 && t <= 5000)
+				check(hi, metrics_heat_index(rh, t), ref_heat_index(rh / 100.0, t / 100.0), rh, t);
+		}
+	}
+	for (const Error *e : { &dp, &ah, &hi })
+		printf("test_metrics: %-12s max error %.3f (RH=%d T=%d)\n",
+		       e->name, e->max, e->rh, e->temp);
+}
+
+/* No step in the heat index around 80F (switch to the regression and
+ * high humidity adjustment) */
+void test_heat_continuity()
+{
+	for (int rh = 0; rh <= 10000; rh += 100)
+	{
+		int prev = metrics_heat_index(rh, 2000);
+		int step = 0;
+
+		/* 20 to 32 deg C, both switches are around 26.7 deg C */
+		for (int t = 2001; t <= 3200; t++)
+		{
+			int v = metrics_heat_index(rh, t);
+			if (std::abs(v - prev) > step)
+				step = std::abs(v - prev);
+			prev = v;
+		}
+		g_checks++;
+		/* 0.01 deg C of temperature moves the heat index by less than 0.1 */
+		if (step > 10)
+		{
+			g_failed++;
+			fprintf(stderr, "FAIL: heat_index step of %d at RH=%d\n", step, rh);
+		}
+	}
+}
+
+} // namespace
+
+int main()
+{
+	test_sweep();
+	test_heat_continuity();
+
+	printf("test_metrics: %d checks, %d failed\n", g_checks, g_failed);
+	return g_failed ? 1 : 0;
+}
+/* EOF */
@@ -0,0 +1,123 @@
+/**
+ * @file  test_parser.cpp
+ * @brief Tests of the stream parser : fixed point values and overlong lines
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "trh_parser.hpp"
+
+namespace {
+
+int g_checks = 0;
+int g_failed = 0;
+
+void check(bool ok, const char *what, int line)
+{
+	g_checks++;
+	if (ok)
+		return;
+	g_failed++;
+	fprintf(stderr, "FAIL: %s (line %d)\n", what, line);
+}
+
+#define CHECK(x) check((x), #x, __LINE__)
+
+/* Values of one line, decoded alone */
+bool decode(const char *line, trh::Sample *s)
+{
+	std::memset(s, 0, sizeof(*s));
+	return trh::parse_sample_line(line, std::strlen(line), s);
+}
+
+void test_fixed()
+{
+	trh::Sample s;
+
+	CHECK(decode("RH=45,12 TEMP=23,05", &s) && (s.rh == 4512) && (s.temp == 2305));
+	CHECK(decode("RH=45,1 TEMP=-3,5", &s) && (s.rh == 4510) && (s.temp == -350));
+	CHECK(decode("RH=45 TEMP=-0,05", &s) && (s.rh == 4500) && (s.temp == -5));
+	CHECK(decode("RH=45.12 TEMP=23.05", &s) && (s.rh == 4512));
+	/* More than two fractional digits is not a firmware value */
+	CHECK(!decode("RH=45,123 TEMP=23,05", &s));
+	CHECK(!decode("RH=45,12 TEMP=23,0500", &s));
+	CHECK(!decode("RH=45, TEMP=23,05", &s));
+	CHECK(!decode("RH=- TEMP=23,05", &s));
+}
+
+/* Parse a stream given by chunks, return the number of samples */
+size_t parse_chunks(trh::StreamParser &p, const std::string &data, size_t chunk)
+{
+	trh::Sample out[64];
+	size_t n = 0;
+
+	for (size_t off = 0; off < data.size(); )
+	{
+		size_t len = std::min(chunk, data.size() - off);
+		size_t used;
+		n += p.parse(data.data() + off, len, out, 64, &used);
+		off += used;
+	}
+	return n;
+}
+
+void test_overlong()
+{
+	const std::string good = "RH=45,12 TEMP=23,05 SEQ=1\n";
+	const std::string longl = std::string(3000, 'x') + "\n";
+
+	/* Overlong line in the middle of one buffer : the next lines are kept */
+	{
+		trh::StreamParser p;
+		std::string d = good + longl + good + good;
+		CHECK(parse_chunks(p, d, d.size()) == 3);
+		CHECK(p.stats().overlong == 1);
+		CHECK(p.stats().lines == 4);
+		CHECK(p.stats().bytes == d.size());
+	}
+	/* Overlong line split over buffers of any size */
+	for (size_t chunk : { 1, 7, 64, 100, 1000, 1024, 1500, 4096 })
+	{
+		trh::StreamParser p;
+		std::string d = good + longl + good + longl + longl + good;
+		CHECK(parse_chunks(p, d, chunk) == 3);
+		CHECK(p.stats().overlong == 3);
+		CHECK(p.stats().lines == 6);
+	}
+	/* Overlong line at the end, completed by the next call */
+	{
+		trh::StreamParser p;
+		trh::Sample out[4];
+		size_t used;
+		std::string a = good + std::string(2000, 'x');
+		std::string b = "yy\n" + good;
+		CHECK(p.parse(a.data(), a.size(), out, 4, &used) == 1);
+		CHECK(used == a.size());
+		CHECK(p.parse(b.data(), b.size(), out, 4, &used) == 1);
+		CHECK(p.stats().overlong == 1);
+		CHECK(p.stats().samples == 2);
+	}
+}
+
+} // namespace
+
+int main()
+{
+	test_fixed();
+	test_overlong();
+
+	printf("test_parser: %d checks, %d failed\n", g_checks, g_failed);
+	return g_failed ? 1 : 0;
+}
+/* EOF */
@@ -0,0 +1,83 @@
+/**
+ * @file  test_si7021.cpp
+ * @brief Conversion of the raw sensor codes against the datasheet formulas
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+/* Firmware header, built with the 32 bits types of the target */
+#define TYPES_H
+typedef unsigned int uint;
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t  u8;
+#include "si7021.h"
+
+namespace {
+
+int g_checks = 0;
+int g_failed = 0;
+
+void check(bool ok, const char *what, unsigned code, int v)
+{
+	g_checks++;
+	if (ok)
+		return;
+	g_failed++;
+	if (g_failed < 10)
+		fprintf(stderr, "FAIL: %s code=%u : %d\n", what, code, v);
+}
+
+/* Known codes : ends of the range and exact points of the formulas */
+void test_known()
+{
+	check(si7021_rh_raw(0)     ==  -600, "rh", 0,     si7021_rh_raw(0));
+	check(si7021_rh_raw(3146)  ==     0, "rh", 3146,  si7021_rh_raw(3146));
+	check(si7021_rh_raw(32768) ==  5650, "rh", 32768, si7021_rh_raw(32768));
+	check(si7021_rh_raw(55575) == 10000, "rh", 55575, si7021_rh_raw(55575));
+	check(si7021_rh_raw(65535) == 11899, "rh", 65535, si7021_rh_raw(65535));
+
+	check(si7021_temp_raw(0)     == -4685, "temp", 0,     si7021_temp_raw(0));
+	check(si7021_temp_raw(26797) ==  2500, "temp", 26797, si7021_temp_raw(26797));
+	check(si7021_temp_raw(65535) == 12886, "temp", 65535, si7021_temp_raw(65535));
+}
+
+/* Every code, against the floating point formulas (truncated to 0.01) */
+void test_all_codes()
+{
+	for (unsigned code = 0; code < 65536; code++)
+	{
+		double rh   = 125.0 * code / 65536 - 6;
+		double temp = 175.72 * code / 65536 - 46.85;
+		int v;
+
+		v = si7021_rh_raw(code);
+		check(std::fabs(v / 100.0 - rh) < 0.0101, "rh model", code, v);
+		v = si7021_temp_raw(code);
+		check(std::fabs(v / 100.0 - temp) < 0.0101, "temp model", code, v);
+	}
+}
+
+} // namespace
+
+int main()
+{
+	test_known();
+	test_all_codes();
+
+	printf("test_si7021: %d checks, %d failed\n", g_checks, g_failed);
+	return g_failed ? 1 : 0;
+}
+/* EOF */
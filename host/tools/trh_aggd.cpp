@@ -0,0 +1,169 @@
+/**
+ * @file  trh_aggd.cpp
+ * @brief Aggregator daemon : collect samples of many boards into one output
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "trh_aggregator.hpp"
+
+namespace {
+
+volatile sig_atomic_t g_stop = 0;
+
+void on_signal(int)
+{
+	g_stop = 1;
+}
+
+/**
+ * @brief Add the ports listed into a file (one per line, # for comments)
+ */
+bool read_list(const char *path, trh::Aggregator *agg)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return false;
+	char line[512];
+	while (fgets(line, sizeof(line), fp))
+	{
+		size_t n = strcspn(line, "\r\n");
+		line[n] = 0;
+		if ((n == 0) || (line[0] == '#'))
+			continue;
+		agg->add_port(line);
+	}
+	fclose(fp);
+	return true;
+}
+
+/**
+ * @brief Allow as many file descriptors as possible (one per port)
+ */
+void raise_fd_limit()
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options] [port ...]\n"
+	                "  -b baud   baudrate of the ports (default 9600)\n"
+	                "  -l file   read the list of ports from a file\n"
+	                "  -o file   append records to a file (default stdout)\n"
+	                "  -u path   send records to a local (unix) socket\n"
+	                "  -s KB     batch size, write when reached (default 256)\n"
+	                "  -t ms     max delay before a write (default 100)\n"
+	                "  -p KB     max pending output, ports paused above (default 8192)\n"
+	                "  -q bytes  max bytes read per port per period (default none)\n"
+	                "  -m file   export metrics (Prometheus text format)\n"
+	                "  -i s      metrics export period (default 10)\n",
+	        name);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	trh::AggConfig conf;
+	const char *list = nullptr;
+	const char *file = nullptr;
+	const char *sock = nullptr;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:l:o:u:s:t:p:q:m:i:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': conf.baud        = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'l': list = optarg; break;
+			case 'o': file = optarg; break;
+			case 'u': sock = optarg; break;
+			case 's': conf.batch_size  = strtoul(optarg, nullptr, 0) * 1024; break;
+			case 't': conf.flush_ms    = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'p': conf.max_pending = strtoul(optarg, nullptr, 0) * 1024; break;
+			case 'q': conf.port_quota  = strtoul(optarg, nullptr, 0); break;
+			case 'm': conf.metrics     = optarg; break;
+			case 'i': conf.metrics_ms  = unsigned(strtoul(optarg, nullptr, 0)) * 1000; break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+
+	raise_fd_limit();
+	trh::Aggregator agg(conf);
+	if (list && !read_list(list, &agg))
+	{
+		fprintf(stderr, "%s: %s\n", list, strerror(errno));
+		return 1;
+	}
+	for (int i = optind; i < argc; i++)
+		agg.add_port(argv[i]);
+	if (agg.ports() == 0)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::string err;
+	if (file && !agg.output_file(file, &err))
+	{
+		fprintf(stderr, "%s: %s\n", file, err.c_str());
+		return 1;
+	}
+	if (sock && !agg.output_socket(sock, &err))
+	{
+		fprintf(stderr, "%s: %s\n", sock, err.c_str());
+		return 1;
+	}
+
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT,  &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!agg.run(&g_stop, &err))
+	{
+		fprintf(stderr, "trh_aggd: %s\n", err.c_str());
+		return 1;
+	}
+
+	const trh::AggStats &st = agg.stats();
+	fprintf(stderr, "%zu port(s), %zu open : %llu bytes in, %llu samples, "
+	                "%llu bytes out in %llu writes, %llu dropped\n",
+	        agg.ports(), agg.ports_open(),
+	        (unsigned long long)st.bytes_in, (unsigned long long)st.samples,
+	        (unsigned long long)st.bytes_out, (unsigned long long)st.writes,
+	        (unsigned long long)st.dropped);
+	if (st.lat_count)
+		fprintf(stderr, "Latency read to write : mean %llu us, max %llu us\n",
+		        (unsigned long long)(st.lat_sum_us / st.lat_count),
+		        (unsigned long long)st.lat_max_us);
+	return 0;
+}
+/* EOF */
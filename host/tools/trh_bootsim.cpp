@@ -0,0 +1,247 @@
+/**
+ * @file  trh_bootsim.cpp
+ * @brief Simulated bootloader on a pseudo terminal, to test trh_flash
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pty.h>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "trh_boot.hpp"
+#include "trh_serial.hpp"
+
+namespace {
+
+/* Flash layout and timings of the ATSAMD09 (see firmware/src/boot.h) */
+constexpr uint32_t kAppAddr  = 0x400;
+constexpr uint32_t kAppSize  = 0x2000 - kAppAddr;
+constexpr uint32_t kRowSize  = 256;
+constexpr uint32_t kPageSize = 64;
+constexpr int      kEraseUs  = 6000;   /* Row erase   */
+constexpr int      kWriteUs  = 2500;   /* Page write  */
+
+struct Device
+{
+	std::vector<uint8_t> flash = std::vector<uint8_t>(kAppSize, 0xFF);
+	uint32_t page[kPageSize / 4];   /* Scratch buffer of a WRITE request */
+	uint32_t page0[kPageSize / 4];  /* First page, kept until VERIFY     */
+	int      page0_valid = 0;   /* 0: none, 1: pending, 2: written       */
+	unsigned baud = trh::boot::kBaud;
+	unsigned drop = 0;      /* Drop one response every N (0: never)  */
+	unsigned count = 0;
+};
+
+void wait_us(long us)
+{
+	std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+/* Send a response, paced like the real UART (10 bits per byte) */
+void respond(int fd, Device &dev, uint8_t status, const uint8_t *data = nullptr,
+             size_t len = 0)
+{
+	uint8_t f[5 + trh::boot::kMaxData];
+	f[0] = trh::boot::kSofRsp;
+	f[1] = status;
+	f[2] = uint8_t(len);
+	if (len)
+		memcpy(&f[3], data, len);
+	uint16_t crc = trh::crc16_modbus(&f[1], 2 + len);
+	f[3 + len] = uint8_t(crc);
+	f[4 + len] = uint8_t(crc >> 8);
+	wait_us(long(5 + len) * 10000000L / dev.baud);
+	if (dev.drop && ((++dev.count % dev.drop) == 0))
+		return;
+	trh::serial_write(fd, f, 5 + len);
+}
+
+/* Same checks as boot_reset() : is the application startable ? */
+bool app_valid(const Device &dev)
+{
+	auto rd32 = [&](size_t o) {
+		return uint32_t(dev.flash[o]) | (uint32_t(dev.flash[o + 1]) << 8) |
+		       (uint32_t(dev.flash[o + 2]) << 16) | (uint32_t(dev.flash[o + 3]) << 24);
+	};
+	uint32_t sp = rd32(0), pc = rd32(4);
+	return ((sp & 3) == 0) && (sp > 0x20000000) && (sp <= 0x20000FF8) &&
+	       (pc > kAppAddr) && (pc < kAppAddr + kAppSize);
+}
+
+/* Program a page : flash bits can only go from 1 to 0 */
+void program(Device &dev, uint32_t off, const uint32_t *data)
+{
+	for (uint32_t i = 0; i < kPageSize; i++)
+		dev.flash[off + i] &= uint8_t(data[i / 4] >> ((i % 4) * 8));
+	wait_us(kWriteUs);
+}
+
+/* Process one request, return false on RUN */
+bool process(int fd, Device &dev, const uint8_t *req)
+{
+	uint8_t  cmd  = req[0];
+	size_t   len  = req[1];
+	uint32_t addr = uint32_t(req[2] | (req[3] << 8));
+	const uint8_t *data = &req[4];
+
+	switch (cmd)
+	{
+		case trh::boot::kCmdInfo:
+		{
+			const uint8_t info[6] = { 1, kPageSize, uint8_t(kAppAddr), uint8_t(kAppAddr >> 8),
+			                          uint8_t(kAppSize), uint8_t(kAppSize >> 8) };
+			respond(fd, dev, trh::boot::kOk, info, sizeof(info));
+			return true;
+		}
+		case trh::boot::kCmdErase:
+			dev.page0_valid = 0;
+			std::fill(dev.flash.begin(), dev.flash.end(), 0xFF);
+			wait_us(long(kAppSize / kRowSize) * kEraseUs);
+			break;
+		case trh::boot::kCmdWrite:
+			if ((len != kPageSize) || (addr % kPageSize) || (addr >= kAppSize))
+			{
+				respond(fd, dev, trh::boot::kErrParam);
+				return true;
+			}
+			/* Same steps as the bootloader : unpack into the scratch
+			 * buffer, the first page (vector table) is kept until VERIFY */
+			for (uint32_t i = 0; i < kPageSize / 4; i++)
+				dev.page[i] = uint32_t(data[i * 4]) | (uint32_t(data[i * 4 + 1]) << 8) |
+				              (uint32_t(data[i * 4 + 2]) << 16) | (uint32_t(data[i * 4 + 3]) << 24);
+			if (addr == 0)
+			{
+				memcpy(dev.page0, dev.page, kPageSize);
+				dev.page0_valid = 1;
+			}
+			else
+				program(dev, addr, dev.page);
+			break;
+		case trh::boot::kCmdVerify:
+		{
+			uint32_t size = uint32_t(data[0] | (data[1] << 8));
+			if ((len != 4) || (size < kPageSize) || (size > kAppSize) || !dev.page0_valid)
+			{
+				respond(fd, dev, trh::boot::kErrParam);
+				return true;
+			}
+			uint8_t first[kPageSize];
+			for (uint32_t i = 0; i < kPageSize; i++)
+				first[i] = uint8_t(dev.page0[i / 4] >> ((i % 4) * 8));
+			uint16_t crc = trh::crc16_modbus(first, kPageSize);
+			crc = trh::crc16_modbus(&dev.flash[kPageSize], size - kPageSize, crc);
+			if ((data[2] != uint8_t(crc)) || (data[3] != uint8_t(crc >> 8)))
+			{
+				respond(fd, dev, trh::boot::kErrVerify);
+				return true;
+			}
+			if (dev.page0_valid == 1)
+				program(dev, 0, dev.page0);
+			dev.page0_valid = 2;
+			break;
+		}
+		case trh::boot::kCmdRun:
+			respond(fd, dev, trh::boot::kOk);
+			return false;
+		default:
+			respond(fd, dev, trh::boot::kErrParam);
+			return true;
+	}
+	respond(fd, dev, trh::boot::kOk);
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	Device dev;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:d:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'b': dev.baud = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'd': dev.drop = unsigned(strtoul(optarg, nullptr, 0)); break;
+			default:
+				fprintf(stderr, "Usage: %s [-b baud] [-d N] [flash.bin]\n"
+				                "  -d  drop one response every N (test retries)\n", argv[0]);
+				return 1;
+		}
+	}
+	const char *out = (optind < argc) ? argv[optind] : nullptr;
+
+	int master, slave;
+	char name[64];
+	if (openpty(&master, &slave, name, nullptr, nullptr) < 0)
+	{
+		perror("openpty");
+		return 1;
+	}
+	struct termios tio;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	printf("%s\n", name);
+	fflush(stdout);
+
+	/* Same receive state machine as the bootloader (byte timeout 20ms) */
+	uint8_t req[4 + trh::boot::kMaxData + 2];
+	for (;;)
+	{
+		uint8_t c;
+		if (trh::serial_read(master, &c, 1, 60000) != 1)
+			break;
+		if (c != trh::boot::kSofReq)
+			continue;
+		if (trh::serial_read(master, req, 4, 20) != 4)
+			continue;
+		size_t len = req[1];
+		if ((len > trh::boot::kMaxData) ||
+		    (trh::serial_read(master, &req[4], len + 2, 20) != int(len + 2)))
+			continue;
+		/* Time to receive the request at the simulated baudrate */
+		wait_us(long(7 + len) * 10000000L / dev.baud);
+		uint16_t crc = trh::crc16_modbus(req, 4 + len);
+		if ((req[4 + len] != uint8_t(crc)) || (req[5 + len] != uint8_t(crc >> 8)))
+		{
+			respond(master, dev, trh::boot::kErrCrc);
+			continue;
+		}
+		if (!process(master, dev, req))
+			break;
+	}
+
+	printf("Application %s\n", app_valid(dev) ? "valid, started" : "not valid");
+	if (out)
+	{
+		FILE *fp = fopen(out, "wb");
+		if (fp)
+		{
+			fwrite(dev.flash.data(), 1, dev.flash.size(), fp);
+			fclose(fp);
+		}
+	}
+	/* Let the uploader read the last response before closing the pty */
+	wait_us(100000);
+	close(slave);
+	close(master);
+	return app_valid(dev) ? 0 : 2;
+}
+/* EOF */
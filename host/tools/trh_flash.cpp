@@ -0,0 +1,178 @@
+/**
+ * @file  trh_flash.cpp
+ * @brief Firmware uploader for the pmod-trh serial bootloader
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "trh_boot.hpp"
+#include "trh_serial.hpp"
+
+namespace {
+
+const char *status_name(int st)
+{
+	switch (st)
+	{
+		case trh::boot::kOk:        return "ok";
+		case trh::boot::kErrCrc:    return "CRC error";
+		case trh::boot::kErrParam:  return "invalid parameter";
+		case trh::boot::kErrVerify: return "image verify failed";
+		case trh::boot::kErrFlash:  return "flash error";
+		case trh::kBootTimeout:     return "no response";
+	}
+	return "unknown error";
+}
+
+bool read_file(const char *path, std::vector<uint8_t> *out)
+{
+	FILE *fp = fopen(path, "rb");
+	if (!fp)
+		return false;
+	uint8_t buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		out->insert(out->end(), buf, buf + n);
+	fclose(fp);
+	return true;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-a app_baud] [-b boot_baud] <port> <trh7021.bin>\n"
+	                "  -a  send UPDATE command to the running firmware first\n"
+	                "      (ASCII mode, usually 9600)\n"
+	                "  -b  bootloader baudrate (default %u)\n",
+	        name, trh::boot::kBaud);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	unsigned app_baud  = 0;
+	unsigned boot_baud = trh::boot::kBaud;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "a:b:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'a': app_baud  = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'b': boot_baud = unsigned(strtoul(optarg, nullptr, 0)); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (argc - optind != 2)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	const char *port = argv[optind];
+	const char *file = argv[optind + 1];
+
+	std::vector<uint8_t> image;
+	if (!read_file(file, &image) || image.empty())
+	{
+		fprintf(stderr, "%s: cannot read image\n", file);
+		return 1;
+	}
+
+	std::string err;
+	int fd = trh::serial_open(port, app_baud ? app_baud : boot_baud, &err);
+	if (fd < 0)
+	{
+		fprintf(stderr, "%s: %s\n", port, err.c_str());
+		return 1;
+	}
+	auto t0 = std::chrono::steady_clock::now();
+
+	/* Ask the running firmware to reset into bootloader */
+	if (app_baud)
+	{
+		trh::serial_write(fd, "\r\nUPDATE\r\n", 10);
+		tcdrain(fd);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		trh::serial_set_baud(fd, boot_baud);
+	}
+
+	trh::BootClient boot(fd);
+	trh::BootInfo info;
+	int st = boot.info(&info);
+	if (st != trh::boot::kOk)
+	{
+		fprintf(stderr, "Bootloader: %s\n", status_name(st));
+		return 1;
+	}
+	printf("Bootloader v%u, application at 0x%04X (%u bytes max)\n",
+	       info.version, info.app_addr, info.app_size);
+	if ((info.block == 0) || (info.block > trh::boot::kMaxData) ||
+	    (image.size() > info.app_size))
+	{
+		fprintf(stderr, "%s: image too large (%zu bytes)\n", file, image.size());
+		return 1;
+	}
+	/* Pad the image to a whole number of blocks (erased flash value) */
+	image.resize(((image.size() + info.block - 1) / info.block) * info.block, 0xFF);
+
+	if ((st = boot.erase()) != trh::boot::kOk)
+	{
+		fprintf(stderr, "Erase: %s\n", status_name(st));
+		return 1;
+	}
+	/* Blocks that contain only 0xFF are already erased, skip them */
+	size_t sent = 0;
+	for (size_t off = 0; off < image.size(); off += info.block)
+	{
+		const uint8_t *blk = &image[off];
+		size_t k = 0;
+		while ((k < info.block) && (blk[k] == 0xFF))
+			k++;
+		if ((k == info.block) && (off != 0))
+			continue;
+		if ((st = boot.write(uint16_t(off), blk, info.block)) != trh::boot::kOk)
+		{
+			fprintf(stderr, "\nWrite 0x%04zX: %s\n", off, status_name(st));
+			return 1;
+		}
+		sent += info.block;
+		printf("\rWrite %zu/%zu", off + info.block, image.size());
+		fflush(stdout);
+	}
+	printf("\n");
+
+	uint16_t crc = trh::crc16_modbus(image.data(), image.size());
+	if ((st = boot.verify(uint16_t(image.size()), crc)) != trh::boot::kOk)
+	{
+		fprintf(stderr, "Verify: %s\n", status_name(st));
+		return 1;
+	}
+	if ((st = boot.run()) != trh::boot::kOk)
+		fprintf(stderr, "Run: %s\n", status_name(st));
+
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	printf("%zu bytes (%zu sent) in %.2f s, %.1f KB/s, %u request(s) resent\n",
+	       image.size(), sent, s, (image.size() / 1024.0) / s, boot.resent());
+	close(fd);
+	return (st == trh::boot::kOk) ? 0 : 1;
+}
+/* EOF */
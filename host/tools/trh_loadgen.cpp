@@ -0,0 +1,609 @@
+/**
+ * @file  trh_loadgen.cpp
+ * @brief Load generator : emulate many boards and measure a consumer
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <deque>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pty.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+#include "trh_emulator.hpp"
+
+namespace {
+
+/* Max bytes waiting for a device (consumer too slow), lines are lost above */
+constexpr size_t   kBacklog   = 64 * 1024;
+/* Number of lines generated per device and loop in saturation mode */
+constexpr unsigned kBurst     = 16;
+/* Max lines skipped when a record is matched with its send time */
+constexpr size_t   kSkip      = 64;
+constexpr size_t   kBuckets   = 640;
+
+volatile sig_atomic_t g_stop = 0;
+
+void on_signal(int)
+{
+	g_stop = 1;
+}
+
+uint64_t mono_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000 + uint64_t(ts.tv_nsec) / 1000;
+}
+
+struct Sent
+{
+	uint32_t seq;
+	uint64_t time;
+};
+
+struct Device
+{
+	trh::DeviceEmulator emu;
+	int         fd;       /* pty master or fifo (write side)      */
+	int         slave;    /* pty slave, kept open                 */
+	std::string name;     /* Name given to the consumer           */
+	std::string pending;  /* Bytes not yet accepted by the fd     */
+	uint64_t    hold;     /* Split line : rest sent after this    */
+	uint64_t    lost;
+	std::deque<Sent> sent;  /* Lines not yet received by the sink */
+};
+
+/**
+ * Latency histogram : log-linear buckets (16 per power of 2, < 7% error)
+ */
+struct Histogram
+{
+	uint64_t count[kBuckets];
+	uint64_t total;
+	uint64_t max;
+
+	void add(uint64_t v)
+	{
+		size_t idx;
+		if (v < 16)
+			idx = size_t(v);
+		else
+		{
+			int msb = 63 - __builtin_clzll(v);
+			idx = size_t(msb - 3) * 16 + size_t((v >> (msb - 4)) & 0xF);
+		}
+		count[std::min(idx, kBuckets - 1)]++;
+		total++;
+		if (v > max)
+			max = v;
+	}
+	uint64_t percentile(double p) const
+	{
+		uint64_t target = uint64_t(p * double(total));
+		uint64_t n = 0;
+		for (size_t i = 0; i < kBuckets; i++)
+		{
+			n += count[i];
+			if (n > target)
+			{
+				if (i < 16)
+					return i;
+				return uint64_t(16 + (i % 16)) << (i / 16 - 1);
+			}
+		}
+		return max;
+	}
+};
+
+/**
+ * Reader of the consumer output (records of trh_aggd, one per line :
+ * "time_ns,port,sn,seq,...") on a local socket
+ */
+struct Sink
+{
+	int         fd;
+	std::string carry;
+};
+
+struct Stats
+{
+	uint64_t  records;    /* Lines received from the consumer        */
+	uint64_t  matched;    /* Records with a known send time          */
+	uint64_t  first_us;
+	uint64_t  last_us;
+	Histogram lat;
+};
+
+/**
+ * @brief Decode one record and update latency
+ */
+void record(const char *p, const char *end, std::vector<Device> &devs,
+            Stats *st, uint64_t now)
+{
+	unsigned long field[4] = { 0, 0, 0, 0 };
+	bool present[4] = { false, false, false, false };
+	int f = 0;
+
+	for (; (p < end) && (f < 4); p++)
+	{
+		if (*p == ',')
+			f++;
+		else if ((f < 4) && (*p >= '0') && (*p <= '9'))
+		{
+			field[f] = field[f] * 10 + unsigned(*p - '0');
+			present[f] = true;
+		}
+	}
+	st->records++;
+	if (!st->first_us)
+		st->first_us = now;
+	st->last_us = now;
+	if (!present[1] || !present[3] || (field[1] >= devs.size()))
+		return;
+	/* Records of a board are received in order, older lines were lost */
+	std::deque<Sent> &sent = devs[field[1]].sent;
+	size_t n = std::min(sent.size(), kSkip);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (sent[i].seq == field[3])
+		{
+			st->matched++;
+			st->lat.add(now - sent[i].time);
+			sent.erase(sent.begin(), sent.begin() + long(i) + 1);
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Read available records of a sink connection
+ *
+ * @return bool False when the connection is closed
+ */
+bool sink_read(Sink &sk, std::vector<Device> &devs, Stats *st)
+{
+	char buf[65536];
+
+	ssize_t n = read(sk.fd, buf, sizeof(buf));
+	if (n < 0)
+		return (errno == EAGAIN) || (errno == EINTR);
+	if (n == 0)
+		return false;
+	uint64_t now = mono_us();
+	const char *p = buf, *end = buf + n;
+	while (p < end)
+	{
+		const char *nl = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+		if (!nl)
+		{
+			sk.carry.append(p, size_t(end - p));
+			break;
+		}
+		if (!sk.carry.empty())
+		{
+			sk.carry.append(p, size_t(nl - p));
+			record(sk.carry.data(), sk.carry.data() + sk.carry.size(), devs, st, now);
+			sk.carry.clear();
+		}
+		else
+			record(p, nl, devs, st, now);
+		p = nl + 1;
+	}
+	return true;
+}
+
+/**
+ * @brief Create the port of a device : a pty, or a fifo into a directory
+ */
+bool dev_open(Device &d, size_t idx, const char *fifo_dir)
+{
+	if (fifo_dir)
+	{
+		d.name = std::string(fifo_dir) + "/trh" + std::to_string(idx);
+		unlink(d.name.c_str());
+		if (mkfifo(d.name.c_str(), 0644) < 0)
+			return false;
+		/* Read-write open does not wait for a reader */
+		d.fd    = open(d.name.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		d.slave = -1;
+		return d.fd >= 0;
+	}
+	char name[64];
+	struct termios tio;
+	if (openpty(&d.fd, &d.slave, name, nullptr, nullptr) < 0)
+		return false;
+	/* Raw mode : bytes are received as sent by a board */
+	tcgetattr(d.slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(d.slave, TCSANOW, &tio);
+	fcntl(d.fd, F_SETFL, fcntl(d.fd, F_GETFL) | O_NONBLOCK);
+	fcntl(d.fd, F_SETFD, FD_CLOEXEC);
+	fcntl(d.slave, F_SETFD, FD_CLOEXEC);
+	d.name = name;
+	return true;
+}
+
+/**
+ * @brief Queue the output of a device (lost if the backlog is full)
+ *
+ * With a sink, the send time of each line is kept until its record is
+ * received (latency).
+ * @return bool True if the bytes have been queued
+ */
+bool dev_queue(Device &d, const char *p, size_t len, uint64_t now, bool track)
+{
+	if (d.pending.size() + len > kBacklog)
+	{
+		d.lost++;
+		return false;
+	}
+	d.pending.append(p, len);
+	if (track)
+		d.sent.push_back(Sent{ d.emu.seq(), now });
+	return true;
+}
+
+/**
+ * @brief Write pending bytes of a device (a part only for a split line)
+ */
+void dev_write(Device &d, double split, uint64_t now, uint64_t *bytes)
+{
+	if (d.pending.empty() || (now < d.hold))
+		return;
+	size_t len = d.pending.size();
+	if ((split > 0) && (len > 1) && (double(std::rand()) / RAND_MAX < split))
+	{
+		/* Cut into a line, the rest is sent one ms later */
+		len  = 1 + size_t(std::rand()) % (len - 1);
+		d.hold = now + 1000;
+	}
+	ssize_t n = write(d.fd, d.pending.data(), len);
+	if (n > 0)
+	{
+		d.pending.erase(0, size_t(n));
+		*bytes += uint64_t(n);
+	}
+}
+
+/**
+ * @brief Start the consumer (the shell is replaced, to receive SIGTERM)
+ */
+pid_t spawn(const char *cmd, const char *ports, const char *sink)
+{
+	std::string line = std::string("exec ") + cmd;
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setenv("TRH_PORTS", ports, 1);
+		if (sink)
+			setenv("TRH_SINK", sink, 1);
+		execl("/bin/sh", "sh", "-c", line.c_str(), (char *)nullptr);
+		_exit(127);
+	}
+	return pid;
+}
+
+void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options]\n"
+	                "  -n count  number of emulated boards (default 1)\n"
+	                "  -r rate   lines per second per board (default 1, 0 = max)\n"
+	                "  -d sec    duration (default 10)\n"
+	                "  -f dir    use fifos into dir (default pseudo terminals)\n"
+	                "  -l file   list of ports, one per line (default trh_ports.txt)\n"
+	                "  -s path   receive the consumer records on a local socket\n"
+	                "  -c cmd    start the consumer ($TRH_PORTS and $TRH_SINK)\n"
+	                "  -w ms     delay before the boards start (default 500)\n"
+	                "  -e p      probability of sensor errors (ERROR values)\n"
+	                "  -p p      probability of a line split into two writes\n"
+	                "  -z p      probability of line noise (one bit flipped)\n"
+	                "  -x p      probability of a reset (line cut, banner)\n"
+	                "  -M        no derived values (DEW, AH, HI)\n"
+	                "  -S seed   random seed (default 1)\n",
+	        name);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	trh::EmuFaults faults;
+	unsigned count = 1;
+	double   rate  = 1;
+	double   duration = 10;
+	double   split = 0;
+	unsigned wait_ms = 500;
+	unsigned seed  = 1;
+	bool     metrics = true;
+	const char *fifo_dir = nullptr;
+	const char *list = "trh_ports.txt";
+	const char *sink_path = nullptr;
+	const char *cmd = nullptr;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:d:f:l:s:c:w:e:p:z:x:MS:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': count    = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'r': rate     = strtod(optarg, nullptr); break;
+			case 'd': duration = strtod(optarg, nullptr); break;
+			case 'f': fifo_dir = optarg; break;
+			case 'l': list     = optarg; break;
+			case 's': sink_path = optarg; break;
+			case 'c': cmd      = optarg; break;
+			case 'w': wait_ms  = unsigned(strtoul(optarg, nullptr, 0)); break;
+			case 'e': faults.error = strtod(optarg, nullptr); break;
+			case 'p': split        = strtod(optarg, nullptr); break;
+			case 'z': faults.noise = strtod(optarg, nullptr); break;
+			case 'x': faults.reset = strtod(optarg, nullptr); break;
+			case 'M': metrics  = false; break;
+			case 'S': seed     = unsigned(strtoul(optarg, nullptr, 0)); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if ((count == 0) || (optind != argc))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	std::srand(seed);
+
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+	{
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+
+	/* Create the boards and the list of their ports */
+	std::vector<Device> devs;
+	devs.reserve(count);
+	FILE *fp = fopen(list, "w");
+	if (!fp)
+	{
+		fprintf(stderr, "%s: %s\n", list, strerror(errno));
+		return 1;
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		devs.push_back(Device{ trh::DeviceEmulator(0x5A00000000000000ull | i,
+		                                           seed * 7919 + i, metrics),
+		                       -1, -1, std::string(), std::string(), 0, 0,
+		                       std::deque<Sent>() });
+		if (!dev_open(devs.back(), i, fifo_dir))
+		{
+			fprintf(stderr, "board %u: %s\n", i, strerror(errno));
+			return 1;
+		}
+		fprintf(fp, "%s\n", devs.back().name.c_str());
+	}
+	fclose(fp);
+
+	/* Socket where the consumer sends its records */
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	int lsock = -1;
+	struct epoll_event ev;
+	if (sink_path)
+	{
+		struct sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, sink_path, sizeof(addr.sun_path) - 1);
+		unlink(sink_path);
+		lsock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if ((lsock < 0) ||
+		    (bind(lsock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0) ||
+		    (listen(lsock, 8) < 0))
+		{
+			fprintf(stderr, "%s: %s\n", sink_path, strerror(errno));
+			return 1;
+		}
+		ev.events   = EPOLLIN;
+		ev.data.u64 = ~uint64_t(0);
+		epoll_ctl(ep, EPOLL_CTL_ADD, lsock, &ev);
+	}
+
+	struct sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT,  &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	pid_t child = cmd ? spawn(cmd, list, sink_path) : -1;
+	if (!cmd)
+		printf("%u board(s), ports listed into %s\n", count, list);
+	fflush(stdout);
+
+	std::vector<Sink> sinks;
+	Stats st;
+	std::memset(&st, 0, sizeof(st));
+	char buf[trh::DeviceEmulator::kMaxOutput * kBurst];
+	uint64_t bytes = 0;
+	uint64_t lines = 0;
+
+	/* Let the consumer open the ports before the banners are sent */
+	uint64_t t0  = mono_us() + uint64_t(wait_ms) * 1000;
+	uint64_t end = t0 + uint64_t(duration * 1e6);
+	uint64_t drain = end + 3000000;
+	uint64_t next = 0;        /* Index of the next line (all boards) */
+	double   step = (rate > 0) ? 1e6 / (rate * count) : 0;
+	bool     started = false;
+	bool     track = (sink_path != nullptr);
+
+	while (!g_stop)
+	{
+		uint64_t now = mono_us();
+		bool running = (now >= t0) && (now < end);
+
+		if (running && !started)
+		{
+			for (Device &d : devs)
+				dev_queue(d, buf, d.emu.start(buf), now, false);
+			started = true;
+		}
+		if (running)
+		{
+			if (rate > 0)
+			{
+				/* Boards are spread over the period */
+				while (t0 + uint64_t(double(next) * step) <= now)
+				{
+					Device &d = devs[next % count];
+					lines += dev_queue(d, buf, d.emu.sample(buf, faults), now, track);
+					next++;
+				}
+			}
+			else
+			{
+				for (Device &d : devs)
+				{
+					if (d.pending.size() >= kBacklog / 2)
+						continue;
+					for (unsigned k = 0; k < kBurst; k++)
+						lines += dev_queue(d, buf, d.emu.sample(buf, faults), now, track);
+				}
+			}
+		}
+		bool pending = false;
+		for (Device &d : devs)
+		{
+			dev_write(d, split, now, &bytes);
+			pending |= !d.pending.empty();
+		}
+
+		/* End : all bytes sent, and all records received (or timeout) */
+		if ((now >= end) && (!pending || (now >= drain)))
+		{
+			if (!sink_path || sinks.empty() || (st.records >= lines) ||
+			    (now >= drain))
+				break;
+		}
+
+		/* Wait for the consumer (or the next line) */
+		int timeout = 1;
+		if ((rate > 0) && !pending && running)
+		{
+			uint64_t due = t0 + uint64_t(double(next) * step);
+			timeout = (due > now) ? int(std::min<uint64_t>((due - now) / 1000, 100)) : 0;
+		}
+		else if (running && (rate <= 0))
+			timeout = 0;
+		struct epoll_event evs[64];
+		int n = epoll_wait(ep, evs, 64, timeout);
+		for (int i = 0; i < n; i++)
+		{
+			if (evs[i].data.u64 == ~uint64_t(0))
+			{
+				int fd = accept4(lsock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0)
+					continue;
+				ev.events   = EPOLLIN;
+				ev.data.u64 = sinks.size();
+				epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+				sinks.push_back(Sink{ fd, std::string() });
+				continue;
+			}
+			Sink &sk = sinks[evs[i].data.u64];
+			if ((sk.fd >= 0) && !sink_read(sk, devs, &st))
+			{
+				epoll_ctl(ep, EPOLL_CTL_DEL, sk.fd, nullptr);
+				close(sk.fd);
+				sk.fd = -1;
+			}
+		}
+	}
+
+	/* Stop the consumer, then read its last records */
+	if (child > 0)
+	{
+		kill(child, SIGTERM);
+		uint64_t limit = mono_us() + 2000000;
+		bool open = true;
+		while (open && (mono_us() < limit))
+		{
+			struct epoll_event evs[64];
+			int n = epoll_wait(ep, evs, 64, 10);
+			for (int i = 0; i < n; i++)
+			{
+				if (evs[i].data.u64 == ~uint64_t(0))
+					continue;
+				Sink &sk = sinks[evs[i].data.u64];
+				if ((sk.fd >= 0) && !sink_read(sk, devs, &st))
+				{
+					epoll_ctl(ep, EPOLL_CTL_DEL, sk.fd, nullptr);
+					close(sk.fd);
+					sk.fd = -1;
+				}
+			}
+			open = false;
+			for (const Sink &sk : sinks)
+				open |= (sk.fd >= 0);
+			if (sinks.empty())
+				open = (waitpid(child, nullptr, WNOHANG) == 0);
+		}
+		waitpid(child, nullptr, 0);
+	}
+
+	uint64_t lost = 0;
+	for (const Device &d : devs)
+		lost += d.lost;
+	double secs = double(std::min(mono_us(), end) - t0) / 1e6;
+	printf("Sent: %u board(s), %llu lines, %llu bytes in %.2f s (%.0f lines/s, %.2f MB/s)\n",
+	       count, (unsigned long long)lines, (unsigned long long)bytes, secs,
+	       double(lines) / secs, double(bytes) / secs / 1e6);
+	if (lost)
+		printf("Lost: %llu lines (consumer too slow, backlog full)\n",
+		       (unsigned long long)lost);
+	if (sink_path)
+	{
+		double rsecs = double(st.last_us - st.first_us) / 1e6;
+		printf("Received: %llu records, %llu matched", (unsigned long long)st.records,
+		       (unsigned long long)st.matched);
+		if (rsecs > 0)
+			printf(", %.0f records/s", double(st.records) / rsecs);
+		printf("\n");
+		if (st.lat.total)
+			printf("Latency (us): p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+			       (unsigned long long)st.lat.percentile(0.50),
+			       (unsigned long long)st.lat.percentile(0.90),
+			       (unsigned long long)st.lat.percentile(0.99),
+			       (unsigned long long)st.lat.percentile(0.999),
+			       (unsigned long long)st.lat.max);
+		unlink(sink_path);
+	}
+	if (fifo_dir)
+	{
+		for (const Device &d : devs)
+			unlink(d.name.c_str());
+	}
+	return 0;
+}
+/* EOF */
@@ -0,0 +1,123 @@
+/**
+ * @file  trh_trace.cpp
+ * @brief Decoder of MTB trace dumps (TRACE DUMP command)
+ *
+ * @author Saint-Genest Gwenael <gwen@cowlab.fr>
+ * @copyright Cowlab (c) 2022
+ *
+ * @page License
+ * This software is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3 as published
+ * by the Free Software Foundation. You should have received a copy of the
+ * GNU General Public License along with this program, see LICENSE.md file
+ * for more details.
+ * This program is distributed WITHOUT ANY WARRANTY.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "trh_elf.hpp"
+
+namespace {
+
+/* One MTB packet : a non sequential change of PC (branch, exception) */
+struct Packet
+{
+	uint32_t src;
+	uint32_t dst;
+	bool     exception;  /* A-bit : exception entry or return             */
+	bool     start;      /* S-bit : first packet after the trace started    */
+};
+
+/**
+ * @brief Read packets ("T <source> <destination>" lines) from a dump
+ */
+std::vector<Packet> read_dump(FILE *fp)
+{
+	std::vector<Packet> pkts;
+	char line[128];
+	unsigned int a, b;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (sscanf(line, "T %x %x", &a, &b) != 2)
+			continue;
+		pkts.push_back({ a & ~1u, b & ~1u, (a & 1) != 0, (b & 1) != 0 });
+	}
+	return pkts;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	if ((argc < 2) || (argc > 3))
+	{
+		fprintf(stderr, "Usage: %s <trh7021.elf> [dump.txt]\n", argv[0]);
+		return 1;
+	}
+
+	trh::SymbolTable syms;
+	std::string err;
+	if (!syms.load(argv[1], &err))
+	{
+		fprintf(stderr, "%s: %s\n", argv[1], err.c_str());
+		return 1;
+	}
+	FILE *fp = (argc == 3) ? fopen(argv[2], "r") : stdin;
+	if (!fp)
+	{
+		fprintf(stderr, "%s: cannot open file\n", argv[2]);
+		return 1;
+	}
+	std::vector<Packet> pkts = read_dump(fp);
+	if (fp != stdin)
+		fclose(fp);
+	if (pkts.empty())
+	{
+		fprintf(stderr, "No trace packet found\n");
+		return 1;
+	}
+
+	/* Branch flow, oldest first */
+	for (size_t i = 0; i < pkts.size(); i++)
+	{
+		const Packet &p = pkts[i];
+		printf("%4zu  %-28s -> %-28s%s%s\n", i,
+		       syms.describe(p.src).c_str(), syms.describe(p.dst).c_str(),
+		       p.exception ? " [exception]" : "", p.start ? " [start]" : "");
+	}
+
+	/*
+	 * Code between two packets is executed sequentially : from the
+	 * destination of a packet to the source of the next one. This gives
+	 * the number of (16 bits) instructions executed into each function.
+	 */
+	std::map<std::string, uint64_t> insns;
+	uint64_t total = 0;
+	for (size_t i = 0; i + 1 < pkts.size(); i++)
+	{
+		uint32_t from = pkts[i].dst;
+		uint32_t to   = pkts[i + 1].src;
+		if (pkts[i + 1].start || (to < from) || (to - from > 4096))
+			continue;
+		const trh::Symbol *s = syms.find(from);
+		uint64_t n = ((to - from) / 2) + 1;
+		insns[s ? s->name : std::string("?")] += n;
+		total += n;
+	}
+
+	std::vector<std::pair<std::string, uint64_t>> hot(insns.begin(), insns.end());
+	std::sort(hot.begin(), hot.end(),
+	          [](const auto &a, const auto &b) { return a.second > b.second; });
+	printf("\n%zu packets, ~%" PRIu64 " instructions\n", pkts.size(), total);
+	for (const auto &h : hot)
+		printf("  %-28s %8" PRIu64 " %5.1f%%\n", h.first.c_str(), h.second,
+		       total ? (100.0 * h.second / total) : 0.0);
+	return 0;
+}
+/* EOF */